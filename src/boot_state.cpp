@@ -0,0 +1,42 @@
+#include <Preferences.h>
+#include <string.h>
+#include "boot_state.h"
+
+static const char* const NAMESPACE = "pov";
+static const char* const KEY = "boot";
+
+// Last state read or written, so unchanged states are not written again
+static BootState stored;
+static bool storedValid = false;
+
+bool loadBootState(BootState& state) {
+    Preferences prefs;
+    if (!prefs.begin(NAMESPACE, true)) {
+        return false;
+    }
+    size_t len = prefs.getBytes(KEY, &state, sizeof(state));
+    prefs.end();
+    if (len != sizeof(state) || state.version != BOOT_STATE_VERSION) {
+        return false;
+    }
+    state.item[BOOT_ITEM_NAME_LEN - 1] = '\0';
+    stored = state;
+    storedValid = true;
+    return true;
+}
+
+void saveBootState(const BootState& state) {
+    if (storedValid && memcmp(&stored, &state, sizeof(state)) == 0) {
+        return;
+    }
+    Preferences prefs;
+    if (!prefs.begin(NAMESPACE, false)) {
+        Serial.println("Could not open the nvs partition, the display state is not kept");
+        return;
+    }
+    if (prefs.putBytes(KEY, &state, sizeof(state)) == sizeof(state)) {
+        stored = state;
+        storedValid = true;
+    }
+    prefs.end();
+}
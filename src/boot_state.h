@@ -0,0 +1,28 @@
+#ifndef BOOT_STATE_H
+#define BOOT_STATE_H
+#include <stdint.h>
+#include <stddef.h>
+
+// What the display showed last, kept in the nvs partition so that power-on
+// goes straight back to it instead of waiting in the menu for a command.
+// Written whenever a command changes it, read once at boot.
+
+const uint8_t BOOT_STATE_VERSION = 3;
+const size_t BOOT_ITEM_NAME_LEN = 32;
+
+struct BootState {
+    uint8_t version;
+    uint8_t mode;                        // Mode in display.cpp
+    uint8_t subMode;                     // SubMode, for text
+    uint8_t effect;                      // builtinEffects index
+    char item[BOOT_ITEM_NAME_LEN];       // file name in the mode's directory, "" for none
+    uint32_t generation;                 // content generation the item belongs to
+    uint32_t columnIntervalNs;           // calibration: time per display column, 0 for the default
+};
+
+// False if nothing was saved yet or it was saved by a different layout
+bool loadBootState(BootState& state);
+// Only touches flash when the state differs from what is stored
+void saveBootState(const BootState& state);
+
+#endif // BOOT_STATE_H
@@ -0,0 +1,43 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+#include <stdint.h>
+#include <stddef.h>
+
+// Content hash used to key stored frames and images (64 bit FNV-1a).
+// Kept free of Arduino headers so the host tools produce the same keys.
+const uint64_t CONTENT_HASH_SEED = 0xcbf29ce484222325ULL;
+
+// Pass the previous result back in as seed to hash data arriving in chunks
+inline uint64_t contentHash(const uint8_t* data, size_t len, uint64_t seed = CONTENT_HASH_SEED) {
+    uint64_t h = seed;
+    for (size_t i = 0; i < len; i++) {
+        h ^= data[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// CRC32 (IEEE, same result as zlib crc32), chainable like contentHash.
+// The ESP32 ROM has a table driven version, the host falls back to a nibble table.
+#ifdef ESP_PLATFORM
+#include <esp_rom_crc.h>
+inline uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len) {
+    return esp_rom_crc32_le(crc, data, len);
+}
+#else
+inline uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len) {
+    static const uint32_t nibbleTable[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+    };
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ nibbleTable[crc & 0x0f];
+        crc = (crc >> 4) ^ nibbleTable[crc & 0x0f];
+    }
+    return ~crc;
+}
+#endif
+
+#endif // CHECKSUM_H
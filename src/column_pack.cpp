@@ -0,0 +1,185 @@
+#include "column_pack.h"
+
+// COLUMN_PACK_SCALAR builds only the table kernel, to test it on a host
+#if defined(COLUMN_PACK_SCALAR)
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COLUMN_PACK_SSSE3
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define COLUMN_PACK_NEON
+#endif
+
+// Pin assignments of the three controller types within a block of 16 LEDs,
+// LED numbers are 1 based within the block. Index 15 represents the top pin.
+enum Channel : uint8_t { R = 0, G = 1, B = 2 };
+typedef struct {
+    uint8_t led;
+    Channel channel;
+} Pin;
+
+const Pin controller1Pins[16] = {
+    {1, G}, {1, R}, {2, R}, {2, G}, {1, B}, {2, B}, {3, G}, {3, B},
+    {4, B}, {5, B}, {5, R}, {6, G}, {5, G}, {4, R}, {4, G}, {3, R}
+};
+const Pin controller2Pins[16] = {
+    {8, R}, {8, G}, {7, G}, {6, R}, {6, B}, {7, B}, {7, R}, {8, B},
+    {9, B}, {10, B}, {11, B}, {10, R}, {11, G}, {10, G}, {9, R}, {9, G}
+};
+const Pin controller3Pins[16] = {
+    {11, R}, {13, R}, {13, G}, {12, G}, {12, B}, {12, R}, {13, B}, {14, B},
+    {14, R}, {15, B}, {16, B}, {15, R}, {16, G}, {16, R}, {15, G}, {14, G}
+};
+// The last, partial block starts at LED 177; only its first 10 pins are sent
+const Pin controller4Pins[10] = {
+    {9, G}, {11, R}, {10, G}, {10, R}, {11, B}, {10, B}, {9, B}, {8, B}, {8, R}, {7, B}
+};
+
+const uint16_t NO_CHANNEL = 0xffff;
+uint16_t wireMap[WIRE_WORDS];  // byte offset into the RGB column for each wire word
+
+// The 11 full blocks repeat one pattern: 48 words from the 48 bytes of their
+// 16 LEDs. The kernels permute a block at a time and finish the partial
+// 12th block from wireMap.
+const size_t FULL_BLOCKS = 11;
+const size_t BLOCK_BYTES = 48;
+uint8_t blockPattern[BLOCK_BYTES];  // byte within the block for each word of the block
+
+static void mapController(size_t& w, const Pin* pins, size_t count, int firstLed) {
+    for (size_t j = 0; j < count; j++) {
+        int led = firstLed + pins[j].led - 1;
+        // Pin 11 of the partial block would be LED 187, past the end of the column
+        wireMap[w++] = led < HEIGHT ? led * 3 + pins[j].channel : NO_CHANNEL;
+    }
+}
+
+// No per word branch and a byte table instead of the 16 bit map; the ESP32-S3
+// vector unit has no byte permute, so this is the device kernel
+static void packBlocksTable(const uint8_t* bytes, uint16_t* wire) {
+    for (size_t b = 0; b < FULL_BLOCKS; b++) {
+        for (size_t j = 0; j < BLOCK_BYTES; j += 4) {
+            wire[j] = bytes[blockPattern[j]] << 8;
+            wire[j + 1] = bytes[blockPattern[j + 1]] << 8;
+            wire[j + 2] = bytes[blockPattern[j + 2]] << 8;
+            wire[j + 3] = bytes[blockPattern[j + 3]] << 8;
+        }
+        bytes += BLOCK_BYTES;
+        wire += BLOCK_BYTES;
+    }
+}
+
+static void (*packBlocks)(const uint8_t*, uint16_t*) = packBlocksTable;
+static const char* packBlocksName = "table";
+
+// Each output vector is 8 words; its high bytes can come from any of the
+// block's three 16 byte chunks and the low bytes are zero, so one shuffle
+// mask per (vector, chunk) picks the bytes that chunk supplies
+#if defined(COLUMN_PACK_SSSE3) || defined(COLUMN_PACK_NEON)
+const size_t BLOCK_VECTORS = BLOCK_BYTES / 8;
+uint8_t shuffleMasks[BLOCK_VECTORS][3][16];
+
+static void buildShuffleMasks(bool singleTable) {
+    for (size_t v = 0; v < BLOCK_VECTORS; v++) {
+        for (size_t c = 0; c < 3; c++) {
+            for (size_t i = 0; i < 8; i++) {
+                uint8_t source = blockPattern[v * 8 + i];
+                shuffleMasks[v][c][2 * i] = 0xff;  // out of range, gives 0
+                if (singleTable) {
+                    shuffleMasks[v][c][2 * i + 1] = source;
+                } else {
+                    shuffleMasks[v][c][2 * i + 1] = source / 16 == c ? source % 16 : 0xff;
+                }
+            }
+        }
+    }
+}
+#endif
+
+#ifdef COLUMN_PACK_SSSE3
+__attribute__((target("ssse3"))) static void packBlocksSsse3(const uint8_t* bytes, uint16_t* wire) {
+    __m128i masks[BLOCK_VECTORS][3];
+    for (size_t v = 0; v < BLOCK_VECTORS; v++) {
+        for (size_t c = 0; c < 3; c++) {
+            masks[v][c] = _mm_loadu_si128((const __m128i*)shuffleMasks[v][c]);
+        }
+    }
+    for (size_t b = 0; b < FULL_BLOCKS; b++) {
+        __m128i chunk0 = _mm_loadu_si128((const __m128i*)bytes);
+        __m128i chunk1 = _mm_loadu_si128((const __m128i*)(bytes + 16));
+        __m128i chunk2 = _mm_loadu_si128((const __m128i*)(bytes + 32));
+        for (size_t v = 0; v < BLOCK_VECTORS; v++) {
+            __m128i words = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(chunk0, masks[v][0]),
+                                                      _mm_shuffle_epi8(chunk1, masks[v][1])),
+                                         _mm_shuffle_epi8(chunk2, masks[v][2]));
+            _mm_storeu_si128((__m128i*)(wire + v * 8), words);
+        }
+        bytes += BLOCK_BYTES;
+        wire += BLOCK_BYTES;
+    }
+}
+#endif
+
+#ifdef COLUMN_PACK_NEON
+// TBL looks up in all 48 bytes at once, one instruction per vector
+static void packBlocksNeon(const uint8_t* bytes, uint16_t* wire) {
+    for (size_t b = 0; b < FULL_BLOCKS; b++) {
+        uint8x16x3_t block = {{vld1q_u8(bytes), vld1q_u8(bytes + 16), vld1q_u8(bytes + 32)}};
+        for (size_t v = 0; v < BLOCK_VECTORS; v++) {
+            vst1q_u8((uint8_t*)(wire + v * 8), vqtbl3q_u8(block, vld1q_u8(shuffleMasks[v][0])));
+        }
+        bytes += BLOCK_BYTES;
+        wire += BLOCK_BYTES;
+    }
+}
+#endif
+
+static void initBlockKernel() {
+#if defined(COLUMN_PACK_SSSE3)
+    if (__builtin_cpu_supports("ssse3")) {
+        buildShuffleMasks(false);
+        packBlocks = packBlocksSsse3;
+        packBlocksName = "ssse3";
+    }
+#elif defined(COLUMN_PACK_NEON)
+    buildShuffleMasks(true);
+    packBlocks = packBlocksNeon;
+    packBlocksName = "neon";
+#endif
+}
+
+void initColumnPack() {
+    size_t w = 0;
+    for (int i = 0; i < 11; i++) {
+        mapController(w, controller1Pins, 16, 16 * i);
+        mapController(w, controller2Pins, 16, 16 * i);
+        mapController(w, controller3Pins, 16, 16 * i);
+    }
+    mapController(w, controller1Pins, 16, 16 * 11);
+    mapController(w, controller4Pins, 10, 176);
+
+    for (size_t j = 0; j < BLOCK_BYTES; j++) {
+        blockPattern[j] = wireMap[j];
+    }
+    initBlockKernel();
+}
+
+void packColumnReference(const RGB* column, uint16_t* wire) {
+    const uint8_t* bytes = (const uint8_t*)column;
+    for (size_t w = 0; w < WIRE_WORDS; w++) {
+        uint16_t offset = wireMap[w];
+        wire[w] = offset == NO_CHANNEL ? 0 : bytes[offset] << 8;
+    }
+}
+
+void packColumn(const RGB* column, uint16_t* wire) {
+    const uint8_t* bytes = (const uint8_t*)column;
+    packBlocks(bytes, wire);
+    for (size_t w = FULL_BLOCKS * BLOCK_BYTES; w < WIRE_WORDS; w++) {
+        uint16_t offset = wireMap[w];
+        wire[w] = offset == NO_CHANNEL ? 0 : bytes[offset] << 8;
+    }
+}
+
+const char* columnPackKernel() {
+    return packBlocksName;
+}
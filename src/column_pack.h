@@ -0,0 +1,34 @@
+#ifndef COLUMN_PACK_H
+#define COLUMN_PACK_H
+#include <stdint.h>
+#include <stddef.h>
+#include "display_types.h"
+
+// One display column in the order it is shifted out over SPI: for each of the
+// 11 full blocks the 16 channels of controller set 1, 2 and 3, then set 1 of
+// the 12th block, then the first 10 channels of set 4. Each word is a 16 bit
+// brightness with the 8 bit colour value in the top byte.
+const size_t WIRE_WORDS = 11 * 48 + 16 + 10;
+
+// Builds the channel -> column byte table, call once before packing
+void initColumnPack();
+
+// RGB column (HEIGHT LEDs, row 0 on top) to wire words, with the fastest
+// kernel for the CPU: byte shuffles on SSSE3 and NEON hosts, a per block
+// table elsewhere. Every kernel gives the same words as packColumnReference.
+void packColumn(const RGB* column, uint16_t* wire);
+
+// One table lookup per word, the definition of the wire order
+void packColumnReference(const RGB* column, uint16_t* wire);
+
+// Name of the kernel packColumn uses, valid after initColumnPack
+const char* columnPackKernel();
+
+// Combine columns with disjoint lit channels, e.g. text lines in the same colour
+inline void orWireColumn(uint16_t* dst, const uint16_t* src) {
+    for (size_t i = 0; i < WIRE_WORDS; i++) {
+        dst[i] |= src[i];
+    }
+}
+
+#endif // COLUMN_PACK_H
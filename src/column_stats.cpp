@@ -0,0 +1,169 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "column_stats.h"
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#endif
+
+#if COLUMN_STATS
+static CoreStats coreStats[STATS_CORES];
+static uint32_t deadline = 0;
+
+static inline size_t currentCore() {
+#ifdef ESP_PLATFORM
+    return (size_t)xPortGetCoreID() % STATS_CORES;
+#else
+    return 0;
+#endif
+}
+
+static inline size_t bucketOf(uint32_t cycles) {
+    size_t bucket = cycles == 0 ? 0 : 31 - __builtin_clz(cycles);
+    return bucket < STATS_BUCKETS ? bucket : STATS_BUCKETS - 1;
+}
+
+static inline void add(StageStats& s, uint32_t cycles) {
+    s.count++;
+    s.totalCycles += cycles;
+    if (cycles > s.maxCycles) {
+        s.maxCycles = cycles;
+    }
+    s.buckets[bucketOf(cycles)]++;
+}
+
+void statsBegin(uint32_t deadlineCycles) {
+    deadline = deadlineCycles;
+}
+
+void statsRecord(StatsStage stage, uint32_t cycles) {
+    add(coreStats[currentCore()].stages[stage], cycles);
+}
+
+void statsColumn(uint32_t cycles, uint32_t ms) {
+    CoreStats& c = coreStats[currentCore()];
+    add(c.stages[STAGE_COLUMN], cycles);
+    if (deadline != 0 && cycles > deadline) {
+        c.missRing[c.misses % STATS_MISS_RING] = {ms, cycles};
+        c.misses++;
+    }
+}
+
+void statsReset() {
+    memset(&coreStats[currentCore()], 0, sizeof(CoreStats));
+}
+
+bool statsSnapshot(size_t core, CoreStats& out) {
+    if (core >= STATS_CORES) {
+        return false;
+    }
+    // The 32 bit counters are read whole even while the core writes; only the
+    // 64 bit total can be caught between its two halves
+    memcpy(&out, (const void*)&coreStats[core], sizeof(CoreStats));
+    return true;
+}
+
+uint32_t statsDeadlineCycles() {
+    return deadline;
+}
+#else
+bool statsSnapshot(size_t, CoreStats&) {
+    return false;
+}
+
+uint32_t statsDeadlineCycles() {
+    return 0;
+}
+#endif
+
+const char* statsStageName(StatsStage stage) {
+    static const char* const names[STAGE_COUNT] = {"pack", "spi", "latch", "column"};
+    return stage < STAGE_COUNT ? names[stage] : "?";
+}
+
+// Upper bound of the bucket holding the given fraction of the samples, at most the maximum
+static uint32_t percentile(const StageStats& s, uint32_t perMille) {
+    uint64_t wanted = ((uint64_t)s.count * perMille + 999) / 1000;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < STATS_BUCKETS; b++) {
+        seen += s.buckets[b];
+        if (seen >= wanted && seen > 0) {
+            uint32_t bound = b + 1 < STATS_BUCKETS ? (2u << b) - 1 : s.maxCycles;
+            return bound < s.maxCycles ? bound : s.maxCycles;
+        }
+    }
+    return 0;
+}
+
+// snprintf that keeps appending at `at` without running past size
+static void append(char* out, size_t size, size_t& at, const char* format, ...) __attribute__((format(printf, 4, 5)));
+static void append(char* out, size_t size, size_t& at, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(at < size ? out + at : nullptr, at < size ? size - at : 0, format, args);
+    va_end(args);
+    at += n > 0 ? n : 0;
+}
+
+size_t formatStatsText(char* out, size_t size) {
+    size_t at = 0;
+    if (size > 0) {
+        out[0] = '\0';
+    }
+    CoreStats c;
+    if (!statsSnapshot(0, c)) {
+        append(out, size, at, "Stats are compiled out of release builds\n");
+        return at;
+    }
+    append(out, size, at, "deadline %u cycles per column\n", (unsigned)statsDeadlineCycles());
+    for (size_t core = 0; core < STATS_CORES && statsSnapshot(core, c); core++) {
+        if (c.stages[STAGE_COLUMN].count == 0 && c.stages[STAGE_SPI].count == 0) {
+            continue;
+        }
+        append(out, size, at, "core %u: %u deadline misses\n", (unsigned)core, (unsigned)c.misses);
+        for (size_t st = 0; st < STAGE_COUNT; st++) {
+            const StageStats& s = c.stages[st];
+            append(out, size, at, "  %-7s n=%u mean=%u p50<=%u p99<=%u max=%u\n", statsStageName((StatsStage)st),
+                   (unsigned)s.count, (unsigned)(s.count ? s.totalCycles / s.count : 0),
+                   (unsigned)percentile(s, 500), (unsigned)percentile(s, 990), (unsigned)s.maxCycles);
+        }
+    }
+    return at;
+}
+
+size_t formatStatsJson(char* out, size_t size) {
+    size_t at = 0;
+    if (size > 0) {
+        out[0] = '\0';
+    }
+    CoreStats c;
+    if (!statsSnapshot(0, c)) {
+        append(out, size, at, "{\"enabled\":false}");
+        return at;
+    }
+    append(out, size, at, "{\"enabled\":true,\"deadline\":%u,\"cores\":[", (unsigned)statsDeadlineCycles());
+    for (size_t core = 0; core < STATS_CORES && statsSnapshot(core, c); core++) {
+        append(out, size, at, "%s{\"misses\":%u,\"recentMisses\":[", core ? "," : "", (unsigned)c.misses);
+        size_t kept = c.misses < STATS_MISS_RING ? c.misses : STATS_MISS_RING;
+        for (size_t i = 0; i < kept; i++) {
+            const DeadlineMiss& m = c.missRing[(c.misses - kept + i) % STATS_MISS_RING];
+            append(out, size, at, "%s{\"ms\":%u,\"cycles\":%u}", i ? "," : "", (unsigned)m.ms, (unsigned)m.cycles);
+        }
+        append(out, size, at, "],\"stages\":{");
+        for (size_t st = 0; st < STAGE_COUNT; st++) {
+            const StageStats& s = c.stages[st];
+            append(out, size, at, "%s\"%s\":{\"count\":%u,\"mean\":%u,\"p50\":%u,\"p99\":%u,\"max\":%u,\"buckets\":[",
+                   st ? "," : "", statsStageName((StatsStage)st), (unsigned)s.count,
+                   (unsigned)(s.count ? s.totalCycles / s.count : 0), (unsigned)percentile(s, 500),
+                   (unsigned)percentile(s, 990), (unsigned)s.maxCycles);
+            for (size_t b = 0; b < STATS_BUCKETS; b++) {
+                append(out, size, at, "%s%u", b ? "," : "", (unsigned)s.buckets[b]);
+            }
+            append(out, size, at, "]}");
+        }
+        append(out, size, at, "}}");
+    }
+    append(out, size, at, "]}");
+    return at;
+}
@@ -0,0 +1,95 @@
+#ifndef COLUMN_STATS_H
+#define COLUMN_STATS_H
+#include <stdint.h>
+#include <stddef.h>
+
+// Timing of the column path: how many CPU cycles packing, the SPI transfer
+// and latching take, and how often a whole column runs over its time.
+//
+// Every core writes only its own counters, so recording takes no lock and
+// never waits on a reader. Readers (the serial 'stats' command, GET /stats)
+// copy the counters while the display keeps running; a snapshot taken in
+// the middle of a column can be one sample out between stages.
+//
+// Histograms have one bucket per power of two cycles. Release builds
+// (-DPOV_RELEASE, the -release environment in platformio.ini) compile all
+// of it out: the record calls are empty and the readers report nothing.
+
+#ifndef POV_RELEASE
+#define COLUMN_STATS 1
+#else
+#define COLUMN_STATS 0
+#endif
+
+enum StatsStage : uint8_t {
+    STAGE_PACK,      // RGB column to wire words
+    STAGE_SPI,       // shifting the words out
+    STAGE_LATCH,     // latch enable pulse
+    STAGE_COLUMN,    // all of the above for one column, against the deadline
+    STAGE_COUNT
+};
+
+const size_t STATS_BUCKETS = 24;        // bucket i: 2^i .. 2^(i+1)-1 cycles, the last one is open
+const size_t STATS_CORES = 2;
+const size_t STATS_MISS_RING = 16;      // latest deadline misses kept per core
+
+struct StageStats {
+    uint32_t count;
+    uint32_t maxCycles;
+    uint64_t totalCycles;
+    uint32_t buckets[STATS_BUCKETS];
+};
+
+struct DeadlineMiss {
+    uint32_t ms;        // millis() when the column finished
+    uint32_t cycles;    // what the column took
+};
+
+struct CoreStats {
+    StageStats stages[STAGE_COUNT];
+    uint32_t misses;
+    DeadlineMiss missRing[STATS_MISS_RING];   // written at misses % STATS_MISS_RING
+};
+
+#if COLUMN_STATS
+#ifdef ESP_PLATFORM
+#include <Arduino.h>
+inline uint32_t statsCycles() {
+    return ESP.getCycleCount();
+}
+#else
+#include <chrono>
+// Nanoseconds stand in for cycles on the host
+inline uint32_t statsCycles() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+// Cycles one column may take, ROWINTERVAL at the CPU clock
+void statsBegin(uint32_t deadlineCycles);
+void statsRecord(StatsStage stage, uint32_t cycles);
+// A finished column: records STAGE_COLUMN and counts a miss when it is over the deadline
+void statsColumn(uint32_t cycles, uint32_t ms);
+// Zeroes the calling core's counters, call from the core that records
+void statsReset();
+#else
+inline uint32_t statsCycles() { return 0; }
+inline void statsBegin(uint32_t) {}
+inline void statsRecord(StatsStage, uint32_t) {}
+inline void statsColumn(uint32_t, uint32_t) {}
+inline void statsReset() {}
+#endif
+
+// Copy of one core's counters, false when stats are compiled out
+bool statsSnapshot(size_t core, CoreStats& out);
+uint32_t statsDeadlineCycles();
+const char* statsStageName(StatsStage stage);
+
+// Readable summaries of every core: one line per stage with count, mean,
+// p50/p99 (bucket upper bounds), max and misses; or the same as JSON with
+// the bucket counts. Return the length written, like snprintf.
+size_t formatStatsText(char* out, size_t size);
+size_t formatStatsJson(char* out, size_t size);
+
+#endif // COLUMN_STATS_H
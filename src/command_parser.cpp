@@ -0,0 +1,144 @@
+#include <string.h>
+#include "command_parser.h"
+
+bool Token::equals(const char* s) const {
+    return strlen(s) == len && memcmp(ptr, s, len) == 0;
+}
+
+bool Token::toU32(uint32_t& out) const {
+    if (len == 0 || len > 10) {
+        return false;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (ptr[i] < '0' || ptr[i] > '9') {
+            return false;
+        }
+        value = value * 10 + (ptr[i] - '0');
+    }
+    if (value > 0xffffffffULL) {
+        return false;
+    }
+    out = (uint32_t)value;
+    return true;
+}
+
+size_t Token::copyTo(char* dst, size_t size) const {
+    if (size == 0) {
+        return 0;
+    }
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, ptr, n);
+    dst[n] = '\0';
+    return n;
+}
+
+bool parseCommand(const char* line, size_t len, Command& cmd, size_t maxTokens) {
+    if (maxTokens == 0 || maxTokens > MAX_COMMAND_TOKENS) {
+        maxTokens = MAX_COMMAND_TOKENS;
+    }
+    cmd.argc = 0;
+    if (len == 0) {
+        cmd.verb = {line, 0};
+        return false;
+    }
+
+    Token* tokens[MAX_COMMAND_TOKENS] = {&cmd.verb, &cmd.args[0], &cmd.args[1], &cmd.args[2]};
+    size_t start = 0;
+    size_t n = 0;
+    for (size_t i = 0; i <= len && n < maxTokens; i++) {
+        // The last allowed token runs to the end of the line
+        bool last = n == maxTokens - 1;
+        if (i == len || (!last && line[i] == ':')) {
+            *tokens[n++] = {line + start, i - start};
+            start = i + 1;
+            if (last) {
+                break;
+            }
+        }
+    }
+    cmd.argc = n - 1;
+    return true;
+}
+
+
+CommandRing::CommandRing() : head(0), count(0), scanned(0), discarding(false) {}
+
+size_t CommandRing::push(const char* data, size_t len) {
+    size_t taken = 0;
+    while (taken < len) {
+        if (discarding) {
+            char c = data[taken++];
+            if (c == '\n' || c == '\r') {
+                discarding = false;
+            }
+            continue;
+        }
+        if (count == COMMAND_RING_SIZE) {
+            size_t at = scanned;
+            while (at < count && buffer[(head + at) % COMMAND_RING_SIZE] != '\n'
+                   && buffer[(head + at) % COMMAND_RING_SIZE] != '\r') {
+                at++;
+            }
+            if (at < count) {
+                break;  // complete lines are waiting, the caller has to next() them first
+            }
+            // One line fills the whole ring, it can never be parsed
+            head = 0;
+            count = 0;
+            scanned = 0;
+            discarding = true;
+            continue;
+        }
+        size_t tail = (head + count) % COMMAND_RING_SIZE;
+        size_t room = tail >= head ? COMMAND_RING_SIZE - tail : head - tail;
+        size_t n = len - taken < room ? len - taken : room;
+        memcpy(buffer + tail, data + taken, n);
+        count += n;
+        taken += n;
+    }
+    return taken;
+}
+
+bool CommandRing::take(size_t lineLen, size_t skip, Command& cmd, size_t maxTokens) {
+    const char* start = buffer + head;
+    if (head + lineLen > COMMAND_RING_SIZE) {
+        // Wrapped line: the only case that copies
+        size_t firstPart = COMMAND_RING_SIZE - head;
+        memcpy(line, buffer + head, firstPart);
+        memcpy(line + firstPart, buffer, lineLen - firstPart);
+        start = line;
+    }
+    head = (head + lineLen + skip) % COMMAND_RING_SIZE;
+    count -= lineLen + skip;
+    scanned = 0;
+    return parseCommand(start, lineLen, cmd, maxTokens);
+}
+
+bool CommandRing::next(Command& cmd, size_t maxTokens) {
+    while (scanned < count) {
+        char c = buffer[(head + scanned) % COMMAND_RING_SIZE];
+        if (c != '\n' && c != '\r') {
+            scanned++;
+            continue;
+        }
+        if (scanned == 0) {
+            // Empty line, e.g. the '\n' of "\r\n"
+            head = (head + 1) % COMMAND_RING_SIZE;
+            count--;
+            continue;
+        }
+        return take(scanned, 1, cmd, maxTokens);
+    }
+    return false;
+}
+
+bool CommandRing::flushPartial(Command& cmd, size_t maxTokens) {
+    if (next(cmd, maxTokens)) {
+        return true;
+    }
+    if (count == 0 || discarding) {
+        return false;
+    }
+    return take(count, 0, cmd, maxTokens);
+}
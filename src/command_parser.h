@@ -0,0 +1,58 @@
+#ifndef COMMAND_PARSER_H
+#define COMMAND_PARSER_H
+#include <stdint.h>
+#include <stddef.h>
+
+// Shared command parser for the serial menu, the BLE command characteristic
+// and HTTP query args. Commands are lines of the form VERB[:arg[:arg...]],
+// the last token takes the rest of the line so content may contain ':'.
+// Nothing here allocates: tokens are views into the caller's buffer or into
+// the ring below, valid until the buffer or ring is next modified.
+
+struct Token {
+    const char* ptr;
+    size_t len;
+
+    bool empty() const { return len == 0; }
+    char first() const { return len > 0 ? ptr[0] : '\0'; }
+    bool equals(const char* s) const;
+    bool toU32(uint32_t& out) const;             // decimal, false on junk or overflow
+    size_t copyTo(char* dst, size_t size) const;  // NUL terminated, truncates, returns length copied
+};
+
+const size_t MAX_COMMAND_TOKENS = 4;
+
+struct Command {
+    Token verb;
+    Token args[MAX_COMMAND_TOKENS - 1];
+    size_t argc;
+};
+
+// Splits one line (without its terminator) into at most maxTokens tokens
+bool parseCommand(const char* line, size_t len, Command& cmd, size_t maxTokens = MAX_COMMAND_TOKENS);
+
+const size_t COMMAND_RING_SIZE = 1024;
+
+// Fixed ring for byte streams that deliver commands in arbitrary chunks
+// (BLE writes, serial). Lines end in '\n' or '\r'; a line longer than the
+// ring is dropped whole.
+class CommandRing {
+public:
+    CommandRing();
+    size_t push(const char* data, size_t len);  // returns bytes taken, the rest did not fit
+    bool next(Command& cmd, size_t maxTokens = MAX_COMMAND_TOKENS);     // next complete line
+    bool flushPartial(Command& cmd, size_t maxTokens = MAX_COMMAND_TOKENS);  // take an unterminated line (input went idle)
+    size_t pending() const { return count; }
+
+private:
+    bool take(size_t lineLen, size_t skip, Command& cmd, size_t maxTokens);
+
+    char buffer[COMMAND_RING_SIZE];
+    char line[COMMAND_RING_SIZE];  // only used when a line wraps around the end of buffer
+    size_t head;                   // first unread byte
+    size_t count;                  // unread bytes
+    size_t scanned;                // unread bytes already known to hold no terminator
+    bool discarding;               // inside an over-long line, drop until its terminator
+};
+
+#endif // COMMAND_PARSER_H
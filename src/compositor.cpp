@@ -0,0 +1,101 @@
+#include <string.h>
+#include "compositor.h"
+
+const size_t MAX_LAYER_SPANS = 8;   // text lines sharing one column
+
+Compositor::Compositor() : layerCount(0) {
+    memset(layers, 0, sizeof(layers));
+}
+
+int Compositor::add(const Layer& layer) {
+    if (layerCount >= MAX_LAYERS) {
+        return -1;
+    }
+    layers[layerCount] = layer;
+    return layerCount++;
+}
+
+void Compositor::clear() {
+    layerCount = 0;
+}
+
+int Compositor::layerWidth(const Layer& layer) const {
+    return layer.source == LAYER_TEXT ? layer.text->width : WIDTH;
+}
+
+// The layer's own column under display column x, false if it is blank there
+bool Compositor::sourceColumn(const Layer& layer, int x, RGB* column) const {
+    int sx = scrollColumn(layer.scroll, layerWidth(layer), x);
+    if (layer.source == LAYER_FRAME) {
+        if (layer.frame == nullptr || sx >= WIDTH) {
+            return false;
+        }
+        memcpy(column, layer.frame + (size_t)sx * HEIGHT, HEIGHT * sizeof(RGB));
+        return true;
+    }
+
+    const LayoutSpan* spans[MAX_LAYER_SPANS];
+    size_t n = layer.text == nullptr ? 0 : layoutSpansAt(*layer.text, sx, spans, MAX_LAYER_SPANS);
+    if (n == 0) {
+        return false;
+    }
+    RGB spanColumn[HEIGHT];
+    memset(column, 0, HEIGHT * sizeof(RGB));
+    for (size_t i = 0; i < n; i++) {
+        renderStripColumn(spans[i]->strip, sx - spans[i]->x, spanColumn);
+        for (int y = 0; y < HEIGHT; y++) {
+            if (spanColumn[y].r | spanColumn[y].g | spanColumn[y].b) {
+                column[y] = spanColumn[y];
+            }
+        }
+    }
+    return true;
+}
+
+// a * alpha + b * (255 - alpha), divided by 255 and rounded
+static inline uint8_t blend(uint8_t a, uint8_t b, uint8_t alpha) {
+    uint32_t t = a * alpha + b * (255 - alpha) + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+void Compositor::renderColumn(int x, RGB* column) const {
+    // Nothing below an opaque, unkeyed frame can show, start there
+    size_t first = 0;
+    for (size_t i = layerCount; i-- > 0;) {
+        const Layer& l = layers[i];
+        if (l.source == LAYER_FRAME && l.frame != nullptr && l.alpha == 255 && !l.keyBlack) {
+            first = i;
+            break;
+        }
+    }
+
+    memset(column, 0, HEIGHT * sizeof(RGB));
+    RGB src[HEIGHT];
+    for (size_t i = first; i < layerCount; i++) {
+        const Layer& l = layers[i];
+        if (l.alpha == 0 || !sourceColumn(l, x, src)) {
+            continue;
+        }
+        for (int y = 0; y < HEIGHT; y++) {
+            const RGB& p = src[y];
+            if (l.keyBlack && (p.r | p.g | p.b) == 0) {
+                continue;
+            }
+            if (l.alpha == 255) {
+                column[y] = p;
+            } else {
+                column[y].r = blend(p.r, column[y].r, l.alpha);
+                column[y].g = blend(p.g, column[y].g, l.alpha);
+                column[y].b = blend(p.b, column[y].b, l.alpha);
+            }
+        }
+    }
+}
+
+void Compositor::advance() {
+    for (size_t i = 0; i < layerCount; i++) {
+        if (layers[i].scroll.speed != 0) {
+            advanceScroll(layers[i].scroll, layerWidth(layers[i]));
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+#include <stdint.h>
+#include <stddef.h>
+#include "display_types.h"
+#include "text_render.h"
+#include "text_layout.h"
+
+// Several sources shown at once, e.g. a video background, an image logo and
+// a text ticker. Layers only point at their sources (a frame, a text layout)
+// and are blended one column at a time as the revolution is scanned, so
+// there is never a composited frame in memory.
+//
+// Layers are drawn bottom to top in the order they were added. Each has its
+// own alpha and its own angular offset and rotation speed, kept like the
+// text scroll (text_render.h): column shown at display column 0, 16.16 fixed.
+
+enum LayerSource : uint8_t {
+    LAYER_FRAME,   // column-major WIDTH x HEIGHT frame: an image or the current video frame
+    LAYER_TEXT     // text layout, rendered from its glyph strips
+};
+
+struct Layer {
+    LayerSource source;
+    const RGB* frame;          // LAYER_FRAME
+    const TextLayout* text;    // LAYER_TEXT
+    uint8_t alpha;             // 255 = opaque
+    bool keyBlack;             // unlit pixels let the layers below show, for logos and text
+    TextScroll scroll;
+};
+
+const size_t MAX_LAYERS = 4;
+
+class Compositor {
+public:
+    Compositor();
+    // Index of the new layer, -1 when all are in use
+    int add(const Layer& layer);
+    void clear();
+    size_t count() const { return layerCount; }
+    Layer* layer(size_t i) { return i < layerCount ? &layers[i] : nullptr; }
+
+    // Display column x of the current revolution, blended from all layers
+    void renderColumn(int x, RGB* column) const;
+    // Moves every layer by its rotation speed, once per revolution
+    void advance();
+
+private:
+    int layerWidth(const Layer& layer) const;
+    bool sourceColumn(const Layer& layer, int x, RGB* column) const;
+
+    Layer layers[MAX_LAYERS];
+    size_t layerCount;
+};
+
+#endif // COMPOSITOR_H
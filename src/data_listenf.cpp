@@ -4,7 +4,17 @@
 #include <SPIFFS.h>
 #include <map>
 #include <mutex>
+#include <atomic>
 #include "data_listen.h"
+#include "frame_store.h"
+#include "command_parser.h"
+#include "display.h"
+#include "vector_scene.h"
+#include "image_codec.h"
+#include "column_stats.h"
+#include "trace.h"
+#include "deferred_log.h"
+#include "memory_stats.h"
 
 // WiFi credentials
 const char* ssid = "LingS";
@@ -17,7 +27,7 @@ WebServer server(80);
 const size_t maxPSRAMSlots = 30;
 const size_t maxSPIFFSSLots = 30;
 const size_t totalSlots = 60;
-const size_t fixedBlockSize = 314 * 168 * 3;
+const size_t fixedBlockSize = 314 * 186 * 3;   // one full frame, playVideo shows whole blocks
 size_t currentSlot = 0;
 
 // In-memory storage, psram
@@ -29,32 +39,37 @@ std::map<size_t, uint8_t*> inMemoryStorage;
 // Mutex for protecting shared resources
 std::mutex storageMutex;
 
-void eraseAllFilesInSPIFFS() {
-    File root = SPIFFS.open("/");
-    File file = root.openNextFile();
-    while (file) {
-        SPIFFS.remove(file.name());
-        file = root.openNextFile();
-    }
-    Serial.println("All files erased in SPIFFS.");
-}
+// Set by the WiFi event task, handled in loop() where the frame store is used
+std::atomic<bool> clientConnected(false);
+const size_t RECLAIM_ITEMS_PER_LOOP = 1;   // each removal is a few ms of flash work
 
 void WiFiEvent(WiFiEvent_t event) {
     switch (event) {
         case SYSTEM_EVENT_AP_STACONNECTED:
-            Serial.println("Client connected to WiFi. Erasing all files in SPIFFS.");
-            eraseAllFilesInSPIFFS();
+            clientConnected = true;
             break;
         default:
             break;
     }
 }
 
+// A client uploads into the staging generation while the current one keeps playing,
+// and shows it with POST /activate. Leaving, or dropping out halfway, publishes nothing;
+// a client that reconnects finds what it staged still there.
+void handleClientEvents() {
+    if (clientConnected.exchange(false)) {
+        beginGeneration();
+        Serial.printf("Client connected to WiFi. Uploads go to generation %u, %u items staged.\n",
+                      (unsigned)stagingGeneration(), (unsigned)stagedItems());
+    }
+}
+
 
 void createSubdirectories() {
     // Define the paths for the subdirectories
     const char* imageDir = "/img";
     const char* charDir = "/char";
+    const char* vectorDir = "/vec";
 
     // Create image subdirectory
     if (!SPIFFS.exists(imageDir)) {
@@ -77,11 +92,22 @@ void createSubdirectories() {
     } else {
         Serial.println("Character directory already exists.");
     }
+
+    // Create vector scene subdirectory
+    if (!SPIFFS.exists(vectorDir)) {
+        if (SPIFFS.mkdir(vectorDir)) {
+            Serial.println("Vector directory created successfully.");
+        } else {
+            Serial.println("Failed to create vector directory.");
+        }
+    } else {
+        Serial.println("Vector directory already exists.");
+    }
 }
 
 
 
-void handleWrite(const char* directory, const char* data) {//文字图片存储
+String nextItemPath(const char* directory) {
     // Determine the next file index
     int fileIndex = 1;
     File root = SPIFFS.open(directory);
@@ -89,10 +115,10 @@ void handleWrite(const char* directory, const char* data) {//文字图片存储
 
     while (file) {
         String fileName = String(file.name());
-        int lastSlash = fileName.lastIndexOf('/');
+        int lastSlash = fileName.lastIndexOf('/');  // -1 when name() is already the base name
         int lastDot = fileName.lastIndexOf('.');
         
-        if (lastSlash != -1 && lastDot != -1) {
+        if (lastDot != -1) {
             int currentIndex = fileName.substring(lastSlash + 1, lastDot).toInt();
             if (currentIndex >= fileIndex) {
                 fileIndex = currentIndex + 1;
@@ -103,39 +129,74 @@ void handleWrite(const char* directory, const char* data) {//文字图片存储
     }
 
     // Generate the new file name based on the index
-    String newFilePath = String(directory) + "/" + String(fileIndex) + ".txt";
+    return String(directory) + "/" + String(fileIndex) + ".txt";
+}
 
-    // Open new file for writing
-    file = SPIFFS.open(newFilePath.c_str(), FILE_WRITE);
-    if (!file) {
-        Serial.println("Failed to open file for writing");
-        return;
-    }
+void handleWrite(const char* directory, const char* data, size_t len) {//文字图片存储
+    beginGeneration();   // after an activation the next upload starts a new one
+    String newFilePath = nextItemPath(stagingPath(directory).c_str());
 
-    // Write data to the file
-    if (file.print(data)) {
+    // Identical content already on flash only costs a new item record.
+    // The CRC32 taken during the write is checked when the item is first loaded.
+    if (storeItem(newFilePath.c_str(), (const uint8_t*)data, len)) {
         Serial.println("File written successfully");
     } else {
         Serial.println("Write failed");
     }
+}
 
-    // Close the file
-    file.close();
+// Binary bodies are collected through the raw callback: server.arg("plain") ends at
+// the first NUL byte, and the PIMG and PVEC headers both have one at byte 5.
+struct RequestBody {
+    uint8_t* data;
+    size_t len;
+    bool tooLarge;
+    bool noMemory;
+};
+RequestBody requestBody = {nullptr, 0, false, false};
+
+void releaseRequestBody() {
+    free(requestBody.data);
+    requestBody = {nullptr, 0, false, false};
+}
 
-    // Optional: Open file for reading and print content
-    file = SPIFFS.open(newFilePath.c_str());
-    if (!file) {
-        Serial.println("Failed to open file for reading");
-        return;
+void collectRequestBody(size_t maxLen) {
+    HTTPRaw& raw = server.raw();
+    if (raw.status == RAW_START) {
+        releaseRequestBody();
+        requestBody.data = (uint8_t*)ps_malloc(maxLen);
+        if (requestBody.data == nullptr) {
+            logMemory("a request body", maxLen);
+            requestBody.noMemory = true;
+        }
+    } else if (raw.status == RAW_WRITE) {
+        if (requestBody.data == nullptr || requestBody.tooLarge) {
+            return;   // the rest of a refused body is read and dropped
+        }
+        if (requestBody.len + raw.currentSize > maxLen) {
+            requestBody.tooLarge = true;
+            return;
+        }
+        memcpy(requestBody.data + requestBody.len, raw.buf, raw.currentSize);
+        requestBody.len += raw.currentSize;
+    } else if (raw.status == RAW_ABORTED) {
+        releaseRequestBody();
     }
+}
 
-    Serial.println("File Content:");
-    while (file.available()) {
-        Serial.write(file.read());
+// True with the bytes in requestBody, otherwise the error is already sent and the body released
+bool requestBodyReady() {
+    if (requestBody.noMemory) {
+        server.send(500, "application/json", "{\"error\":\"Memory allocation failed\"}");
+    } else if (requestBody.tooLarge) {
+        server.send(413, "application/json", "{\"error\":\"Data too large\"}");
+    } else if (requestBody.len == 0) {
+        server.send(400, "application/json", "{\"error\":\"No data provided\"}");
+    } else {
+        return true;
     }
-
-    // Close the file
-    file.close();
+    releaseRequestBody();
+    return false;
 }
 
 
@@ -145,69 +206,74 @@ void handleUpload() {//视频的存储程序
     bool uploadSuccessful = false;
 
     if (upload.status == UPLOAD_FILE_START) {
-        Serial.printf("UploadStart: %s\n", upload.filename.c_str());
+        LOG(UPLOAD, LOG_INFO, "UploadStart: %s", upload.filename.c_str());
     } else if (upload.status == UPLOAD_FILE_WRITE) {
-        Serial.printf("UploadWrite: %s, %u bytes\n", upload.filename.c_str(), upload.currentSize);
+        TraceSpan span(TRACE_UPLOAD, upload.currentSize);
+        LOG(UPLOAD, LOG_DEBUG, "UploadWrite: %s, %u bytes", upload.filename.c_str(), upload.currentSize);
         if (upload.currentSize > fixedBlockSize) {
+            LOG(UPLOAD, LOG_WARN, "Chunk of %u bytes is larger than a frame", upload.currentSize);
             server.send(400, "application/json", "{\"error\":\"Data too large\"}");
             return;
         }
 
-        Serial.println("Got Over Data Too Large");
-        Serial.print("psramFound(): ");
-        Serial.println(psramFound());
-        Serial.print("maxPSRAMSlots: ");
-        Serial.println(maxPSRAMSlots);
-        Serial.print("totalSlots: ");
-        Serial.println(totalSlots);
+        LOG(UPLOAD, LOG_DEBUG, "psramFound() %u, slot %u of %u PSRAM slots, %u total", psramFound(), currentSlot,
+            maxPSRAMSlots, totalSlots);
 
         if (currentSlot < maxPSRAMSlots && psramFound()) {
-            Serial.println("Inside currentSlot < maxPSRAMSlots && psramFound()");
 
-            // Free existing memory block if any
+            // Drop this slot's reference to its old frame, if any
             if (inMemoryStorage.find(currentSlot) != inMemoryStorage.end()) {
-                free(inMemoryStorage[currentSlot]);
+                releaseFrame(inMemoryStorage[currentSlot]);
+                inMemoryStorage.erase(currentSlot);
+                memorySlotCleared(currentSlot);
             }
 
-            // Allocate memory and attempt re-allocation if it fails
-            uint8_t* newBlock = (uint8_t*)ps_malloc(fixedBlockSize); 
+            // Frames already held by another slot are shared instead of copied
+            uint8_t* newBlock = acquireFrame(upload.buf, upload.currentSize, fixedBlockSize);
             uint8_t counter = 0;
             size_t slotUsed = currentSlot;
 
+            if (newBlock == nullptr) {
+                logMemory("a frame", fixedBlockSize);
+            }
             while (counter < maxPSRAMSlots && newBlock == nullptr) {
-                Serial.println("Failed to allocate new memory block in PSRAM. Trying to allocate new space.");
+                LOG(UPLOAD, LOG_WARN, "No PSRAM for a frame, freeing slot %u", (slotUsed + 1) % maxPSRAMSlots);
                 slotUsed = (slotUsed + 1) % maxPSRAMSlots;
 
                 // Free memory in the next slot
                 if (inMemoryStorage.find(slotUsed) != inMemoryStorage.end()) {
-                    free(inMemoryStorage[slotUsed]);
+                    releaseFrame(inMemoryStorage[slotUsed]);
+                    inMemoryStorage.erase(slotUsed);
+                    memorySlotCleared(slotUsed);
                 }
 
                 // Attempt to allocate memory again in the freed slot
-                newBlock = (uint8_t*)ps_malloc(fixedBlockSize);
+                newBlock = acquireFrame(upload.buf, upload.currentSize, fixedBlockSize);
                 counter++;
             }
 
             if (newBlock == nullptr) {
-                Serial.println("Failed to allocate new memory block in PSRAM after trying all slots.");
+                LOG(UPLOAD, LOG_ERROR, "No PSRAM for a frame after freeing %u slots", maxPSRAMSlots);
+                logMemory("a frame", fixedBlockSize);
                 server.send(500, "application/json", "{\"error\":\"Memory allocation failed\"}");
                 return;
             }
 
-            // Store the data in the allocated memory block
+            // Store the (possibly shared) block in the slot
             inMemoryStorage[slotUsed] = newBlock;
-            memcpy(inMemoryStorage[slotUsed], upload.buf, upload.currentSize);
+            memorySlotStored(slotUsed, newBlock);
 
             // Update currentSlot to the next position
             currentSlot = (slotUsed + 1) % maxPSRAMSlots; // Wrap around and overwrite
 
             uploadSuccessful = true;  // Mark the upload as successful
         } else {
+            LOG(UPLOAD, LOG_ERROR, "No PSRAM slot available");
             server.send(500, "application/json", "{\"error\":\"No available PSRAM slots\"}");
             return;
         }
     } else if (upload.status == UPLOAD_FILE_END) {
-        Serial.printf("UploadEnd: %s (%u)\n", upload.filename.c_str(), upload.totalSize);
+        LOG(UPLOAD, LOG_INFO, "UploadEnd: %s (%u)", upload.filename.c_str(), upload.totalSize);
         if (uploadSuccessful) {
             char response[100];
             snprintf(response, sizeof(response), "{\"status\":\"success\", \"slot\":%zu}", currentSlot);
@@ -218,35 +284,204 @@ void handleUpload() {//视频的存储程序
     }
 }
 
-void handleNotFound() {
-    server.send(404, "application/json", "{\"error\":\"Not found\"}");
+// Resumable uploads: POST /upload?id=<id>&offset=<n> with the raw bytes as body.
+// The body is appended to flash chunk by chunk as it arrives through the raw
+// callback: server.arg("plain") would end at the first NUL byte and hold it all in RAM.
+// A wrong offset is answered with 409 and the committed length to resume from.
+enum RangeUploadResult {
+    RANGE_NO_DATA,
+    RANGE_BAD_ARGS,
+    RANGE_OFFSET_MISMATCH,
+    RANGE_WRITE_FAILED,
+    RANGE_OK
+};
+RangeUploadResult rangeResult = RANGE_NO_DATA;
+String rangeId;
+size_t rangeOffset = 0;    // where the next chunk goes
+
+void handleRangeUploadData() {
+    HTTPRaw& raw = server.raw();
+    if (raw.status == RAW_START) {
+        rangeId = server.arg("id");
+        String offsetArg = server.arg("offset");
+        uint32_t offset;
+        if (!server.hasArg("id") || !Token{offsetArg.c_str(), offsetArg.length()}.toU32(offset)) {
+            rangeResult = RANGE_BAD_ARGS;
+        } else if (offset != uploadCommittedLength(rangeId.c_str())) {
+            rangeResult = RANGE_OFFSET_MISMATCH;
+        } else {
+            rangeOffset = offset;
+            rangeResult = RANGE_NO_DATA;
+        }
+    } else if (raw.status == RAW_WRITE) {
+        if (rangeResult != RANGE_NO_DATA && rangeResult != RANGE_OK) {
+            return;   // the rest of a refused body is read and dropped
+        }
+        TraceSpan span(TRACE_UPLOAD, raw.currentSize);
+        if (!appendUpload(rangeId.c_str(), rangeOffset, raw.buf, raw.currentSize)) {
+            rangeResult = RANGE_WRITE_FAILED;
+            return;
+        }
+        rangeOffset += raw.currentSize;
+        rangeResult = RANGE_OK;
+    } else if (raw.status == RAW_ABORTED) {
+        rangeResult = RANGE_WRITE_FAILED;
+    }
 }
 
+void handleRangeUpload() {
+    RangeUploadResult result = rangeResult;
+    rangeResult = RANGE_NO_DATA;
+    if (result == RANGE_BAD_ARGS || result == RANGE_NO_DATA) {
+        server.send(400, "application/json", "{\"error\":\"id, offset and data required\"}");
+        return;
+    }
+    char response[100];
+    unsigned committed = (unsigned)uploadCommittedLength(server.arg("id").c_str());
+    if (result == RANGE_OFFSET_MISMATCH) {
+        snprintf(response, sizeof(response), "{\"error\":\"Offset mismatch\", \"committed\":%u}", committed);
+        server.send(409, "application/json", response);
+    } else if (result == RANGE_WRITE_FAILED) {
+        // Whatever reached flash counts, the client resumes from there
+        snprintf(response, sizeof(response), "{\"error\":\"Write failed\", \"committed\":%u}", committed);
+        server.send(500, "application/json", response);
+    } else {
+        snprintf(response, sizeof(response), "{\"status\":\"success\", \"committed\":%u}", committed);
+        server.send(200, "application/json", response);
+    }
+}
 
+void handleUploadStatus() {
+    if (!server.hasArg("id")) {
+        server.send(400, "application/json", "{\"error\":\"id required\"}");
+        return;
+    }
+    char response[100];
+    snprintf(response, sizeof(response), "{\"committed\":%u}",
+             (unsigned)uploadCommittedLength(server.arg("id").c_str()));
+    server.send(200, "application/json", response);
+}
 
+// POST /upload_commit?id=<id>&dir=img|char|vec makes a finished upload the next item of the staging generation
+void handleUploadCommit() {
+    if (!server.hasArg("id") || !server.hasArg("dir")) {
+        server.send(400, "application/json", "{\"error\":\"id and dir required\"}");
+        return;
+    }
+    String dir = server.arg("dir");
+    if (!dir.equals("img") && !dir.equals("char") && !dir.equals("vec")) {
+        server.send(400, "application/json", "{\"error\":\"Unknown dir\"}");
+        return;
+    }
+    // Scenes get the same check as on /write_vec; a short one may still be resumed
+    String id = server.arg("id");
+    if (dir.equals("vec")) {
+        size_t len = uploadCommittedLength(id.c_str());
+        if (len > MAX_VECTOR_SCENE_SIZE) {
+            server.send(400, "application/json", "{\"error\":\"Bad scene\"}");
+            return;
+        }
+        uint8_t* scene = (uint8_t*)ps_malloc(MAX_VECTOR_SCENE_SIZE);
+        if (scene == nullptr) {
+            logMemory("a vector scene", MAX_VECTOR_SCENE_SIZE);
+            server.send(500, "application/json", "{\"error\":\"Memory allocation failed\"}");
+            return;
+        }
+        bool valid = readUpload(id.c_str(), scene, MAX_VECTOR_SCENE_SIZE) == len && validVectorScene(scene, len);
+        free(scene);
+        if (!valid) {
+            server.send(400, "application/json", "{\"error\":\"Bad scene\"}");
+            return;
+        }
+    }
+    beginGeneration();
+    String itemPath = nextItemPath(stagingPath(("/" + dir).c_str()).c_str());
+    if (!commitUpload(id.c_str(), itemPath.c_str())) {
+        server.send(500, "application/json", "{\"error\":\"Commit failed\"}");
+        return;
+    }
+    String response = "{\"status\":\"success\", \"item\":\"" + itemPath + "\"}";
+    server.send(200, "application/json", response);
+}
 
-void setup() {
-    Serial.begin(115200);
-    WiFi.onEvent(WiFiEvent); // Register the WiFi event handler
-    WiFi.begin(ssid, password);
+// POST /activate shows the staging generation, everything uploaded into it since the last activation, in one step
+void handleActivate() {
+    if (!activateGeneration()) {
+        server.send(409, "application/json", "{\"error\":\"Nothing staged\"}");
+        return;
+    }
+    String response = "{\"status\":\"success\", \"generation\":" + String(activeGeneration()) + "}";
+    server.send(200, "application/json", response);
+}
 
-    if (!psramInit()) {
-        Serial.println("PSRAM initialization failed!");
-    } else {
-        Serial.println("PSRAM initialized.");
+// POST /discard drops the staging generation, the next upload starts an empty one
+void handleDiscard() {
+    discardGeneration();
+    server.send(200, "application/json", "{\"status\":\"success\"}");
+}
+
+// GET /cmd?c=<command> runs a menu command, e.g. c=p or c=n, through the same parser as the serial menu
+void handleCommand() {
+    String line = server.arg("c");
+    Command cmd;
+    if (!parseCommand(line.c_str(), line.length(), cmd)) {
+        server.send(400, "application/json", "{\"error\":\"No command\"}");
+        return;
+    }
+    if (!queueDisplayCommand(line.c_str(), line.length())) {
+        server.send(503, "application/json", "{\"error\":\"Command queue full\"}");
+        return;
     }
+    server.send(200, "application/json", "{\"status\":\"queued\"}");
+}
 
-    Serial.print("IP Address: ");
-    Serial.println(WiFi.softAPIP());
+// GET /stats: column path timing from every core as JSON, read without stopping the display
+void handleStats() {
+    static char json[4096];
+    formatStatsJson(json, sizeof(json));
+    server.send(200, "application/json", json);
+}
 
-    if (!SPIFFS.begin(true)) {
-        Serial.println("Critical error: SPIFFS failed to initialize!");
-        while (1); // Halt execution
+// GET /trace: the event trace as a binary TraceHeader and records, for tools/trace_convert.
+// Tracing pauses while the ring is sent.
+void handleTrace() {
+    TraceHeader header;
+    TraceDump dump = traceStop(header);
+    size_t count = dump.count;
+    server.setContentLength(sizeof(header) + count * sizeof(TraceRecord));
+    server.send(200, "application/octet-stream", "");
+    server.sendContent((const char*)&header, sizeof(header));
+    TraceRecord chunk[64];
+    for (size_t i = 0; i < count;) {
+        size_t n = 0;
+        while (n < 64 && i < count) {
+            chunk[n++] = traceRead(dump, i++);
+        }
+        server.sendContent((const char*)chunk, n * sizeof(TraceRecord));
     }
+    traceResume();
+}
 
-    createSubdirectories();
+// GET /memory: heap free space, largest blocks, low-water marks and PSRAM slot use as JSON
+void handleMemory() {
+    static char json[3072];
+    formatMemoryJson(json, sizeof(json));
+    server.send(200, "application/json", json);
+}
+
+void handleNotFound() {
+    server.send(404, "application/json", "{\"error\":\"Not found\"}");
+}
 
+
+
+
+// Set once storage, WiFi and the server are up; nothing is served before
+std::atomic<bool> storageReady(false);
+
+void registerRoutes() {
     // Ensure the /write endpoint handles POST requests
+    // Video frames go to the PSRAM slots only, they are not part of the staging generation
     server.on("/write", HTTP_POST, []() {
         // This lambda is just to acknowledge the POST request
         Serial.println("Received POST request to /write");
@@ -257,7 +492,7 @@ void setup() {
         Serial.println("Received POST request to /write_char");
         if (server.hasArg("plain")) {
             String data = server.arg("plain");
-            handleWrite("/char", data.c_str());
+            handleWrite("/char", data.c_str(), data.length());
             server.send(200, "application/json", "{\"status\":\"success\"}");
         } else {
             server.send(400, "application/json", "{\"error\":\"No data provided\"}");
@@ -266,23 +501,92 @@ void setup() {
 
     server.on("/write_img", HTTP_POST, []() {
         Serial.println("Received POST request to /write_img");
-        if (server.hasArg("plain")) {
-            String data = server.arg("plain");
-            handleWrite("/img", data.c_str());
+        if (requestBodyReady()) {
+            handleWrite("/img", (const char*)requestBody.data, requestBody.len);
+            releaseRequestBody();
             server.send(200, "application/json", "{\"status\":\"success\"}");
-        } else {
-            server.send(400, "application/json", "{\"error\":\"No data provided\"}");
         }
-    });
+    }, []() { collectRequestBody(MAX_ENCODED_IMAGE_SIZE); });
 
+    // Vector scenes are binary, see vector_scene.h; malformed ones are refused here, not at display time
+    server.on("/write_vec", HTTP_POST, []() {
+        Serial.println("Received POST request to /write_vec");
+        if (!requestBodyReady()) {
+            return;
+        }
+        if (!validVectorScene(requestBody.data, requestBody.len)) {
+            releaseRequestBody();
+            server.send(400, "application/json", "{\"error\":\"Bad scene\"}");
+            return;
+        }
+        handleWrite("/vec", (const char*)requestBody.data, requestBody.len);
+        releaseRequestBody();
+        server.send(200, "application/json", "{\"status\":\"success\"}");
+    }, []() { collectRequestBody(MAX_VECTOR_SCENE_SIZE); });
+
+
+    server.on("/upload", HTTP_POST, handleRangeUpload, handleRangeUploadData);
+    server.on("/upload_status", HTTP_GET, handleUploadStatus);
+    server.on("/upload_commit", HTTP_POST, handleUploadCommit);
+    server.on("/activate", HTTP_POST, handleActivate);
+    server.on("/discard", HTTP_POST, handleDiscard);
+    server.on("/cmd", HTTP_GET, handleCommand);
+    server.on("/stats", HTTP_GET, handleStats);
+    server.on("/trace", HTTP_GET, handleTrace);
+    server.on("/memory", HTTP_GET, handleMemory);
 
     server.onNotFound(handleNotFound);
+}
+
+// Joining WiFi takes seconds, so it runs in a task and setup() returns at once
+void initNetwork() {
+    WiFi.onEvent(WiFiEvent); // Register the WiFi event handler
+    WiFi.begin(ssid, password);
+    Serial.print("IP Address: ");
+    Serial.println(WiFi.softAPIP());
 
+    registerRoutes();
     server.begin();
-    Serial.println("HTTP server started");
+    storageReady = true;
+    Serial.printf("HTTP server started at %lu ms\n", millis());
+}
+
+void networkInitTask(void*) {
+    initNetwork();
+    vTaskDelete(nullptr);
+}
+
+void setup() {
+    Serial.begin(115200);
+    logBegin();
+
+    if (!psramInit()) {
+        Serial.println("PSRAM initialization failed!");
+    } else {
+        Serial.println("PSRAM initialized.");
+    }
+
+    // Mounted here, before anything else runs on this core; the display's storageBegin() waits for it
+    if (!storageBegin()) {
+        Serial.println("Critical error: SPIFFS failed to initialize!");
+        return;   // Nothing is served
+    }
+    createSubdirectories();
+
+    // On the core the display loop does not use
+    if (xTaskCreatePinnedToCore(networkInitTask, "init", 8192, nullptr, 1, nullptr, 0) != pdPASS) {
+        initNetwork();
+    }
 }
 
 void loop() {
+    if (!storageReady) {
+        delay(10);
+        return;
+    }
     //Defined by arduino core which constantly polls for request and send them to destination with predefined routes like /write
     server.handleClient();
+    handleClientEvents();
+    // Items of replaced generations go a few at a time, between requests
+    reclaimGenerations(RECLAIM_ITEMS_PER_LOOP);
 }
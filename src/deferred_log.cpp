@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include "deferred_log.h"
+
+#ifdef ESP_PLATFORM
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <chrono>
+#endif
+
+static LogRecord ring[LOG_RING_RECORDS];
+static std::atomic<uint32_t> head(0);   // records ever claimed
+static uint32_t tail = 0;               // next record to format, only the drain moves it
+
+static const char* const MODULE_NAMES[LOG_MODULE_COUNT] = {"upload", "storage", "display", "memory"};
+static const char LEVEL_LETTERS[] = "-EWID";
+
+uint32_t logNow() {
+#ifdef ESP_PLATFORM
+    return millis();
+#else
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+LogRecord& logClaim(uint32_t& claim) {
+    claim = head.fetch_add(1, std::memory_order_relaxed);
+    LogRecord& r = ring[claim % LOG_RING_RECORDS];
+    // 0 marks the slot as being written, the drain leaves it until it is published
+    r.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return r;
+}
+
+void logPublish(LogRecord& record, uint32_t claim) {
+    record.seq.store(claim + 1, std::memory_order_release);
+}
+
+size_t logFormat(const LogRecord& r, char* out, size_t size) {
+    size_t at = 0;
+    auto put = [&](int n) { at += n > 0 ? n : 0; };
+    auto room = [&]() { return at < size ? size - at : 0; };
+    auto dst = [&]() { return at < size ? out + at : nullptr; };
+    put(snprintf(dst(), room(), "[%u %s %c] ", (unsigned)r.ms,
+                 r.module < LOG_MODULE_COUNT ? MODULE_NAMES[r.module] : "?", LEVEL_LETTERS[r.level < 5 ? r.level : 0]));
+
+    size_t arg = 0;
+    for (const char* f = r.format; *f != '\0'; f++) {
+        if (*f != '%') {
+            if (at + 1 < size) {
+                out[at] = *f;
+            }
+            at++;
+            continue;
+        }
+        // One conversion: flags, width, length modifiers (ignored, arguments are 32 bit), type
+        char spec[16] = "%";
+        size_t n = 1;
+        f++;
+        while (*f != '\0' && strchr("-+ #0123456789", *f) != nullptr && n < sizeof(spec) - 2) {
+            spec[n++] = *f++;
+        }
+        while (*f == 'l' || *f == 'h' || *f == 'z') {
+            f++;
+        }
+        if (*f == '\0') {
+            break;
+        }
+        spec[n++] = *f;
+        spec[n] = '\0';
+        uint32_t value = arg < r.argc ? r.args[arg] : 0;
+        switch (*f) {
+            case 'd':
+            case 'i':
+            case 'c':
+                put(snprintf(dst(), room(), spec, (int)value));
+                arg++;
+                break;
+            case 'u':
+            case 'x':
+            case 'X':
+                put(snprintf(dst(), room(), spec, (unsigned)value));
+                arg++;
+                break;
+            case 's':
+                put(snprintf(dst(), room(), spec, r.text));
+                break;
+            default:
+                put(snprintf(dst(), room(), "%c", *f));
+                break;
+        }
+    }
+    if (size > 0) {
+        out[at < size ? at : size - 1] = '\0';
+    }
+    return at < size ? at : size - 1;
+}
+
+size_t logDrain(char* out, size_t size) {
+    size_t at = 0;
+    char line[160];
+    while (true) {
+        uint32_t claimed = head.load(std::memory_order_acquire);
+        if (claimed - tail > LOG_RING_RECORDS) {
+            // Writers went round the ring, everything before the last lap is gone
+            int n = snprintf(line, sizeof(line), "[log] %u records dropped\n",
+                             (unsigned)(claimed - LOG_RING_RECORDS - tail));
+            if (at + n >= size) {
+                break;
+            }
+            memcpy(out + at, line, n);
+            at += n;
+            tail = claimed - LOG_RING_RECORDS;
+        }
+        if (tail == claimed) {
+            break;
+        }
+        const LogRecord& r = ring[tail % LOG_RING_RECORDS];
+        uint32_t seq = r.seq.load(std::memory_order_acquire);
+        if (seq != tail + 1) {
+            if (seq == 0 || seq < tail + 1) {
+                break;   // claimed but not published yet
+            }
+            tail++;      // already overwritten by a later lap, the next pass counts it
+            continue;
+        }
+        size_t n = logFormat(r, line, sizeof(line) - 1);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (r.seq.load(std::memory_order_relaxed) != seq) {
+            continue;    // overwritten while formatting, the lap check above catches up
+        }
+        if (at + n + 1 >= size) {
+            break;
+        }
+        memcpy(out + at, line, n);
+        out[at + n] = '\n';
+        at += n + 1;
+        tail++;
+    }
+    if (size > 0) {
+        out[at < size ? at : size - 1] = '\0';
+    }
+    return at;
+}
+
+#ifdef ESP_PLATFORM
+static void logTask(void*) {
+    static char text[1024];
+    while (true) {
+        size_t n = logDrain(text, sizeof(text));
+        if (n > 0) {
+            Serial.write((const uint8_t*)text, n);
+        } else {
+            vTaskDelay(pdMS_TO_TICKS(20));
+        }
+    }
+}
+
+void logBegin() {
+    static bool started = false;
+    if (!started) {
+        // Lowest priority above idle, on the core the display loop does not use
+        started = xTaskCreatePinnedToCore(logTask, "log", 3072, nullptr, tskIDLE_PRIORITY + 1, nullptr, 0) == pdPASS;
+    }
+}
+#else
+void logBegin() {}
+#endif
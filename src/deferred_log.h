@@ -0,0 +1,131 @@
+#ifndef DEFERRED_LOG_H
+#define DEFERRED_LOG_H
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+
+// Logging that costs the caller a ring slot instead of a blocking
+// Serial.println at 115200 baud. The caller stores the format string's
+// address (its ID), the raw arguments and the time; a low-priority task on
+// the other core formats the records and writes them to Serial later.
+//
+//   LOG(UPLOAD, LOG_INFO, "UploadWrite: %s, %u bytes", name, size);
+//
+// Formats take %d %u %x %X %c and one %s, with flags and widths, and at
+// most LOG_MAX_ARGS arguments. The %s string is copied into the record
+// (LOG_STRING_LEN bytes), so it may be a temporary. The format itself must
+// be a literal.
+//
+// Every module has a level, LOG_LEVEL_<module>, settable with -D. Messages
+// above it are compiled out. Release builds default to warnings. When the
+// ring is full the oldest records are lost, and a "dropped" line says how many.
+
+enum LogLevel : uint8_t {
+    LOG_OFF,
+    LOG_ERROR,
+    LOG_WARN,
+    LOG_INFO,
+    LOG_DEBUG
+};
+
+enum LogModule : uint8_t {
+    LOG_MODULE_UPLOAD,     // HTTP uploads into PSRAM and SPIFFS, data_listenf.cpp
+    LOG_MODULE_STORAGE,    // SPIFFS listings and items
+    LOG_MODULE_DISPLAY,    // the renderer, display.cpp
+    LOG_MODULE_MEMORY,     // heap and slot telemetry
+    LOG_MODULE_COUNT
+};
+
+#ifndef LOG_DEFAULT_LEVEL
+#ifdef POV_RELEASE
+#define LOG_DEFAULT_LEVEL LOG_WARN
+#else
+#define LOG_DEFAULT_LEVEL LOG_INFO
+#endif
+#endif
+#ifndef LOG_LEVEL_UPLOAD
+#define LOG_LEVEL_UPLOAD LOG_DEFAULT_LEVEL
+#endif
+#ifndef LOG_LEVEL_STORAGE
+#define LOG_LEVEL_STORAGE LOG_DEFAULT_LEVEL
+#endif
+#ifndef LOG_LEVEL_DISPLAY
+#define LOG_LEVEL_DISPLAY LOG_DEFAULT_LEVEL
+#endif
+#ifndef LOG_LEVEL_MEMORY
+#define LOG_LEVEL_MEMORY LOG_DEFAULT_LEVEL
+#endif
+
+#define LOG(module, level, ...)                                       \
+    do {                                                              \
+        if ((level) <= LOG_LEVEL_##module) {                          \
+            logWrite(LOG_MODULE_##module, (level), __VA_ARGS__);      \
+        }                                                             \
+    } while (0)
+
+const size_t LOG_MAX_ARGS = 4;
+const size_t LOG_STRING_LEN = 24;
+const size_t LOG_RING_RECORDS = 128;   // a power of two
+
+struct LogRecord {
+    std::atomic<uint32_t> seq;     // claim number + 1 once the record is complete
+    uint32_t ms;
+    const char* format;
+    uint8_t module;
+    uint8_t level;
+    uint8_t argc;
+    uint32_t args[LOG_MAX_ARGS];
+    char text[LOG_STRING_LEN];     // the %s argument
+};
+
+// Claims the next slot, the caller fills it and publishes it with logPublish
+LogRecord& logClaim(uint32_t& claim);
+void logPublish(LogRecord& record, uint32_t claim);
+uint32_t logNow();
+
+// Integers and enums are stored as 32 bits, a string is copied into text
+template <typename T>
+inline void logArg(LogRecord& r, T value) {
+    static_assert(std::is_integral<T>::value || std::is_enum<T>::value, "log arguments are integers or strings");
+    if (r.argc < LOG_MAX_ARGS) {
+        r.args[r.argc++] = (uint32_t)value;
+    }
+}
+inline void logArg(LogRecord& r, const char* s) {
+    size_t n = 0;
+    while (s != nullptr && n + 1 < LOG_STRING_LEN && s[n] != '\0') {
+        r.text[n] = s[n];
+        n++;
+    }
+    r.text[n] = '\0';
+}
+inline void logArg(LogRecord& r, char* s) {
+    logArg(r, (const char*)s);
+}
+
+template <typename... Args>
+void logWrite(LogModule module, LogLevel level, const char* format, Args... args) {
+    uint32_t claim;
+    LogRecord& r = logClaim(claim);
+    r.ms = logNow();
+    r.format = format;
+    r.module = module;
+    r.level = level;
+    r.argc = 0;
+    r.text[0] = '\0';
+    int expand[] = {0, (logArg(r, args), 0)...};
+    (void)expand;
+    logPublish(r, claim);
+}
+
+// Starts the task that writes the records to Serial
+void logBegin();
+// Formats every published record into out as lines, returns the bytes written.
+// The task calls this; host tools and tests can call it directly.
+size_t logDrain(char* out, size_t size);
+// One record as text without the newline, e.g. "[1234 upload I] UploadEnd: a.bin (5)"
+size_t logFormat(const LogRecord& record, char* out, size_t size);
+
+#endif // DEFERRED_LOG_H
@@ -1,13 +1,29 @@
 #include <HardwareSerial.h>
 #include <SPIFFS.h>
 #include <vector>
+#include <algorithm>
 #include <string>
 #include <SPI.h>
 #include <unistd.h>
 #include "data_listen.h"
+#include "frame_store.h"
+#include "command_parser.h"
+#include "display.h"
+#include "display_types.h"
+#include "text_render.h"
+#include "column_pack.h"
+#include "glyph_atlas.h"
+#include "text_layout.h"
+#include "image_codec.h"
+#include "compositor.h"
+#include "effects.h"
+#include "vector_scene.h"
+#include "column_stats.h"
+#include "trace.h"
+#include "deferred_log.h"
+#include "memory_stats.h"
+#include "boot_state.h"
 
-#define WIDTH 314
-#define HEIGHT 186
 #define ROWINTERVAL 8.84194 
 //314 pixels for about 10 cm diameter cylinder with 10pixels per centimerter, at a speed of 7200/minutes. 
 //      [(7200/60) (Rotation per second) * (10cm*pi) (diameter)] / [(0.1 cm) (width of one pixel)] = 37699.1118431 (At such speed, in every one second, 37699.118431 number of pixel is passed through)
@@ -18,13 +34,19 @@
 #define LE2_PIN 11   // Latch Enable 2 (LE2)
 #define PWCK_PIN 12  // Pulse Width Clock (PWCK), optional based on your usage
 
+// Time per display column actually used, ROWINTERVAL unless calibrated with interval:<ns> for the motor's real speed
+float columnInterval = ROWINTERVAL;
 
-//Mode initialization
+
+//Mode initialization, the values are saved in the nvs partition (boot_state.h)
 enum Mode {
     MENU,
     CHARACTERS,
     PICTURES,
-    VIDEOS
+    VIDEOS,
+    LAYERS,
+    EFFECTS,
+    VECTORS
 };
 enum SubMode {
     NONE,
@@ -42,27 +64,60 @@ bool videoPlaying = false;
 // File and index structure
 std::vector<std::string> fileList;
 int currentIndex = -1;
+uint32_t listedGeneration = 0;   // content generation fileList was read from
 
 
-// RGB structure and arrays/columns of RGB representing a picture
-typedef struct {
-    uint8_t r;
-    uint8_t g;
-    uint8_t b;
-} RGB;
-RGB def[HEIGHT][WIDTH] = {0};       //Default to be displayed, no led light at all.
-RGB current[HEIGHT][WIDTH];
+// Arrays/columns of RGB representing a picture, column-major: one array row per display column
+RGB def[WIDTH][HEIGHT] = {0};       //Default to be displayed, no led light at all.
+RGB current[WIDTH][HEIGHT];
 RGB* currentImage=NULL;
+bool pictureShown = false;   // current holds the selected picture, redrawn every revolution
+
+
+// Text for CHARACTERS mode, rasterized on the device from the stored string
+LayoutCache layoutCache;
+const TextLayout* currentLayout = nullptr;   // owned by layoutCache
+TextScroll textScroll = {0, 0, 0};
+RGB textColor = {255, 255, 255};
+const size_t MAX_TEXT_LEN = 256;
+
+
+//Packed text columns, expanded once per distinct glyph column
+GlyphAtlas textAtlas;
+
+//CJK and other large fonts, read glyph by glyph from the "glyphs" flash partition
+PartitionGlyphSource glyphPartition;
+GlyphStore glyphStore;
+
 
+//LAYERS mode: video, images and text blended per column. Images shown as
+//layers are decoded into PSRAM, one frame each; text layers hold a copy of
+//their layout, since the layout cache evicts entries; video layers point at
+//the frame store.
+Compositor compositor;
+RGB* layerImages[MAX_LAYERS] = {nullptr};
+TextLayout layerTexts[MAX_LAYERS] = {};
+int videoLayer = -1;
+size_t layerFrame = 0;
 
-//Controller representation used for uploading ddata in
-typedef struct {
-    uint16_t pinData[16]; // Array to hold the concatenated data for the 16 pins
-} LEDController;
-LEDController set1[12];
-LEDController set2[11];
-LEDController set3[11];
-LEDController set4;
+
+//EFFECTS mode: columns computed on the fly, nothing stored
+size_t currentEffect = 0;
+uint32_t effectStartMs = 0;
+uint32_t effectRevolution = 0;
+int32_t clockOffsetMs = 0;   // wall clock minus millis(), set with time:HH:MM:SS
+const uint32_t DAY_MS = 24UL * 3600 * 1000;
+
+
+//VECTORS mode: scenes from /vec, rasterized column by column from their edge table
+VectorScene vectorScene;
+
+
+//Command input, serial bytes and commands queued over HTTP
+CommandRing serialCommands;
+CommandRing remoteCommands;
+unsigned long lastSerialByte = 0;
+const unsigned long SERIAL_IDLE_MS = 70;   // same as Serial.setTimeout, an unterminated key counts as a command after this
 
 
 //video playing mode constants
@@ -75,94 +130,6 @@ bool play=false;
 
 
 
-// Function to initialize an LEDController
-//index here represent which one out of the 12 controller are we initializing
-//reverse orientation, 15 represent the top, 0 represent the bottom led.
-//There are intotal 11 set of controller with full 16 led, and one set with 10 led
-//The top eight bit of pindata is set to the actual color, the lower 8 bit is just zeros to fit
-void initializeController1(RGB ledColumn[186]) {
-    for (int i = 0; i < 12; i++) {
-        set1[i].pinData[0]  = (ledColumn[1  + 16 * i - 1].g << 8);
-        set1[i].pinData[1]  = (ledColumn[1  + 16 * i - 1].r << 8);
-        set1[i].pinData[2]  = (ledColumn[2  + 16 * i - 1].r << 8);
-        set1[i].pinData[3]  = (ledColumn[2  + 16 * i - 1].g << 8);
-        set1[i].pinData[4]  = (ledColumn[1  + 16 * i - 1].b << 8);
-        set1[i].pinData[5]  = (ledColumn[2  + 16 * i - 1].b << 8);
-        set1[i].pinData[6]  = (ledColumn[3  + 16 * i - 1].g << 8);
-        set1[i].pinData[7]  = (ledColumn[3  + 16 * i - 1].b << 8);
-        set1[i].pinData[8]  = (ledColumn[4  + 16 * i - 1].b << 8);
-        set1[i].pinData[9]  = (ledColumn[5  + 16 * i - 1].b << 8);
-        set1[i].pinData[10] = (ledColumn[5 + 16 * i - 1].r << 8);
-        set1[i].pinData[11] = (ledColumn[6 + 16 * i - 1].g << 8);
-        set1[i].pinData[12] = (ledColumn[5 + 16 * i - 1].g << 8);
-        set1[i].pinData[13] = (ledColumn[4 + 16 * i - 1].r << 8);
-        set1[i].pinData[14] = (ledColumn[4 + 16 * i - 1].g << 8);
-        set1[i].pinData[15] = (ledColumn[3  + 16 * i - 1].r << 8);
-    }
-}
-
-void initializeController2(RGB ledColumn[186]) {
-    for (int i = 0; i < 11; i++) {
-        set2[i].pinData[0]  = (ledColumn[8  + 16 * i - 1].r << 8);
-        set2[i].pinData[1]  = (ledColumn[8  + 16 * i - 1].g << 8);
-        set2[i].pinData[2]  = (ledColumn[7  + 16 * i - 1].g << 8);
-        set2[i].pinData[3]  = (ledColumn[6  + 16 * i - 1].r << 8);
-        set2[i].pinData[4]  = (ledColumn[6  + 16 * i - 1].b << 8);
-        set2[i].pinData[5]  = (ledColumn[7  + 16 * i - 1].b << 8);
-        set2[i].pinData[6]  = (ledColumn[7  + 16 * i - 1].r << 8);
-        set2[i].pinData[7]  = (ledColumn[8  + 16 * i - 1].b << 8);
-        set2[i].pinData[8]  = (ledColumn[9  + 16 * i - 1].b << 8);
-        set2[i].pinData[9]  = (ledColumn[10  + 16 * i - 1].b << 8);
-        set2[i].pinData[10] = (ledColumn[11 + 16 * i - 1].b << 8);
-        set2[i].pinData[11] = (ledColumn[10 + 16 * i - 1].r << 8);
-        set2[i].pinData[12] = (ledColumn[11 + 16 * i - 1].g << 8);
-        set2[i].pinData[13] = (ledColumn[10 + 16 * i - 1].g << 8);
-        set2[i].pinData[14] = (ledColumn[9 + 16 * i - 1].r << 8);
-        set2[i].pinData[15] = (ledColumn[9  + 16 * i - 1].g << 8);
-    }
-}
-
-void initializeController3(RGB ledColumn[186]) {
-    for (int i = 0; i < 11; i++) {
-        set3[i].pinData[0]  = (ledColumn[11  + 16 * i - 1].r << 8);
-        set3[i].pinData[1]  = (ledColumn[13  + 16 * i - 1].r << 8);
-        set3[i].pinData[2]  = (ledColumn[13  + 16 * i - 1].g << 8);
-        set3[i].pinData[3]  = (ledColumn[12  + 16 * i - 1].g << 8);
-        set3[i].pinData[4]  = (ledColumn[12  + 16 * i - 1].b << 8);
-        set3[i].pinData[5]  = (ledColumn[12  + 16 * i - 1].r << 8);
-        set3[i].pinData[6]  = (ledColumn[13  + 16 * i - 1].b << 8);
-        set3[i].pinData[7]  = (ledColumn[14  + 16 * i - 1].b << 8);
-        set3[i].pinData[8]  = (ledColumn[14  + 16 * i - 1].r << 8);
-        set3[i].pinData[9]  = (ledColumn[15  + 16 * i - 1].b << 8);
-        set3[i].pinData[10] = (ledColumn[16 + 16 * i - 1].b << 8);
-        set3[i].pinData[11] = (ledColumn[15 + 16 * i - 1].r << 8);
-        set3[i].pinData[12] = (ledColumn[16 + 16 * i - 1].g << 8);
-        set3[i].pinData[13] = (ledColumn[16 + 16 * i - 1].r << 8);
-        set3[i].pinData[14] = (ledColumn[15 + 16 * i - 1].g << 8);
-        set3[i].pinData[15] = (ledColumn[14  + 16 * i - 1].g << 8);
-    }
-}
-
-void initializeController4(RGB ledColumn[186]) {
-    set4.pinData[0]  = (ledColumn[176 + 9  - 1].g << 8);
-    set4.pinData[1]  = (ledColumn[176 + 11 - 1].r << 8);
-    set4.pinData[2]  = (ledColumn[176 + 10 - 1].g << 8);
-    set4.pinData[3]  = (ledColumn[176 + 10 - 1].r << 8);
-    set4.pinData[4]  = (ledColumn[176 + 11 - 1].b << 8);
-    set4.pinData[5]  = (ledColumn[176 + 10 - 1].b << 8);
-    set4.pinData[6]  = (ledColumn[176 + 9  - 1].b << 8);
-    set4.pinData[7]  = (ledColumn[176 + 8  - 1].b << 8);
-    set4.pinData[8]  = (ledColumn[176 + 8  - 1].r << 8);
-    set4.pinData[9]  = (ledColumn[176 + 7  - 1].b << 8);
-    set4.pinData[10] = (ledColumn[176 + 6  - 1].b << 8);
-    set4.pinData[11] = (ledColumn[176 + 7  - 1].r << 8);
-    set4.pinData[12] = (ledColumn[176 + 7  - 1].g << 8);
-    set4.pinData[13] = (ledColumn[176 + 8  - 1].g << 8);
-    set4.pinData[14] = (ledColumn[176 + 9  - 1].r << 8);
-    set4.pinData[15] = (ledColumn[176 + 6  - 1].g << 8);
-}
-
-
 void traverseSPIFFSAndAddFiles(const std::string &directoryPath) {
     // Clear the existing file list
     fileList.clear();
@@ -170,13 +137,13 @@ void traverseSPIFFSAndAddFiles(const std::string &directoryPath) {
     // Open the root directory
     File cd = SPIFFS.open(directoryPath.c_str());
     if (!cd) {
-        Serial.println("Failed to open root directory");
+        LOG(STORAGE, LOG_WARN, "Failed to open %s", directoryPath.c_str());
         return;
     }
 
     // Check if it's a directory
     if (!cd.isDirectory()) {
-        Serial.println("Not a directory");
+        LOG(STORAGE, LOG_WARN, "%s is not a directory", directoryPath.c_str());
         return;
     }
 
@@ -185,7 +152,7 @@ void traverseSPIFFSAndAddFiles(const std::string &directoryPath) {
     while (file) {
         // Add the file name to the fileList vector
         fileList.push_back(file.name());
-        Serial.println(file.name());  // Print the file name for debugging
+        LOG(STORAGE, LOG_DEBUG, "%s", file.name());
 
         // Move to the next file
         file = cd.openNextFile();
@@ -199,42 +166,36 @@ void traverseSPIFFSAndAddFiles(const std::string &directoryPath) {
 void loadFilesFromDirectory(const std::string &directoryPath) {
     traverseSPIFFSAndAddFiles(directoryPath);
 
-    // Set the initial index to 0 if there are files, otherwise -1
+    // Keep the index the menu moved to, start at 0 otherwise, -1 if there are no files
     if (!fileList.empty()) {
-        currentIndex = 0;
+        if (currentIndex < 0 || currentIndex >= (int)fileList.size()) {
+            currentIndex = 0;
+        }
     } else {
         currentIndex = -1;
     }
 }
 
-void displayColumn(RGB ledcolumn[186], int le){     //le here represent which column of the two to latch, for now we are only latching the first one
-    //Setup the controller 
-    initializeController1(ledcolumn);   //准备好数据
-    initializeController2(ledcolumn);
-    initializeController3(ledcolumn);
-    initializeController4(ledcolumn);
+// Directory of the active generation, remembered as the one listed so an activation is noticed
+String listedPath(const char* directory) {
+    listedGeneration = activeGeneration();
+    return generationPath(listedGeneration, directory);
+}
+
+// Cycles spent packing the column sendWireColumn is about to send, 0 for prepacked text columns
+uint32_t packCycles = 0;
 
+// Shifts out one column already in wire order (see column_pack.h) and latches it
+void sendWireColumn(const uint16_t* wire, int le){     //le here represent which column of the two to latch, for now we are only latching the first one
+    uint32_t spiStart = statsCycles();
     digitalWrite(LE1_PIN, LOW);  // Ensure LE is low before starting data transfer 把上一个列的颜色熄灭
     digitalWrite(LE2_PIN, LOW); 
     SPI.beginTransaction(SPISettings(1000000, MSBFIRST, SPI_MODE0));  // 1 MHz, MSB first, SPI mode 0   传输数据
-    for (int i = 0; i < 11; i++) {
-        for (int j=0; j<16; j++){
-            SPI.transfer16(set1[i].pinData[j]);  // Send 16-bit brightness data for each channel
-        }
-        for (int j=0; j<16; j++){
-            SPI.transfer16(set2[i].pinData[j]);  // Send 16-bit brightness data for each channel
-        }
-        for (int j=0; j<16; j++){
-            SPI.transfer16(set3[i].pinData[j]);  // Send 16-bit brightness data for each channel
-        }
-    }
-    for (int j=0; j<16; j++){
-        SPI.transfer16(set1[11].pinData[j]);  // Send 16-bit brightness data for each channel
-    }
-    for (int j=0; j<10; j++){
-        SPI.transfer16(set4.pinData[j]);  // Send 16-bit brightness data for each channel
+    for (size_t i = 0; i < WIRE_WORDS; i++) {
+        SPI.transfer16(wire[i]);  // Send 16-bit brightness data for each channel
     }
     
+    uint32_t latchStart = statsCycles();
     if (le==1){
         digitalWrite(LE1_PIN, HIGH);  // Set LE high
         digitalWrite(LE1_PIN, LOW); 
@@ -242,48 +203,185 @@ void displayColumn(RGB ledcolumn[186], int le){     //le here represent which co
         digitalWrite(LE2_PIN, HIGH);  // Set LE high
         digitalWrite(LE2_PIN, LOW); 
     }
+    uint32_t end = statsCycles();
+    statsRecord(STAGE_SPI, latchStart - spiStart);
+    statsRecord(STAGE_LATCH, end - latchStart);
+    statsColumn(packCycles + (end - spiStart), millis());
+    packCycles = 0;
+}
+
+void displayColumn(RGB ledcolumn[186], int le){
+    static uint16_t wire[WIRE_WORDS];
+    uint32_t start = statsCycles();
+    packColumn(ledcolumn, wire);   //准备好数据
+    packCycles = statsCycles() - start;
+    statsRecord(STAGE_PACK, packCycles);
+    sendWireColumn(wire, le);
 }
 
 void displayCurrentFile(RGB* file) {
     if (currentIndex >= 0 && currentIndex < fileList.size()) {
-        Serial.print("Displaying file: ");
-        Serial.println(fileList[currentIndex].c_str());
+        LOG(DISPLAY, LOG_DEBUG, "Displaying file: %s", fileList[currentIndex].c_str());
     } else {
-        Serial.println("No file to display.");
+        LOG(DISPLAY, LOG_WARN, "No file to display.");
         return;
     }
+    TraceSpan span(TRACE_RENDER, currentMode);
 
     for (int i=0; i<WIDTH; i++){
-        displayColumn(current[i], 1);  
-        delayMicroseconds(ROWINTERVAL);        // Small delay in between every column   根据实际情况可以微调
+        displayColumn(file + i * HEIGHT, 1);  
+        delayMicroseconds(columnInterval);        // Small delay in between every column   根据实际情况可以微调
     }
 }
 
 
-int loadRGBFile(const char* directory, const char* filename){
-    int size=sizeof(directory)+sizeof(filename);
-    char wd[size];
-    strcpy(wd, directory); // Copy directory to wd
-    strcat(wd, filename);  // Concatenate filename to wd
+int loadRGBFile(const char* directory, const char* filename, RGB* frame = current[0]){
+    String wd = String(directory) + "/" + filename;
 
-    FILE *file = fopen(wd, "rb");
-    if (file == NULL) {
+    // Item files only reference their (possibly shared) content, frame_store resolves it
+    ItemRecord record;
+    if (!readRecord(wd.c_str(), record) || record.size > MAX_ENCODED_IMAGE_SIZE) {
         perror("Failed to open file");
         return 1;
     }
-    size_t bytesRead = fread(current, sizeof(char), sizeof(current) - 1, file);
-    fclose(file); // Close the file when done
+    if (record.size == RAW_IMAGE_SIZE) {
+        // Plain raw dump, straight into the frame
+        if (loadItem(wd.c_str(), (uint8_t*)frame, RAW_IMAGE_SIZE) != RAW_IMAGE_SIZE) {
+            perror("Failed to open file");
+            return 1;
+        }
+        return 0;
+    }
+
+    // Palette/RLE images from tools/asset_convert are decoded from a PSRAM copy
+    uint8_t* encoded = (uint8_t*)ps_malloc(record.size);
+    if (encoded == nullptr) {
+        Serial.println("No memory to decode image");
+        return 1;
+    }
+    size_t bytesRead = loadItem(wd.c_str(), encoded, record.size);
+    bool ok = bytesRead == record.size && decodeImage(encoded, bytesRead, frame);
+    free(encoded);
+    if (!ok) {
+        Serial.printf("Corrupt image %s\n", wd.c_str());
+        return 1;
+    }
     return 0;
 }
 
+// The layout of a text file, from layoutCache when it is there. nullptr on failure.
+// Only valid until the next insert into the cache.
+const TextLayout* layoutTextFile(const char* directory, const char* filename, bool wrap){
+    String wd = String(directory) + "/" + filename;
+
+    // Items are content addressed: an unchanged item is shown with its cached layout
+    ItemRecord record;
+    if (!readRecord(wd.c_str(), record)) {
+        return nullptr;
+    }
+    const TextLayout* cached = layoutCache.find(record.hash, wrap);
+    if (cached != nullptr) {
+        return cached;
+    }
+
+    // Only the string is stored, the glyphs come from the compiled-in font and the glyph store
+    char text[MAX_TEXT_LEN];
+    size_t len = loadItem(wd.c_str(), (uint8_t*)text, sizeof(text));
+    if (len == 0) {
+        return nullptr;
+    }
+    // Text files are UTF-8, anything beyond ASCII is looked up in the glyph store first
+    LayoutFonts fonts = {&font5x7, glyphStore.ready() ? &glyphStore : nullptr, !isAsciiText(text, len)};
+    TextLayout layout;
+    if (!layoutText(layout, text, len, fonts, textColor, wrap)) {
+        return nullptr;
+    }
+    return layoutCache.insert(record.hash, wrap, layout);
+}
+
+// Makes a text file the one CHARACTERS mode shows, scrolled back to its start
+bool loadTextFile(const char* directory, const char* filename, bool wrap){
+    const TextLayout* layout = layoutTextFile(directory, filename, wrap);
+    if (layout == nullptr) {
+        return false;
+    }
+    currentLayout = layout;
+    textScroll.column = 0;
+    textScroll.fraction = 0;
+    return true;
+}
+
+// Wire words of one text column: the packed span column from the atlas, or
+// several ORed together where lines share the column. nullptr if the atlas has no memory.
+const size_t MAX_COLUMN_SPANS = 8;
+const uint16_t* textWireColumn(int x) {
+    static uint16_t combined[WIRE_WORDS];
+    const LayoutSpan* spans[MAX_COLUMN_SPANS];
+    size_t n = layoutSpansAt(*currentLayout, x, spans, MAX_COLUMN_SPANS);
+    if (n == 0) {
+        memset(combined, 0, sizeof(combined));
+        return combined;
+    }
+    const uint16_t* first = textAtlas.column(spans[0]->strip, x - spans[0]->x);
+    if (n == 1 || first == nullptr) {
+        return first;
+    }
+    memcpy(combined, first, sizeof(combined));
+    for (size_t i = 1; i < n; i++) {
+        orWireColumn(combined, textAtlas.column(spans[i]->strip, x - spans[i]->x));
+    }
+    return combined;
+}
+
+// Same column expanded to RGB, for when the atlas could not be allocated
+void renderTextColumn(int x, RGB* column) {
+    RGB spanColumn[HEIGHT];
+    const LayoutSpan* spans[MAX_COLUMN_SPANS];
+    size_t n = layoutSpansAt(*currentLayout, x, spans, MAX_COLUMN_SPANS);
+    memset(column, 0, HEIGHT * sizeof(RGB));
+    for (size_t i = 0; i < n; i++) {
+        renderStripColumn(spans[i]->strip, x - spans[i]->x, spanColumn);
+        for (int y = 0; y < HEIGHT; y++) {
+            if (spanColumn[y].r | spanColumn[y].g | spanColumn[y].b) {
+                column[y] = spanColumn[y];
+            }
+        }
+    }
+}
+
+// One revolution of text. Rotation only moves the column the scan starts at,
+// the layout itself is never redone.
+void displayText() {
+    TraceSpan span(TRACE_RENDER, currentMode);
+    RGB column[HEIGHT];
+
+    // The fractional offset delays the whole revolution by that part of a column
+    delayMicroseconds((unsigned)(columnInterval * textScroll.fraction / 65536));
+    for (int i=0; i<WIDTH; i++){
+        int x = scrollColumn(textScroll, currentLayout->width, i);
+        const uint16_t* wire = textWireColumn(x);
+        if (wire != nullptr) {
+            sendWireColumn(wire, 1);
+        } else {
+            // No memory for the atlas, expand and pack every column
+            renderTextColumn(x, column);
+            displayColumn(column, 1);
+        }
+        delayMicroseconds(columnInterval);        // Small delay in between every column
+    }
+    advanceScroll(textScroll, currentLayout->width);
+}
+
 void tryDisplayC(){
-    loadFilesFromDirectory("/characters"); // Load character files
+    String directory = listedPath("/char");
+    loadFilesFromDirectory(directory.c_str()); // Load character files, written by /write_char
     if (currentIndex==-1){
-        displayCurrentFile(def[314]);
+        displayCurrentFile(def[0]);
         Serial.println("No character file is uploaded");
     }else{
-        if (loadRGBFile( "/characters", fileList[currentIndex].c_str())!=1){
-            displayCurrentFile(current[314]);
+        // Rotating text scrolls long lines instead of wrapping them
+        if (loadTextFile(directory.c_str(), fileList[currentIndex].c_str(), currentSubMode != ROTATING_TEXT)){
+            displayText();
         }else{
             perror("Failed to open file");
         }
@@ -291,19 +389,61 @@ void tryDisplayC(){
 }
 
 void tryDisplayI(){
-    loadFilesFromDirectory("/img"); // Load character files
+    String directory = listedPath("/img");
+    loadFilesFromDirectory(directory.c_str()); // Load character files
+    pictureShown = false;
     if (currentIndex==-1){
-        displayCurrentFile(def[314]);
+        displayCurrentFile(def[0]);
         Serial.println("No img file is uploaded");
     }else{
-        if (loadRGBFile( "/img", fileList[currentIndex].c_str())!=1){
-            displayCurrentFile(current[314]);
+        if (loadRGBFile(directory.c_str(), fileList[currentIndex].c_str())!=1){
+            pictureShown = true;
+            displayCurrentFile(current[0]);
         }else{
             perror("Failed to open file");
         }
     }
 }
 
+// Loads the selected /vec scene, false if there is none or it does not compile
+bool loadVectorFile(const char* directory, const char* filename) {
+    String wd = String(directory) + "/" + filename;
+    static uint8_t scene[MAX_VECTOR_SCENE_SIZE];
+    size_t len = loadItem(wd.c_str(), scene, sizeof(scene));
+    if (len == 0 || !vectorScene.load(scene, len)) {
+        vectorScene.clear();
+        return false;
+    }
+    return true;
+}
+
+// One revolution of the scene, every column rasterized as it is sent
+void displayVector() {
+    TraceSpan span(TRACE_RENDER, currentMode);
+    RGB column[HEIGHT];
+    for (int i=0; i<WIDTH; i++){
+        vectorScene.column(i, column);
+        displayColumn(column, 1);
+        delayMicroseconds(columnInterval);        // Small delay in between every column
+    }
+}
+
+void tryDisplayG(){
+    String directory = listedPath("/vec");
+    loadFilesFromDirectory(directory.c_str()); // Load vector scenes, written by /write_vec
+    if (currentIndex==-1){
+        vectorScene.clear();
+        displayCurrentFile(def[0]);
+        Serial.println("No vector file is uploaded");
+    }else{
+        if (loadVectorFile(directory.c_str(), fileList[currentIndex].c_str())){
+            Serial.printf("Scene %s: %u edges\n", fileList[currentIndex].c_str(), (unsigned)vectorScene.edgeCount());
+        }else{
+            Serial.printf("Corrupt scene %s\n", fileList[currentIndex].c_str());
+        }
+    }
+}
+
 void playVideo() {
     while (play) {
         uint8_t* temp = inMemoryStorage[currentFrame];
@@ -318,102 +458,646 @@ void playVideo() {
     }
 }
 
-bool parse_serial_data_and_do_stuff() {
-    if (Serial.available() > 0) {
-        char input_type = Serial.read();
-
-        switch (currentMode) {
-            case MENU:
-                if (input_type == 'c') {
-                    currentMode = CHARACTERS;
-                    Serial.println("Entered Characters mode. Choose 'r' for rotating text or 's' for static text.");
-                    tryDisplayC(); //文字显示function
-                } else if (input_type == 'p') {
-                    currentMode = PICTURES;
-                    Serial.println("Entered Pictures mode. Use 'n' for next and 'p' for previous.");
-                    tryDisplayI();
-                } else if (input_type == 'v') {
-                    currentMode = VIDEOS;
-                    Serial.println("Entered Videos mode. Use 's' to start and 'p' to pause playback.");
+// Frees the images and layouts held by layers and removes every layer
+void clearLayers() {
+    for (size_t i = 0; i < MAX_LAYERS; i++) {
+        free(layerImages[i]);
+        layerImages[i] = nullptr;
+        freeTextLayout(layerTexts[i]);
+    }
+    compositor.clear();
+    videoLayer = -1;
+}
+
+// Layer alpha from an optional argument, opaque if it is missing
+uint8_t layerAlpha(const Command& cmd, size_t arg) {
+    uint32_t alpha;
+    if (cmd.argc <= arg || !cmd.args[arg].toU32(alpha)) {
+        return 255;
+    }
+    return alpha > 255 ? 255 : alpha;
+}
+
+// Decimal with an optional leading '-'
+bool tokenToInt(const Token& token, int32_t& out) {
+    bool negative = token.first() == '-';
+    Token digits = negative ? Token{token.ptr + 1, token.len - 1} : token;
+    uint32_t value;
+    if (!digits.toU32(value) || value > 0x7fffff) {
+        return false;
+    }
+    out = negative ? -(int32_t)value : (int32_t)value;
+    return true;
+}
+
+// Adds file n of /img (decoded into PSRAM) or /char (its layout) of the active generation as the top layer
+int addFileLayer(const char* kind, const Command& cmd) {
+    uint32_t index;
+    if (compositor.count() >= MAX_LAYERS) {
+        Serial.println("All layers are in use, 'clear' removes them");
+        return -1;
+    }
+    String path = activePath(kind);
+    const char* directory = path.c_str();
+    traverseSPIFFSAndAddFiles(directory);
+    if (cmd.argc < 1 || !cmd.args[0].toU32(index) || index >= fileList.size()) {
+        Serial.println("No such file");
+        return -1;
+    }
+    const char* name = fileList[index].c_str();
+    Layer layer = {};
+    layer.alpha = layerAlpha(cmd, 1);
+    layer.keyBlack = true;   // logos and text show the layers below around them
+
+    if (strcmp(kind, "/img") == 0) {
+        RGB* frame = (RGB*)ps_malloc(RAW_IMAGE_SIZE);
+        if (frame == nullptr || loadRGBFile(directory, name, frame) != 0) {
+            Serial.println("Failed to load image layer");
+            free(frame);
+            return -1;
+        }
+        layer.source = LAYER_FRAME;
+        layer.frame = frame;
+        int i = compositor.add(layer);
+        layerImages[i] = frame;
+        return i;
+    }
+
+    // A ticker: long lines scroll around instead of wrapping
+    const TextLayout* cached = layoutTextFile(directory, name, false);
+    TextLayout text;
+    if (cached == nullptr || !copyTextLayout(text, *cached)) {
+        Serial.println("Failed to load text layer");
+        return -1;
+    }
+    size_t i = compositor.count();   // the slot add() fills, checked above
+    layerTexts[i] = text;
+    layer.source = LAYER_TEXT;
+    layer.text = &layerTexts[i];
+    return compositor.add(layer);
+}
+
+// One revolution of the layers, blended column by column. The video layer
+// shows the next frame in PSRAM every revolution.
+void displayLayers() {
+    TraceSpan span(TRACE_RENDER, currentMode);
+    RGB column[HEIGHT];
+    Layer* video = videoLayer >= 0 ? compositor.layer(videoLayer) : nullptr;
+    if (video != nullptr) {
+        auto frame = inMemoryStorage.find(layerFrame);
+        if (frame == inMemoryStorage.end()) {
+            layerFrame = 0;
+            frame = inMemoryStorage.find(layerFrame);
+        }
+        video->frame = frame != inMemoryStorage.end() ? reinterpret_cast<RGB*>(frame->second) : nullptr;
+        layerFrame++;
+    }
+    for (int i=0; i<WIDTH; i++){
+        compositor.renderColumn(i, column);
+        displayColumn(column, 1);
+        delayMicroseconds(columnInterval);        // Small delay in between every column
+    }
+    compositor.advance();
+}
+
+void handleLayerCommand(const Command& cmd) {
+    const Token& verb = cmd.verb;
+    int added = -1;
+    if (verb.equals("video")) {
+        if (videoLayer >= 0) {
+            Serial.println("There already is a video layer.");
+            return;
+        }
+        Layer layer = {};
+        layer.source = LAYER_FRAME;
+        layer.alpha = layerAlpha(cmd, 0);
+        added = videoLayer = compositor.add(layer);
+        if (added < 0) {
+            Serial.println("All layers are in use, 'clear' removes them");
+        }
+    } else if (verb.equals("image")) {
+        added = addFileLayer("/img", cmd);
+    } else if (verb.equals("text")) {
+        added = addFileLayer("/char", cmd);
+    } else if (verb.equals("spin") || verb.equals("offset")) {
+        uint32_t index;
+        int32_t value;
+        Layer* layer = cmd.argc >= 2 && cmd.args[0].toU32(index) ? compositor.layer(index) : nullptr;
+        if (layer == nullptr || !tokenToInt(cmd.args[1], value) || (verb.equals("offset") && value < 0)) {
+            Serial.println("Use spin:<layer>:<1/256 columns per revolution> or offset:<layer>:<column>");
+            return;
+        }
+        if (verb.equals("spin")) {
+            layer->scroll.speed = value * 256;
+        } else {
+            layer->scroll.column = value;
+            layer->scroll.fraction = 0;
+        }
+    } else if (verb.equals("clear")) {
+        clearLayers();
+        Serial.println("Layers cleared.");
+    } else {
+        Serial.println("Unrecognized command in Layers mode.");
+    }
+    if (added >= 0) {
+        Serial.printf("Added layer %d.\n", added);
+    }
+}
+
+EffectTime effectTime() {
+    uint32_t now = millis();
+    return {effectRevolution, now - effectStartMs, (uint32_t)(((int64_t)now + clockOffsetMs) % DAY_MS + DAY_MS) % DAY_MS};
+}
+
+void startEffect(size_t index) {
+    currentEffect = index;
+    effectStartMs = millis();
+    effectRevolution = 0;
+    Serial.printf("Effect: %s\n", builtinEffects[currentEffect]->name());
+}
+
+// One revolution of the current effect, every column generated as it is sent
+void displayEffect() {
+    TraceSpan span(TRACE_RENDER, currentMode);
+    RGB column[HEIGHT];
+    Effect* effect = builtinEffects[currentEffect];
+    EffectTime time = effectTime();
+    effect->prepare(time);
+    for (int i=0; i<WIDTH; i++){
+        effect->column(columnAngle(i), time, column);
+        displayColumn(column, 1);
+        delayMicroseconds(columnInterval);        // Small delay in between every column
+    }
+    effectRevolution++;
+}
+
+// Times revolutions of every effect without sending them, against the column budget
+void benchEffects() {
+    const int revolutions = 10;
+    RGB column[HEIGHT];
+    for (size_t e = 0; e < BUILTIN_EFFECT_COUNT; e++) {
+        Effect* effect = builtinEffects[e];
+        EffectTime time = effectTime();
+        unsigned long start = micros();
+        for (int r = 0; r < revolutions; r++) {
+            effect->prepare(time);
+            for (int i = 0; i < WIDTH; i++) {
+                effect->column(columnAngle(i), time, column);
+            }
+            time.ms += 25;
+            time.dayMs += 25;
+        }
+        unsigned long ns = (micros() - start) * 1000UL / (revolutions * WIDTH);
+        Serial.printf("%-14s %5lu ns/column of %u%s\n", effect->name(), ns, COLUMN_BUDGET_NS,
+                      ns > COLUMN_BUDGET_NS ? "  OVER BUDGET" : "");
+    }
+}
+
+void handleEffectCommand(const Command& cmd) {
+    char input_type = cmd.verb.len == 1 ? cmd.verb.first() : '\0';
+    uint32_t h, m, sec;
+    if (input_type == 'n') {
+        startEffect((currentEffect + 1) % BUILTIN_EFFECT_COUNT);
+    } else if (input_type == 'p') {
+        startEffect((currentEffect + BUILTIN_EFFECT_COUNT - 1) % BUILTIN_EFFECT_COUNT);
+    } else if (input_type == 'b') {
+        benchEffects();
+    } else if (cmd.verb.equals("time")) {
+        if (cmd.argc < 3 || !cmd.args[0].toU32(h) || !cmd.args[1].toU32(m) || !cmd.args[2].toU32(sec)
+            || h > 23 || m > 59 || sec > 59) {
+            Serial.println("Use time:HH:MM:SS");
+            return;
+        }
+        clockOffsetMs = (int32_t)((h * 3600 + m * 60 + sec) * 1000 - millis() % DAY_MS);
+        Serial.println("Clock set.");
+    } else {
+        Serial.println("Unrecognized command in Effects mode.");
+    }
+}
+
+bool queueDisplayCommand(const char* line, size_t len) {
+    // Line plus terminator has to fit, otherwise the command would be split
+    if (COMMAND_RING_SIZE - remoteCommands.pending() < len + 1) {
+        return false;
+    }
+    remoteCommands.push(line, len);
+    remoteCommands.push("\n", 1);
+    return true;
+}
+
+// 'stats' prints the column path timing, 'stats:reset' starts it over; in any mode
+void handleStatsCommand(const Command& cmd) {
+    static char text[1024];
+    if (cmd.argc >= 1 && cmd.args[0].equals("reset")) {
+        statsReset();
+        Serial.println("Stats reset.");
+        return;
+    }
+    formatStatsText(text, sizeof(text));
+    Serial.print(text);
+}
+
+// Prints the trace ring as hex records between TRACE BEGIN and TRACE END lines, for tools/trace_convert
+void dumpTrace() {
+    TraceHeader header;
+    TraceDump dump = traceStop(header);
+    size_t count = dump.count;
+    Serial.printf("TRACE BEGIN %u %u\n", (unsigned)header.count, (unsigned)header.dropped);
+    char line[2 * sizeof(TraceRecord) + 2];
+    for (size_t i = 0; i < count; i++) {
+        TraceRecord r = traceRead(dump, i);
+        const uint8_t* bytes = (const uint8_t*)&r;
+        for (size_t b = 0; b < sizeof(r); b++) {
+            snprintf(line + 2 * b, 3, "%02x", bytes[b]);
+        }
+        line[2 * sizeof(r)] = '\n';
+        Serial.write((const uint8_t*)line, 2 * sizeof(r) + 1);
+    }
+    Serial.println("TRACE END");
+    traceResume();
+}
+
+// 'trace:dump' streams the event trace over serial (slow at 115200 baud, GET /trace is faster),
+// 'trace:stop', 'trace:start' and 'trace:clear' control it
+void handleTraceCommand(const Command& cmd) {
+    if (cmd.argc < 1) {
+        Serial.println("Use trace:dump, trace:start, trace:stop or trace:clear");
+    } else if (cmd.args[0].equals("dump")) {
+        dumpTrace();
+    } else if (cmd.args[0].equals("start")) {
+        traceEnable(true);
+        Serial.println("Tracing.");
+    } else if (cmd.args[0].equals("stop")) {
+        traceEnable(false);
+        Serial.println("Tracing stopped.");
+    } else if (cmd.args[0].equals("clear")) {
+        traceClear();
+        Serial.println("Trace cleared.");
+    } else {
+        Serial.println("Use trace:dump, trace:start, trace:stop or trace:clear");
+    }
+}
+
+const uint32_t MIN_COLUMN_INTERVAL_NS = 2000;
+const uint32_t MAX_COLUMN_INTERVAL_NS = 100000;
+
+void setColumnInterval(uint32_t ns) {
+    columnInterval = ns / 1000.0f;
+    statsBegin((uint32_t)(columnInterval * getCpuFrequencyMhz()));
+}
+
+// 'interval' prints the time per column, 'interval:<ns>' calibrates it to the motor's speed; in any mode
+void handleIntervalCommand(const Command& cmd) {
+    uint32_t ns;
+    if (cmd.argc >= 1) {
+        if (!cmd.args[0].toU32(ns) || ns < MIN_COLUMN_INTERVAL_NS || ns > MAX_COLUMN_INTERVAL_NS) {
+            Serial.printf("Use interval:<ns per column>, %u to %u\n", MIN_COLUMN_INTERVAL_NS, MAX_COLUMN_INTERVAL_NS);
+            return;
+        }
+        setColumnInterval(ns);
+    }
+    Serial.printf("Column interval %u ns\n", (unsigned)(columnInterval * 1000 + 0.5f));
+}
+
+void handleDisplayCommand(const Command& cmd) {
+    TraceSpan span(TRACE_COMMAND, traceTag(cmd.verb.ptr, cmd.verb.len));
+    if (cmd.verb.equals("stats")) {
+        handleStatsCommand(cmd);
+        return;
+    }
+    if (cmd.verb.equals("trace")) {
+        handleTraceCommand(cmd);
+        return;
+    }
+    if (cmd.verb.equals("interval")) {
+        handleIntervalCommand(cmd);
+        return;
+    }
+    if (cmd.verb.equals("mem")) {
+        static char text[2560];
+        formatMemoryText(text, sizeof(text));
+        Serial.print(text);
+        return;
+    }
+
+    // Menu commands are single keys
+    char input_type = cmd.verb.len == 1 ? cmd.verb.first() : '\0';
+
+    switch (currentMode) {
+        case MENU:
+            if (input_type == 'c') {
+                currentMode = CHARACTERS;
+                Serial.println("Entered Characters mode. Choose 'r' for rotating text or 's' for static text.");
+                tryDisplayC(); //文字显示function
+            } else if (input_type == 'p') {
+                currentMode = PICTURES;
+                Serial.println("Entered Pictures mode. Use 'n' for next and 'p' for previous.");
+                tryDisplayI();
+            } else if (input_type == 'v') {
+                currentMode = VIDEOS;
+                Serial.println("Entered Videos mode. Use 's' to start and 'p' to pause playback.");
+            } else if (input_type == 'e') {
+                currentMode = EFFECTS;
+                Serial.println("Entered Effects mode. Use 'n' and 'p' to change effect, 'time:HH:MM:SS' to set the "
+                               "clocks and 'b' to time the effects.");
+                startEffect(currentEffect);
+            } else if (input_type == 'g') {
+                currentMode = VECTORS;
+                Serial.println("Entered Vector graphics mode. Use 'n' for next and 'p' for previous.");
+                tryDisplayG();
+            } else if (input_type == 'l') {
+                currentMode = LAYERS;
+                Serial.println("Entered Layers mode. Add layers bottom to top with 'video[:alpha]', 'image:<n>[:alpha]' "
+                               "and 'text:<n>[:alpha]', turn them with 'spin:<layer>:<speed>' and "
+                               "'offset:<layer>:<column>', 'clear' removes them.");
+            } else {
+                Serial.println("Unrecognized command in General Menu.");
+            }
+            break;
+
+        case CHARACTERS:
+            if (input_type == 'n') {
+                if (currentIndex < fileList.size() - 1) {
+                    currentIndex++;
+                    tryDisplayC();
                 } else {
-                    Serial.println("Unrecognized command in General Menu.");
+                    Serial.println("No more files.");
                 }
-                break;
-
-            case CHARACTERS:
-                if (input_type == 'n') {
-                    if (currentIndex < fileList.size() - 1) {
-                        currentIndex++;
-                        tryDisplayC();
-                    } else {
-                        Serial.println("No more files.");
-                    }
-                } else if (input_type == 'p') {
-                    if (currentIndex > 0) {
-                        currentIndex--;
-                        tryDisplayC();
-                    } else {
-                        Serial.println("No previous files.");
-                    }
-                } else if (input_type == 'm' || input_type == 'q') {
-                    currentMode = MENU;
-                    currentSubMode = NONE;
-                    Serial.println("Returning to General Menu.");
+            } else if (input_type == 'p') {
+                if (currentIndex > 0) {
+                    currentIndex--;
+                    tryDisplayC();
                 } else {
-                    Serial.println("Unrecognized command in Characters mode.");
+                    Serial.println("No previous files.");
                 }
-                tryDisplayC();
-                break;
-
-            case PICTURES:
-                if (input_type == 'n') {
-                    if (currentIndex < fileList.size() - 1) {
-                        currentIndex++;
-                        tryDisplayI();
-                    } else {
-                        Serial.println("No more pictures.");
-                    }
-                } else if (input_type == 'p') {
-                    if (currentIndex > 0) {
-                        currentIndex--;
-                        tryDisplayI();
-                    } else {
-                        Serial.println("No previous pictures.");
-                    }
-                } else if (input_type == 'm' || input_type == 'q') {
-                    currentMode = MENU;
-                    currentSubMode = NONE;
-                    Serial.println("Returning to General Menu.");
+            } else if (input_type == 'r') {
+                currentSubMode = ROTATING_TEXT;
+                textScroll.speed = TEXT_SCROLL_SPEED;
+                Serial.println("Rotating text.");
+            } else if (input_type == 's') {
+                currentSubMode = STATIC_TEXT;
+                textScroll.speed = 0;
+                Serial.println("Static text.");
+            } else if (input_type == 'm' || input_type == 'q') {
+                currentMode = MENU;
+                currentSubMode = NONE;
+                Serial.println("Returning to General Menu.");
+            } else {
+                Serial.println("Unrecognized command in Characters mode.");
+            }
+            tryDisplayC();
+            break;
+
+        case PICTURES:
+            if (input_type == 'n') {
+                if (currentIndex < fileList.size() - 1) {
+                    currentIndex++;
+                    tryDisplayI();
                 } else {
-                    Serial.println("Unrecognized command in Pictures mode.");
+                    Serial.println("No more pictures.");
                 }
-                tryDisplayI();
-                break;
-
-            case VIDEOS:
-                if (input_type == 's'){ //representing start
-                    play=true;
-                }else if (input_type == 'p') {//representing pause
-                    play=false;
-                }else{
-                    Serial.println("Unrecognized command in video mode, playing paused");
-                    play=false;
+            } else if (input_type == 'p') {
+                if (currentIndex > 0) {
+                    currentIndex--;
+                    tryDisplayI();
+                } else {
+                    Serial.println("No previous pictures.");
                 }
-                if (play){
-                    playVideo();
-                }else{
-                    Serial.println("Unrecognized command in video mode, playing paused");
-                    sleep(3000); 
+            } else if (input_type == 'm' || input_type == 'q') {
+                currentMode = MENU;
+                currentSubMode = NONE;
+                pictureShown = false;
+                Serial.println("Returning to General Menu.");
+            } else {
+                Serial.println("Unrecognized command in Pictures mode.");
+            }
+            tryDisplayI();
+            break;
+
+        case VIDEOS:
+            if (input_type == 's'){ //representing start
+                play=true;
+            }else if (input_type == 'p') {//representing pause
+                play=false;
+            }else{
+                Serial.println("Unrecognized command in video mode, playing paused");
+                play=false;
+            }
+            if (play){
+                playVideo();
+            }else{
+                Serial.println("Unrecognized command in video mode, playing paused");
+                sleep(3000); 
+            }
+            break;
+
+        case VECTORS:
+            if (input_type == 'n') {
+                if (currentIndex < fileList.size() - 1) {
+                    currentIndex++;
+                    tryDisplayG();
+                } else {
+                    Serial.println("No more scenes.");
                 }
-                break;
-        }
+            } else if (input_type == 'p') {
+                if (currentIndex > 0) {
+                    currentIndex--;
+                    tryDisplayG();
+                } else {
+                    Serial.println("No previous scenes.");
+                }
+            } else if (input_type == 'm' || input_type == 'q') {
+                vectorScene.clear();
+                currentMode = MENU;
+                Serial.println("Returning to General Menu.");
+            } else {
+                Serial.println("Unrecognized command in Vector graphics mode.");
+            }
+            break;
+
+        case EFFECTS:
+            if (input_type == 'm' || input_type == 'q') {
+                currentMode = MENU;
+                Serial.println("Returning to General Menu.");
+            } else {
+                handleEffectCommand(cmd);
+            }
+            break;
+
+        case LAYERS:
+            if (input_type == 'm' || input_type == 'q') {
+                clearLayers();
+                currentMode = MENU;
+                Serial.println("Returning to General Menu.");
+            } else {
+                handleLayerCommand(cmd);
+            }
+            break;
+    }
+}
+
+// Item directory of a mode within a generation, nullptr for modes without items
+const char* modeDirectory(Mode mode) {
+    switch (mode) {
+        case CHARACTERS: return "/char";
+        case PICTURES: return "/img";
+        case VECTORS: return "/vec";
+        default: return nullptr;
+    }
+}
+
+// Saves what is shown now, so the next power-on starts with it. Flash is only written when it changed.
+void rememberDisplayState() {
+    BootState state;
+    memset(&state, 0, sizeof(state));   // compared byte for byte, padding included
+    state.version = BOOT_STATE_VERSION;
+    state.mode = currentMode;
+    state.subMode = currentSubMode;
+    state.effect = currentEffect;
+    if (modeDirectory(currentMode) != nullptr && currentIndex >= 0 && currentIndex < (int)fileList.size()) {
+        strncpy(state.item, fileList[currentIndex].c_str(), sizeof(state.item) - 1);
+        state.generation = listedGeneration;
+    }
+    state.columnIntervalNs = columnInterval == (float)ROWINTERVAL ? 0 : (uint32_t)(columnInterval * 1000 + 0.5f);
+    saveBootState(state);
+}
+
+// Loads a stored item by name and draws its first revolution
+bool showItem(Mode mode, SubMode subMode, const char* directory, const char* name) {
+    // Stands in for the listing until it is read
+    fileList.assign(1, name);
+    currentIndex = 0;
+    switch (mode) {
+        case PICTURES:
+            if (loadRGBFile(directory, name) != 0) {
+                return false;
+            }
+            currentMode = PICTURES;
+            pictureShown = true;
+            displayCurrentFile(current[0]);
+            return true;
+        case CHARACTERS:
+            if (!loadTextFile(directory, name, subMode != ROTATING_TEXT)) {
+                return false;
+            }
+            currentMode = CHARACTERS;
+            currentSubMode = subMode;
+            textScroll.speed = subMode == ROTATING_TEXT ? TEXT_SCROLL_SPEED : 0;
+            displayText();
+            return true;
+        case VECTORS:
+            if (!loadVectorFile(directory, name)) {
+                return false;
+            }
+            currentMode = VECTORS;
+            displayVector();
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Goes back to what was shown before power-off. The item is opened by name
+// as soon as the frame store is loaded and before any directory is listed;
+// the listing n and p need follows. Video frames and
+// layers lived in PSRAM, those modes start in the menu.
+void restoreDisplayState() {
+    BootState state;
+    if (!loadBootState(state)) {
+        Serial.println("No saved display state, starting in the menu.");
+        return;
+    }
+    if (state.columnIntervalNs >= MIN_COLUMN_INTERVAL_NS && state.columnIntervalNs <= MAX_COLUMN_INTERVAL_NS) {
+        setColumnInterval(state.columnIntervalNs);
+    }
+    if (state.effect < BUILTIN_EFFECT_COUNT) {
+        currentEffect = state.effect;
+    }
+    Mode mode = (Mode)state.mode;
+    if (mode == EFFECTS) {
+        currentMode = EFFECTS;
+        startEffect(currentEffect);
+        displayEffect();
+        Serial.printf("Restored effect %s at %lu ms\n", builtinEffects[currentEffect]->name(), millis());
+        return;
+    }
+    if (modeDirectory(mode) == nullptr || state.item[0] == '\0') {
+        return;
+    }
+    // Waits for the frame store if the other core is still loading it
+    if (!storageBegin()) {
+        Serial.println("SPIFFS not mounted, starting in the menu.");
+        return;
+    }
+    // Saved before a new generation was activated: that item is gone or means something else now
+    if (state.generation != activeGeneration()) {
+        Serial.println("The saved item belongs to a replaced generation, starting in the menu.");
+        return;
+    }
+    String path = listedPath(modeDirectory(mode));
+    const char* directory = path.c_str();
+    if (!showItem(mode, (SubMode)state.subMode, directory, state.item)) {
+        currentMode = MENU;
+        currentSubMode = NONE;
+        Serial.printf("Could not restore %s/%s, starting in the menu.\n", directory, state.item);
+        return;
+    }
+    Serial.printf("Restored %s/%s at %lu ms\n", directory, state.item, millis());
+
+    // n and p move on from the restored item
+    traverseSPIFFSAndAddFiles(directory);
+    auto it = std::find(fileList.begin(), fileList.end(), std::string(state.item));
+    currentIndex = it != fileList.end() ? (int)(it - fileList.begin()) : (fileList.empty() ? -1 : 0);
+}
+
+// A generation activated over HTTP replaces the listed items, which are reclaimed
+// next: list the new ones and show the first, and remember that for the next boot
+void followActiveGeneration() {
+    currentIndex = -1;
+    switch (currentMode) {
+        case CHARACTERS: tryDisplayC(); break;
+        case PICTURES: tryDisplayI(); break;
+        case VECTORS: tryDisplayG(); break;
+        default: break;
+    }
+    Serial.printf("Generation %u is active, showing its first item.\n", (unsigned)listedGeneration);
+    rememberDisplayState();
+}
+
+bool parse_serial_data_and_do_stuff() {
+    char chunk[64];
+    while (Serial.available() > 0) {
+        size_t n = Serial.available() < (int)sizeof(chunk) ? Serial.available() : sizeof(chunk);
+        n = Serial.readBytes(chunk, n);
+        serialCommands.push(chunk, n);
+        lastSerialByte = millis();
     }
 
+    // A command ends with a newline, or when the line goes quiet so single keys still work.
+    // Commands list and load items, so the first one after boot waits for the frame store.
+    Command cmd;
+    if (serialCommands.next(cmd) ||
+        (millis() - lastSerialByte > SERIAL_IDLE_MS && serialCommands.flushPartial(cmd))) {
+        storageBegin();
+        handleDisplayCommand(cmd);
+        rememberDisplayState();
+        return true;
+    }
+    if (remoteCommands.next(cmd)) {
+        storageBegin();
+        handleDisplayCommand(cmd);
+        rememberDisplayState();
+        return true;
+    }
     return false;
 }
 
 
 void setupSPI() {
+    // Channel order of the LED controllers, used by every column sent
+    initColumnPack();
+    statsBegin((uint32_t)(columnInterval * getCpuFrequencyMhz()));
+
     // Initialize SPI
     SPI.begin(SCK_PIN, -1, MOSI_PIN, -1); // MISO (-1) is not used here, only SCK and MOSI
 
@@ -435,11 +1119,43 @@ void setupSPI() {
 void setup() {
     Serial.begin(115200);
     Serial.setTimeout(70);
+    logBegin();
     setupSPI();
+    if (!textAtlas.begin(GLYPH_ATLAS_ENTRIES)) {
+        Serial.println("Glyph atlas allocation failed, text columns are packed on the fly");
+    }
+    if (TRACE_ENABLED && !traceBegin()) {
+        Serial.println("No PSRAM for the trace ring, events are not traced");
+    }
+    if (!glyphPartition.begin() || !glyphStore.begin(glyphPartition)) {
+        Serial.println("No glyph store in the glyphs partition, only ASCII text can be shown");
+    }
+    // Back to the last content before anything slow
+    restoreDisplayState();
 
     for ( int i = 0; i < 3; ++i ) { Serial.println("Testing Serial.println()"); }
 }
 
 void loop() {
     parse_serial_data_and_do_stuff();
+    if (modeDirectory(currentMode) != nullptr && activeGeneration() != listedGeneration) {
+        followActiveGeneration();
+    }
+
+    // Rotating and static text are redrawn every revolution until the menu is left
+    if (currentMode == CHARACTERS && currentSubMode != NONE && currentLayout != nullptr) {
+        displayText();
+    }
+    if (currentMode == PICTURES && pictureShown) {
+        displayCurrentFile(current[0]);
+    }
+    if (currentMode == LAYERS && compositor.count() > 0) {
+        displayLayers();
+    }
+    if (currentMode == EFFECTS) {
+        displayEffect();
+    }
+    if (currentMode == VECTORS && vectorScene.loaded()) {
+        displayVector();
+    }
 }
\ No newline at end of file
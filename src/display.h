@@ -0,0 +1,10 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+#include "command_parser.h"
+
+// Menu commands for the renderer, the same single keys the serial menu takes
+void handleDisplayCommand(const Command& cmd);
+// Queue a command line from another context (HTTP), run by the display loop
+bool queueDisplayCommand(const char* line, size_t len);
+
+#endif // DISPLAY_H
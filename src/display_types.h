@@ -0,0 +1,17 @@
+#ifndef DISPLAY_TYPES_H
+#define DISPLAY_TYPES_H
+#include <stdint.h>
+
+// Geometry of the cylinder surface: WIDTH columns around the circumference,
+// HEIGHT LEDs per column, row 0 at the top.
+#define WIDTH 314
+#define HEIGHT 186
+
+// RGB structure and arrays/columns of RGB representing a picture
+typedef struct {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+} RGB;
+
+#endif // DISPLAY_TYPES_H
@@ -0,0 +1,350 @@
+#include <string.h>
+#include "effects.h"
+#include "font.h"
+
+// sin over one revolution in 256 steps, Q15
+static const int16_t SINE_TABLE[256] = {
+    0, 804, 1608, 2410, 3212, 4011, 4808, 5602, 6393, 7179, 7962, 8739,
+    9512, 10278, 11039, 11793, 12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+    18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594, 23170, 23731, 24279, 24811,
+    25329, 25832, 26319, 26790, 27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+    30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971, 32137, 32285, 32412, 32521,
+    32609, 32678, 32728, 32757, 32767, 32757, 32728, 32678, 32609, 32521, 32412, 32285,
+    32137, 31971, 31785, 31580, 31356, 31113, 30852, 30571, 30273, 29956, 29621, 29268,
+    28898, 28510, 28105, 27683, 27245, 26790, 26319, 25832, 25329, 24811, 24279, 23731,
+    23170, 22594, 22005, 21403, 20787, 20159, 19519, 18868, 18204, 17530, 16846, 16151,
+    15446, 14732, 14010, 13279, 12539, 11793, 11039, 10278, 9512, 8739, 7962, 7179,
+    6393, 5602, 4808, 4011, 3212, 2410, 1608, 804, 0, -804, -1608, -2410,
+    -3212, -4011, -4808, -5602, -6393, -7179, -7962, -8739, -9512, -10278, -11039, -11793,
+    -12539, -13279, -14010, -14732, -15446, -16151, -16846, -17530, -18204, -18868, -19519, -20159,
+    -20787, -21403, -22005, -22594, -23170, -23731, -24279, -24811, -25329, -25832, -26319, -26790,
+    -27245, -27683, -28105, -28510, -28898, -29268, -29621, -29956, -30273, -30571, -30852, -31113,
+    -31356, -31580, -31785, -31971, -32137, -32285, -32412, -32521, -32609, -32678, -32728, -32757,
+    -32767, -32757, -32728, -32678, -32609, -32521, -32412, -32285, -32137, -31971, -31785, -31580,
+    -31356, -31113, -30852, -30571, -30273, -29956, -29621, -29268, -28898, -28510, -28105, -27683,
+    -27245, -26790, -26319, -25832, -25329, -24811, -24279, -23731, -23170, -22594, -22005, -21403,
+    -20787, -20159, -19519, -18868, -18204, -17530, -16846, -16151, -15446, -14732, -14010, -13279,
+    -12539, -11793, -11039, -10278, -9512, -8739, -7962, -7179, -6393, -5602, -4808, -4011,
+    -3212, -2410, -1608, -804,
+};
+
+int16_t fixedSin(uint16_t angle) {
+    int i = angle >> 8;
+    int a = SINE_TABLE[i];
+    int b = SINE_TABLE[(i + 1) & 0xff];
+    return a + (((b - a) * (angle & 0xff)) >> 8);
+}
+
+RGB hueColor(uint16_t hue) {
+    uint32_t h = (uint32_t)hue * 6;
+    uint8_t f = (h >> 8) & 0xff;
+    switch (h >> 16) {
+        case 0: return {255, f, 0};
+        case 1: return {(uint8_t)(255 - f), 255, 0};
+        case 2: return {0, 255, f};
+        case 3: return {0, (uint8_t)(255 - f), 255};
+        case 4: return {f, 0, 255};
+        default: return {255, 0, (uint8_t)(255 - f)};
+    }
+}
+
+static void fillRows(RGB* out, int y0, int y1, RGB color) {
+    if (y0 < 0) {
+        y0 = 0;
+    }
+    if (y1 >= HEIGHT) {
+        y1 = HEIGHT - 1;
+    }
+    for (int y = y0; y <= y1; y++) {
+        out[y] = color;
+    }
+}
+
+// Signed distance in 1/16 LED from the column at `angle` to the one at
+// `center`, the short way around; one column is one LED wide
+static int32_t columnOffsetQ4(uint16_t angle, uint16_t center) {
+    return ((int32_t)(int16_t)(angle - center) * WIDTH * 16) >> 16;
+}
+
+
+// Hue around the cylinder, drifting over time, darker towards the bottom
+class GradientEffect : public Effect {
+public:
+    GradientEffect() : hueShift(0) {}
+    const char* name() const override { return "gradient"; }
+    void prepare(const EffectTime& time) override {
+        hueShift = (uint16_t)(((uint64_t)time.ms << 16) / PERIOD_MS);
+    }
+    void column(uint16_t angle, const EffectTime&, RGB* out) override {
+        // Channels fall linearly from full to a quarter, in 16.16 steps per pair of rows
+        RGB c = hueColor(angle + hueShift);
+        uint32_t r = c.r << 16, g = c.g << 16, b = c.b << 16;
+        uint32_t dr = (c.r * 3 << 15) / HEIGHT, dg = (c.g * 3 << 15) / HEIGHT, db = (c.b * 3 << 15) / HEIGHT;
+        for (int y = 0; y < HEIGHT; y += 2) {
+            RGB shade = {(uint8_t)(r >> 16), (uint8_t)(g >> 16), (uint8_t)(b >> 16)};
+            out[y] = shade;
+            out[y + 1] = shade;
+            r -= dr;
+            g -= dg;
+            b -= db;
+        }
+    }
+
+private:
+    static const uint32_t PERIOD_MS = 8000;  // one trip around the colour wheel
+    uint16_t hueShift;
+};
+
+
+// Classic plasma: three moving sine fields summed and looked up in a cyclic
+// palette. The row field is shared by every column of a revolution, and the
+// pattern is smooth enough to compute for pairs of rows.
+class PlasmaEffect : public Effect {
+public:
+    PlasmaEffect() : phase1(0), phase2(0), paletteShift(0) {
+        for (int i = 0; i < 256; i++) {
+            uint16_t a = i << 8;
+            palette[i] = {(uint8_t)(128 + fixedSin(a) * 127 / 32767), (uint8_t)(128 + fixedSin(a + 0x5555) * 127 / 32767),
+                          (uint8_t)(128 + fixedSin(a + 0xaaaa) * 127 / 32767)};
+        }
+        memset(rowField, 0, sizeof(rowField));
+    }
+    const char* name() const override { return "plasma"; }
+    void prepare(const EffectTime& time) override {
+        uint32_t t = time.ms;
+        for (int y = 0; y < HEIGHT / 2; y++) {
+            rowField[y] = fixedSin(y * 1400 + t * 23) >> 2;
+        }
+        phase1 = t * 17;
+        phase2 = t * 31;
+        paletteShift = t >> 4;
+    }
+    void column(uint16_t angle, const EffectTime&, RGB* out) override {
+        // Whole periods around the cylinder: 3 for the column field, 2 for the diagonal one
+        int columnField = fixedSin(angle * 3 + phase1) >> 2;
+        uint16_t diagonal = angle * 2 + phase2;
+        for (int y = 0; y < HEIGHT / 2; y++, diagonal += 1800) {
+            int v = columnField + rowField[y] + (SINE_TABLE[diagonal >> 8] >> 2);
+            RGB c = palette[(uint8_t)((v >> 6) + paletteShift)];
+            out[2 * y] = c;
+            out[2 * y + 1] = c;
+        }
+    }
+
+private:
+    RGB palette[256];
+    int16_t rowField[HEIGHT / 2];
+    uint16_t phase1;
+    uint16_t phase2;
+    uint8_t paletteShift;
+};
+
+
+// Floor and ceiling of a / b for b > 0
+static int32_t floorDiv(int32_t a, int32_t b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static int32_t ceilDiv(int32_t a, int32_t b) {
+    return a >= 0 ? (a + b - 1) / b : -(-a / b);
+}
+
+// Narrows [yMin, yMax] to the rows y with lo <= a + b * y <= hi
+static void limitRows(int32_t a, int32_t b, int32_t lo, int32_t hi, int& yMin, int& yMax) {
+    if (b == 0) {
+        if (a < lo || a > hi) {
+            yMax = yMin - 1;
+        }
+        return;
+    }
+    if (b < 0) {
+        int32_t t = lo;
+        lo = -hi;
+        hi = -t;
+        a = -a;
+        b = -b;
+    }
+    int32_t first = ceilDiv(lo - a, b);
+    int32_t last = floorDiv(hi - a, b);
+    yMin = first > yMin ? first : yMin;
+    yMax = last < yMax ? last : yMax;
+}
+
+uint32_t fixedSqrt(uint32_t n) {
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > n) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (n >= root + bit) {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+// A thick line from (x0, y0) along a unit direction. Positions are 1/16 LED
+// (Q4) relative to the dial centre, the direction is Q15.
+struct Segment {
+    int32_t x0, y0;
+    int32_t ux, uy;
+    int32_t length;      // Q4
+    int32_t halfWidth;   // Q4
+    RGB color;
+};
+
+// Dial around display column CLOCK_CENTER_X, rows measured from the middle
+const int CLOCK_CENTER_X = WIDTH / 2;
+const int32_t CLOCK_RADIUS = 88;
+const size_t CLOCK_SEGMENTS = 12 + 3;
+
+static Segment radialSegment(uint16_t angle, int32_t from, int32_t length, int32_t halfWidth, RGB color) {
+    // Clockwise from 12 o'clock with rows growing downwards
+    int32_t ux = fixedSin(angle);
+    int32_t uy = -fixedCos(angle);
+    return {(from * 16 * ux) >> 15, (from * 16 * uy) >> 15, ux, uy, length * 16, halfWidth, color};
+}
+
+// Rows of the column at x (Q4) covered by the segment, as [yMin, yMax]
+static void segmentRows(const Segment& s, int32_t x, int& yMin, int& yMax) {
+    yMin = 0;
+    yMax = HEIGHT - 1;
+    int32_t relX = x - s.x0;
+    int32_t relY0 = 8 - HEIGHT * 8 - s.y0;   // centre of row 0 relative to the segment start
+    // Across the line: |relX * uy - relY * ux| <= halfWidth
+    limitRows(relX * s.uy - relY0 * s.ux, -16 * s.ux, -s.halfWidth * 32768, s.halfWidth * 32768, yMin, yMax);
+    // Along it: 0 <= relX * ux + relY * uy <= length
+    limitRows(relX * s.ux + relY0 * s.uy, 16 * s.uy, 0, s.length * 32768, yMin, yMax);
+}
+
+class AnalogClockEffect : public Effect {
+public:
+    AnalogClockEffect() {
+        for (int i = 0; i < 12; i++) {
+            bool quarter = i % 3 == 0;
+            segments[i] = radialSegment(i * 65536 / 12, CLOCK_RADIUS - 15, quarter ? 11 : 8, quarter ? 24 : 14,
+                                        {255, 255, 255});
+        }
+        prepare({0, 0, 0});
+    }
+    const char* name() const override { return "analog clock"; }
+    void prepare(const EffectTime& time) override {
+        uint32_t ms = time.dayMs % (12 * 3600000UL);
+        uint16_t hour = (uint16_t)(((uint64_t)ms << 16) / (12 * 3600000UL));
+        uint16_t minute = (uint16_t)(((uint64_t)(ms % 3600000UL) << 16) / 3600000UL);
+        uint16_t second = (uint16_t)(((ms % 60000UL) / 1000) * 65536 / 60);   // ticks once a second
+        segments[12] = radialSegment(hour, -6, 50, 40, {255, 255, 255});
+        segments[13] = radialSegment(minute, -6, 76, 24, {255, 255, 255});
+        segments[14] = radialSegment(second, -14, 96, 10, {255, 40, 20});
+    }
+    void column(uint16_t angle, const EffectTime&, RGB* out) override {
+        memset(out, 0, HEIGHT * sizeof(RGB));
+        int32_t x = columnOffsetQ4(angle, columnAngle(CLOCK_CENTER_X));
+        const int32_t outer = CLOCK_RADIUS * 16;
+        if (x > outer || x < -outer) {
+            return;
+        }
+
+        // Rim: two arcs where the ring crosses this column
+        const int32_t inner = (CLOCK_RADIUS - 3) * 16;
+        int32_t top = fixedSqrt(outer * outer - x * x);
+        int32_t bottom = x * x < inner * inner ? fixedSqrt(inner * inner - x * x) : 0;
+        const int32_t center = HEIGHT * 8 - 8;   // row 0 is 8/16 below the top edge
+        RGB rim = {90, 90, 110};
+        fillRows(out, ceilDiv(center - top, 16), floorDiv(center - bottom, 16), rim);
+        fillRows(out, ceilDiv(center + bottom, 16), floorDiv(center + top, 16), rim);
+
+        for (size_t i = 0; i < CLOCK_SEGMENTS; i++) {
+            int yMin, yMax;
+            segmentRows(segments[i], x, yMin, yMax);
+            fillRows(out, yMin, yMax, segments[i].color);
+        }
+    }
+
+private:
+    Segment segments[CLOCK_SEGMENTS];   // 12 ticks, then hour, minute and second hands
+};
+
+
+// HH:MM:SS in the compiled-in font, centred on the cylinder; the colons blink
+const uint8_t DIGITAL_SCALE = 5;
+const size_t MAX_CLOCK_COLUMNS = 64;
+
+class DigitalClockEffect : public Effect {
+public:
+    DigitalClockEffect() : width(0), shown(0xffffffff) {}
+    const char* name() const override { return "digital clock"; }
+    void prepare(const EffectTime& time) override {
+        // Only rebuilt when the text changes, twice a second
+        uint32_t halfSeconds = (time.dayMs / 500) % (24 * 3600 * 2);
+        if (halfSeconds == shown) {
+            return;
+        }
+        shown = halfSeconds;
+        uint32_t s = halfSeconds / 2;
+        char text[9];
+        text[0] = '0' + s / 36000;
+        text[1] = '0' + s / 3600 % 10;
+        text[2] = ':';
+        text[3] = '0' + s / 600 % 6;
+        text[4] = '0' + s / 60 % 10;
+        text[5] = ':';
+        text[6] = '0' + s % 60 / 10;
+        text[7] = '0' + s % 10;
+        text[8] = '\0';
+
+        const Font& font = font5x7;
+        width = 0;
+        for (size_t i = 0; i < 8; i++) {
+            Glyph glyph;
+            if (!fontGlyph(font, (uint8_t)text[i], glyph)) {
+                continue;
+            }
+            bool blank = text[i] == ':' && halfSeconds % 2 == 1;
+            for (uint8_t c = 0; c < glyph.width + font.spacing && width < MAX_CLOCK_COLUMNS; c++) {
+                uint32_t bits = 0;
+                for (uint8_t k = 0; c < glyph.width && k < font.bytesPerColumn; k++) {
+                    bits |= (uint32_t)glyph.columns[c * font.bytesPerColumn + k] << (8 * k);
+                }
+                columns[width++] = blank ? 0 : bits;
+            }
+        }
+        top = (HEIGHT - font.height * DIGITAL_SCALE) / 2;
+        rows = font.height;
+    }
+    void column(uint16_t angle, const EffectTime&, RGB* out) override {
+        memset(out, 0, HEIGHT * sizeof(RGB));
+        int32_t x = (columnOffsetQ4(angle, columnAngle(WIDTH / 2)) >> 4) + width * DIGITAL_SCALE / 2;
+        if (x < 0 || x >= width * DIGITAL_SCALE) {
+            return;
+        }
+        uint32_t bits = columns[x / DIGITAL_SCALE];
+        RGB color = {40, 220, 255};
+        for (uint8_t r = 0; r < rows && bits != 0; r++, bits >>= 1) {
+            if (bits & 1) {
+                fillRows(out, top + r * DIGITAL_SCALE, top + (r + 1) * DIGITAL_SCALE - 1, color);
+            }
+        }
+    }
+
+private:
+    uint32_t columns[MAX_CLOCK_COLUMNS];
+    uint16_t width;      // font columns
+    uint32_t shown;      // half second the columns were built for
+    int top;
+    uint8_t rows;
+};
+
+
+static GradientEffect gradientEffect;
+static PlasmaEffect plasmaEffect;
+static AnalogClockEffect analogClockEffect;
+static DigitalClockEffect digitalClockEffect;
+
+Effect* const builtinEffects[] = {&gradientEffect, &plasmaEffect, &analogClockEffect, &digitalClockEffect};
+const size_t BUILTIN_EFFECT_COUNT = sizeof(builtinEffects) / sizeof(builtinEffects[0]);
@@ -0,0 +1,54 @@
+#ifndef EFFECTS_H
+#define EFFECTS_H
+#include <stdint.h>
+#include <stddef.h>
+#include "display_types.h"
+
+// Procedural content: an effect computes any display column from where it
+// is on the cylinder and when, so gradients, patterns and clocks need no
+// stored frames and no frame buffer. Everything is integer fixed point.
+//
+// Angles are 16 bit, 65536 per revolution, so patterns whose frequency
+// around the cylinder is a whole number join seamlessly.
+
+struct EffectTime {
+    uint32_t revolution;   // revolutions shown since the effect started
+    uint32_t ms;           // milliseconds since the effect started
+    uint32_t dayMs;        // wall clock, milliseconds since midnight
+};
+
+// Time the renderer has for one column, ROWINTERVAL in display.cpp
+const uint32_t COLUMN_BUDGET_NS = 8842;
+
+class Effect {
+public:
+    virtual ~Effect() {}
+    virtual const char* name() const = 0;
+    // Work shared by every column of a revolution, called once before them
+    virtual void prepare(const EffectTime& time) { (void)time; }
+    // HEIGHT LEDs of the column at `angle`, row 0 on top
+    virtual void column(uint16_t angle, const EffectTime& time, RGB* out) = 0;
+};
+
+// Angle of display column x
+inline uint16_t columnAngle(int x) {
+    return (uint16_t)(((uint32_t)x << 16) / WIDTH);
+}
+
+// sin of a 16 bit angle, Q15 (-32767 .. 32767)
+int16_t fixedSin(uint16_t angle);
+inline int16_t fixedCos(uint16_t angle) {
+    return fixedSin(angle + 0x4000);
+}
+
+// Integer square root, rounded down
+uint32_t fixedSqrt(uint32_t n);
+
+// Fully saturated colour for a 16 bit hue
+RGB hueColor(uint16_t hue);
+
+// The built-in effects: gradient, plasma, analog clock, digital clock
+extern Effect* const builtinEffects[];
+extern const size_t BUILTIN_EFFECT_COUNT;
+
+#endif // EFFECTS_H
@@ -0,0 +1,79 @@
+#ifndef FONT_H
+#define FONT_H
+#include <stdint.h>
+#include <stddef.h>
+
+// Bitmap fonts stored column-major, which is the order the display scans in.
+// Each glyph column takes bytesPerColumn bytes, bit 0 of the first byte is the
+// top row. Tables are const so they stay in flash.
+// 4 bit anti-aliased fonts pack two rows per byte, low nibble first.
+// Generated fonts come from tools/font_compiler, see fonts/fonts.txt.
+
+// Column adjustment between two glyphs, sorted by (left, right)
+struct KernPair {
+    uint16_t left;
+    uint16_t right;
+    int8_t adjust;            // columns, negative moves the right glyph closer
+};
+
+struct Font {
+    uint8_t height;           // rows, ascent + descent
+    uint8_t bytesPerColumn;   // (height * bitsPerPixel + 7) / 8
+    uint8_t spacing;          // blank columns after every glyph
+    uint32_t firstCodepoint;
+    uint32_t glyphCount;
+    const uint8_t* widths;    // columns per glyph
+    const uint16_t* offsets;  // first column of each glyph in bitmap
+    const uint8_t* bitmap;
+    uint8_t bitsPerPixel;     // 1, or 4 for anti-aliased coverage
+    uint8_t ascent;           // rows above the baseline
+    uint8_t descent;          // rows below the baseline
+    uint8_t lineGap;          // blank rows between lines
+    const KernPair* kerning;
+    uint16_t kerningCount;
+};
+
+struct Glyph {
+    uint8_t width;
+    const uint8_t* columns;   // width * bytesPerColumn bytes
+};
+
+// false if the font has no glyph for the codepoint
+inline bool fontGlyph(const Font& font, uint32_t codepoint, Glyph& glyph) {
+    if (codepoint < font.firstCodepoint || codepoint - font.firstCodepoint >= font.glyphCount) {
+        return false;
+    }
+    uint32_t index = codepoint - font.firstCodepoint;
+    glyph.width = font.widths[index];
+    glyph.columns = font.bitmap + font.offsets[index] * font.bytesPerColumn;
+    return true;
+}
+
+// Kerning adjustment for a pair of codepoints, 0 if the font has none
+inline int fontKerning(const Font& font, uint32_t left, uint32_t right) {
+    size_t lo = 0;
+    size_t hi = font.kerningCount;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const KernPair& pair = font.kerning[mid];
+        if (pair.left == left && pair.right == right) {
+            return pair.adjust;
+        }
+        if (pair.left < left || (pair.left == left && pair.right < right)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0;
+}
+
+// Rows from one baseline to the next
+inline int fontLineHeight(const Font& font) {
+    return font.height + font.lineGap;
+}
+
+// Compiled-in 5x7 ASCII font, 0x20..0x7e, generated from fonts/5x7.bdf
+extern const Font font5x7;
+
+#endif // FONT_H
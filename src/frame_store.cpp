@@ -0,0 +1,649 @@
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <Preferences.h>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include "frame_store.h"
+#include "trace.h"
+
+// One shared copy of a PSRAM frame
+typedef struct {
+    uint8_t* data;
+    size_t size;      // payload bytes that were hashed
+    size_t blockSize; // bytes allocated
+    uint16_t refs;
+} SharedFrame;
+
+// Several frames can share a hash in theory, equal_range + memcmp tells them apart
+std::multimap<uint64_t, SharedFrame> frameTable;
+std::mutex frameTableMutex;
+
+// Blob bookkeeping for SPIFFS, rebuilt from the item files on boot
+typedef struct {
+    uint32_t size;
+    uint16_t refs;
+    bool verified;    // CRC checked since boot, later loads skip it
+} BlobInfo;
+std::map<uint64_t, BlobInfo> blobTable;
+
+// Resumable uploads in progress, rebuilt from /part on first use after boot
+typedef struct {
+    uint32_t committed;  // bytes safely on flash
+    uint64_t hash;       // running contentHash() of those bytes
+    uint32_t crc32;      // running CRC32 of those bytes
+} PartialUpload;
+std::map<String, PartialUpload> partialUploads;
+
+// Content generations, see frame_store.h. The active number is kept in nvs.
+// Loaded by storageBegin(); the display reads the active one from the other core.
+std::atomic<uint32_t> currentGeneration(0);
+uint32_t stagedGeneration = 0;
+uint32_t newestGeneration = 0;     // highest number on flash, new generations count up from it
+size_t stagedCount = 0;            // items in the staging generation
+std::vector<uint32_t> retiredGenerations;   // items still on flash, removed by reclaimGenerations()
+const char* GENERATION_NAMESPACE = "pov";
+const char* GENERATION_KEY = "gen";
+
+const char* itemDirectories[] = {"/img", "/char", "/vec"};
+const char* blobDirectory = "/blob";
+const char* partDirectory = "/part";
+const size_t UPLOAD_ID_LEN = 16;
+const size_t BLOB_PATH_LEN = 24;  // "/blob/" + 16 hex digits + '\0'
+const size_t WRITE_CHUNK = 4096;  // CRC is folded in per chunk as it goes to flash
+
+
+uint8_t* acquireFrame(const uint8_t* data, size_t len, size_t blockSize) {
+    if (len > blockSize) {
+        return nullptr;
+    }
+    uint64_t hash = contentHash(data, len);
+    std::lock_guard<std::mutex> lock(frameTableMutex);
+
+    auto range = frameTable.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second.size == len && memcmp(it->second.data, data, len) == 0) {
+            it->second.refs++;
+            return it->second.data;
+        }
+    }
+
+    uint8_t* block = (uint8_t*)ps_malloc(blockSize);
+    if (block == nullptr) {
+        return nullptr;
+    }
+    memcpy(block, data, len);
+    memset(block + len, 0, blockSize - len);
+    frameTable.insert({hash, {block, len, blockSize, 1}});
+    return block;
+}
+
+void releaseFrame(uint8_t* block) {
+    if (block == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(frameTableMutex);
+    for (auto it = frameTable.begin(); it != frameTable.end(); ++it) {
+        if (it->second.data == block) {
+            if (--it->second.refs == 0) {
+                free(block);
+                frameTable.erase(it);
+            }
+            return;
+        }
+    }
+}
+
+uint16_t frameRefs(const uint8_t* block) {
+    std::lock_guard<std::mutex> lock(frameTableMutex);
+    for (auto it = frameTable.begin(); it != frameTable.end(); ++it) {
+        if (it->second.data == block) {
+            return it->second.refs;
+        }
+    }
+    return 0;
+}
+
+void frameTableUsage(size_t& frames, size_t& bytes) {
+    std::lock_guard<std::mutex> lock(frameTableMutex);
+    frames = frameTable.size();
+    bytes = 0;
+    for (auto it = frameTable.begin(); it != frameTable.end(); ++it) {
+        bytes += it->second.blockSize;
+    }
+}
+
+
+void blobPath(uint64_t hash, char* out) {
+    snprintf(out, BLOB_PATH_LEN, "%s/%016llx", blobDirectory, (unsigned long long)hash);
+}
+
+bool readRecord(File& file, ItemRecord& record) {
+    size_t n = file.read((uint8_t*)&record, sizeof(record));
+    if (n >= sizeof(record.magic) && record.magic == OLD_ITEM_MAGIC) {
+        Serial.printf("%s has a record without CRC, store it again\n", file.path());
+        return false;
+    }
+    return n == sizeof(record) && record.magic == ITEM_MAGIC;
+}
+
+bool readRecord(const char* itemPath, ItemRecord& record) {
+    File file = SPIFFS.open(itemPath, FILE_READ);
+    if (!file) {
+        return false;
+    }
+    bool ok = readRecord(file, record);
+    file.close();
+    return ok;
+}
+
+void releaseBlob(uint64_t hash) {
+    auto it = blobTable.find(hash);
+    if (it == blobTable.end()) {
+        return;
+    }
+    if (it->second.refs > 0) {
+        it->second.refs--;
+    }
+    if (it->second.refs == 0) {
+        char path[BLOB_PATH_LEN];
+        blobPath(hash, path);
+        SPIFFS.remove(path);
+        blobTable.erase(it);
+    }
+}
+
+void loadGeneration() {
+    Preferences prefs;
+    if (prefs.begin(GENERATION_NAMESPACE, true)) {
+        currentGeneration = prefs.getUInt(GENERATION_KEY, 0);
+        prefs.end();
+    }
+    stagedGeneration = currentGeneration;
+    newestGeneration = std::max(newestGeneration, currentGeneration.load());
+}
+
+// Generation of an item path, false for anything outside the item directories (blobs, uploads)
+bool itemGeneration(const char* path, uint32_t& generation) {
+    const char* rest = path;
+    generation = 0;
+    if (path[0] == '/' && path[1] == 'g' && isdigit((unsigned char)path[2])) {
+        char* end;
+        generation = strtoul(path + 2, &end, 10);
+        rest = end;
+    }
+    for (const char* directory : itemDirectories) {
+        size_t n = strlen(directory);
+        if (strncmp(rest, directory, n) == 0 && rest[n] == '/') {
+            return true;
+        }
+    }
+    return false;
+}
+
+void retireGeneration(uint32_t generation) {
+    if (std::find(retiredGenerations.begin(), retiredGenerations.end(), generation) == retiredGenerations.end()) {
+        retiredGenerations.push_back(generation);
+    }
+}
+
+void frameStoreBegin() {
+    blobTable.clear();
+    loadGeneration();
+    retiredGenerations.clear();
+
+    // Items of every generation hold blob references until they are reclaimed
+    std::map<uint32_t, size_t> generationItems;
+    File root = SPIFFS.open("/");
+    File file = root.openNextFile();
+    while (file) {
+        uint32_t generation;
+        ItemRecord record;
+        if (itemGeneration(file.path(), generation) && readRecord(file, record)) {
+            BlobInfo& blob = blobTable[record.hash];
+            blob.size = record.size;
+            blob.refs++;
+            newestGeneration = std::max(newestGeneration, generation);
+            generationItems[generation]++;
+        }
+        file = root.openNextFile();
+    }
+
+    // The newest generation past the active one was being staged and stays so, uploads
+    // carry on with it after a reboot. Anything else but the active generation is dropped.
+    if (newestGeneration > currentGeneration && generationItems.count(newestGeneration) > 0) {
+        stagedGeneration = newestGeneration;
+        stagedCount = generationItems[newestGeneration];
+    }
+    for (const auto& items : generationItems) {
+        if (items.first != currentGeneration && items.first != stagedGeneration) {
+            retireGeneration(items.first);
+        }
+    }
+
+    // Drop blobs whose item file never got written (power loss between the two writes)
+    File dir = SPIFFS.open(blobDirectory);
+    if (dir && dir.isDirectory()) {
+        File file = dir.openNextFile();
+        while (file) {
+            String path = String(file.path());
+            file.close();
+            uint64_t hash = strtoull(path.substring(path.lastIndexOf('/') + 1).c_str(), nullptr, 16);
+            file = dir.openNextFile();
+            if (blobTable.find(hash) == blobTable.end()) {
+                SPIFFS.remove(path);
+            }
+        }
+    }
+}
+
+std::mutex storageBeginMutex;
+bool storageStarted = false;
+bool storageMounted = false;
+
+bool storageBegin() {
+    std::lock_guard<std::mutex> lock(storageBeginMutex);
+    if (!storageStarted) {
+        storageStarted = true;
+        storageMounted = SPIFFS.begin(true);
+        if (storageMounted) {
+            frameStoreBegin();
+        }
+    }
+    return storageMounted;
+}
+
+// Point an item at a blob that is already in blobTable and on flash
+bool linkItem(const char* itemPath, const ItemRecord& record) {
+    // Overwriting an item gives up its reference to the old content
+    ItemRecord previous;
+    bool replacing = readRecord(itemPath, previous);
+
+    File file = SPIFFS.open(itemPath, FILE_WRITE);
+    if (!file || file.write((const uint8_t*)&record, sizeof(record)) != sizeof(record)) {
+        Serial.println("Failed to write item record");
+        if (file) {
+            file.close();
+        }
+        if (blobTable[record.hash].refs == 0) {
+            char path[BLOB_PATH_LEN];
+            blobPath(record.hash, path);
+            SPIFFS.remove(path);
+            blobTable.erase(record.hash);
+        }
+        return false;
+    }
+    file.close();
+
+    blobTable[record.hash].refs++;
+    if (replacing) {
+        releaseBlob(previous.hash);
+    }
+    uint32_t generation;
+    if (stagedGeneration != currentGeneration && itemGeneration(itemPath, generation)
+        && generation == stagedGeneration && !replacing) {
+        stagedCount++;
+    }
+    return true;
+}
+
+// A 64 bit hash can collide, so a blob is only shared once its bytes are seen to match
+bool blobMatches(uint64_t hash, const uint8_t* data, size_t len) {
+    char path[BLOB_PATH_LEN];
+    blobPath(hash, path);
+    File blob = SPIFFS.open(path, FILE_READ);
+    if (!blob || blob.size() != len) {
+        return false;
+    }
+    uint8_t buffer[512];
+    size_t compared = 0;
+    size_t n;
+    while (compared < len && (n = blob.read(buffer, sizeof(buffer))) > 0) {
+        if (n > len - compared || memcmp(buffer, data + compared, n) != 0) {
+            break;
+        }
+        compared += n;
+    }
+    blob.close();
+    return compared == len;
+}
+
+bool storeItem(const char* itemPath, const uint8_t* data, size_t len) {
+    TraceSpan span(TRACE_FLASH_WRITE, len);
+    ItemRecord record = {ITEM_MAGIC, (uint32_t)len, contentHash(data, len), 0, 0};
+    char path[BLOB_PATH_LEN];
+    blobPath(record.hash, path);
+
+    auto it = blobTable.find(record.hash);
+    if (it != blobTable.end() && (it->second.size != record.size || !blobMatches(record.hash, data, len))) {
+        Serial.println("Content hash collision, item not stored");
+        return false;
+    }
+    if (it == blobTable.end()) {
+        // First copy of this content, the only case that costs a payload write
+        File blob = SPIFFS.open(path, FILE_WRITE);
+        if (!blob) {
+            Serial.println("Failed to open blob for writing");
+            return false;
+        }
+        size_t written = 0;
+        while (written < len) {
+            size_t n = len - written < WRITE_CHUNK ? len - written : WRITE_CHUNK;
+            if (blob.write(data + written, n) != n) {
+                break;
+            }
+            record.crc32 = crc32Update(record.crc32, data + written, n);
+            written += n;
+        }
+        blob.close();
+        if (written != len) {
+            Serial.println("Blob write failed");
+            SPIFFS.remove(path);
+            return false;
+        }
+        blobTable[record.hash] = {record.size, 0, false};
+    } else {
+        // Nothing written, the record still needs the checksum of the shared payload
+        record.crc32 = crc32Update(0, data, len);
+    }
+
+    return linkItem(itemPath, record);
+}
+
+File openItem(const char* itemPath, ItemRecord* recordOut) {
+    ItemRecord record;
+    if (!readRecord(itemPath, record)) {
+        return File();
+    }
+    if (recordOut != nullptr) {
+        *recordOut = record;
+    }
+    char path[BLOB_PATH_LEN];
+    blobPath(record.hash, path);
+    return SPIFFS.open(path, FILE_READ);
+}
+
+size_t loadItem(const char* itemPath, uint8_t* dst, size_t maxLen) {
+    TraceSpan span(TRACE_FLASH_READ, maxLen);
+    // Lazy verification: the first load of a blob after boot streams it through the CRC
+    // before dst is touched, so a corrupt payload never lands in the caller's live buffer
+    if (!verifyItem(itemPath)) {
+        return 0;
+    }
+    ItemRecord record;
+    File blob = openItem(itemPath, &record);
+    if (!blob) {
+        return 0;
+    }
+    size_t bytesRead = blob.read(dst, record.size < maxLen ? record.size : maxLen);
+    blob.close();
+    return bytesRead;
+}
+
+bool verifyItem(const char* itemPath) {
+    ItemRecord record;
+    File blob = openItem(itemPath, &record);
+    if (!blob) {
+        return false;
+    }
+    auto it = blobTable.find(record.hash);
+    if (it != blobTable.end() && it->second.verified) {
+        blob.close();
+        return true;
+    }
+
+    uint8_t buffer[512];
+    uint32_t crc = 0;
+    size_t total = 0;
+    size_t n;
+    while ((n = blob.read(buffer, sizeof(buffer))) > 0) {
+        crc = crc32Update(crc, buffer, n);
+        total += n;
+    }
+    blob.close();
+
+    bool ok = total == record.size && crc == record.crc32;
+    if (!ok) {
+        Serial.printf("CRC mismatch in %s\n", itemPath);
+    } else if (it != blobTable.end()) {
+        it->second.verified = true;
+    }
+    return ok;
+}
+
+bool removeItem(const char* itemPath) {
+    ItemRecord record;
+    bool known = readRecord(itemPath, record);
+    if (!SPIFFS.remove(itemPath)) {
+        return false;
+    }
+    if (known) {
+        releaseBlob(record.hash);
+    }
+    return true;
+}
+
+void forgetAllItems() {
+    blobTable.clear();
+}
+
+
+uint32_t activeGeneration() {
+    return currentGeneration;
+}
+
+uint32_t stagingGeneration() {
+    return stagedGeneration;
+}
+
+String generationPath(uint32_t generation, const char* directory) {
+    if (generation == 0) {
+        return String(directory);
+    }
+    return "/g" + String(generation) + directory;
+}
+
+void beginGeneration() {
+    if (stagedGeneration != currentGeneration) {
+        return;   // a client that comes back carries on with what it staged
+    }
+    stagedGeneration = ++newestGeneration;
+    stagedCount = 0;
+}
+
+void discardGeneration() {
+    if (stagedGeneration != currentGeneration) {
+        retireGeneration(stagedGeneration);
+    }
+    stagedGeneration = currentGeneration;
+    stagedCount = 0;
+}
+
+size_t stagedItems() {
+    return stagedCount;
+}
+
+bool activateGeneration() {
+    if (stagedGeneration == currentGeneration || stagedCount == 0) {
+        return false;   // an empty generation would blank the display
+    }
+    // The flip itself: one nvs write, after power loss either the old or the new generation is active
+    Preferences prefs;
+    bool stored = prefs.begin(GENERATION_NAMESPACE, false)
+                  && prefs.putUInt(GENERATION_KEY, stagedGeneration) == sizeof(uint32_t);
+    prefs.end();
+    if (!stored) {
+        Serial.println("Failed to store the active generation");
+        return false;
+    }
+    retireGeneration(currentGeneration);
+    currentGeneration = stagedGeneration;
+    stagedCount = 0;
+    return true;
+}
+
+size_t reclaimGenerations(size_t maxItems) {
+    size_t removed = 0;
+    while (!retiredGenerations.empty() && removed < maxItems) {
+        uint32_t generation = retiredGenerations.back();
+
+        // Collected first, removing files while their directory is being listed skips entries
+        std::vector<String> paths;
+        for (const char* directory : itemDirectories) {
+            File dir = SPIFFS.open(generationPath(generation, directory));
+            if (!dir || !dir.isDirectory()) {
+                continue;
+            }
+            File file = dir.openNextFile();
+            while (file && removed + paths.size() < maxItems) {
+                paths.push_back(String(file.path()));
+                file = dir.openNextFile();
+            }
+        }
+        if (paths.empty()) {
+            retiredGenerations.pop_back();   // nothing of it is left
+            continue;
+        }
+        for (const String& path : paths) {
+            removeItem(path.c_str());   // blobs no other generation uses go with their last item
+            removed++;
+        }
+    }
+    return removed;
+}
+
+
+bool validUploadId(const char* id) {
+    size_t len = strlen(id);
+    if (len == 0 || len > UPLOAD_ID_LEN) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (!isalnum((unsigned char)id[i]) && id[i] != '-' && id[i] != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+String partPath(const char* id) {
+    return String(partDirectory) + "/" + id;
+}
+
+// State of an upload, nullptr if nothing of it is on flash
+PartialUpload* findUpload(const char* id) {
+    if (!validUploadId(id)) {
+        return nullptr;
+    }
+    auto it = partialUploads.find(String(id));
+    if (it != partialUploads.end()) {
+        return &it->second;
+    }
+
+    // Not seen since boot: rebuild the running checksums from what made it to flash
+    File file = SPIFFS.open(partPath(id), FILE_READ);
+    if (!file) {
+        return nullptr;
+    }
+    PartialUpload state = {0, CONTENT_HASH_SEED, 0};
+    uint8_t buffer[512];
+    size_t n;
+    while ((n = file.read(buffer, sizeof(buffer))) > 0) {
+        state.hash = contentHash(buffer, n, state.hash);
+        state.crc32 = crc32Update(state.crc32, buffer, n);
+        state.committed += n;
+    }
+    file.close();
+    return &(partialUploads[String(id)] = state);
+}
+
+size_t uploadCommittedLength(const char* id) {
+    PartialUpload* state = findUpload(id);
+    return state != nullptr ? state->committed : 0;
+}
+
+bool appendUpload(const char* id, size_t offset, const uint8_t* data, size_t len) {
+    TraceSpan span(TRACE_FLASH_WRITE, len);
+    if (!validUploadId(id)) {
+        return false;
+    }
+    PartialUpload* state = findUpload(id);
+    if (offset != (state != nullptr ? state->committed : 0)) {
+        return false;
+    }
+    // Offset 0 (re)starts the upload from scratch
+    if (offset == 0) {
+        state = &(partialUploads[String(id)] = {0, CONTENT_HASH_SEED, 0});
+    }
+
+    File file = SPIFFS.open(partPath(id), offset == 0 ? FILE_WRITE : FILE_APPEND);
+    if (!file) {
+        Serial.println("Failed to open partial upload");
+        return false;
+    }
+    size_t written = file.write(data, len);
+    file.close();
+    if (written != len) {
+        // Whatever did reach flash counts, the next status query re-reads it
+        partialUploads.erase(String(id));
+        return false;
+    }
+
+    state->hash = contentHash(data, len, state->hash);
+    state->crc32 = crc32Update(state->crc32, data, len);
+    state->committed += len;
+    return true;
+}
+
+size_t readUpload(const char* id, uint8_t* dst, size_t maxLen) {
+    if (findUpload(id) == nullptr) {
+        return 0;
+    }
+    File file = SPIFFS.open(partPath(id), FILE_READ);
+    if (!file) {
+        return 0;
+    }
+    size_t n = file.read(dst, maxLen);
+    file.close();
+    return n;
+}
+
+bool commitUpload(const char* id, const char* itemPath) {
+    TraceSpan span(TRACE_FLASH_WRITE, 0);
+    PartialUpload* state = findUpload(id);
+    if (state == nullptr) {
+        return false;
+    }
+    ItemRecord record = {ITEM_MAGIC, state->committed, state->hash, state->crc32, 0};
+    String part = partPath(id);
+
+    auto it = blobTable.find(record.hash);
+    if (it != blobTable.end() && it->second.size != record.size) {
+        Serial.println("Content hash collision, item not stored");
+        return false;
+    }
+    if (it == blobTable.end()) {
+        // The partial file becomes the blob as is, no copy
+        char path[BLOB_PATH_LEN];
+        blobPath(record.hash, path);
+        if (!SPIFFS.rename(part.c_str(), path)) {
+            Serial.println("Failed to move upload into place");
+            return false;
+        }
+        blobTable[record.hash] = {record.size, 0, false};
+    } else {
+        SPIFFS.remove(part);
+    }
+    partialUploads.erase(String(id));
+    return linkItem(itemPath, record);
+}
+
+void abortUpload(const char* id) {
+    if (!validUploadId(id)) {
+        return;
+    }
+    SPIFFS.remove(partPath(id));
+    partialUploads.erase(String(id));
+}
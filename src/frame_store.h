@@ -0,0 +1,76 @@
+#ifndef FRAME_STORE_H
+#define FRAME_STORE_H
+#include <Arduino.h>
+#include <FS.h>
+#include "checksum.h"
+
+// Content addressed storage for frames and images.
+// Identical payloads are stored once and shared by reference count,
+// both for PSRAM video slots and for the SPIFFS files behind /img and /char.
+
+// PSRAM frames: returns a block of blockSize bytes holding data, shared with any
+// earlier frame with the same content. nullptr if PSRAM is exhausted.
+uint8_t* acquireFrame(const uint8_t* data, size_t len, size_t blockSize);
+// Drop one reference, the block is freed with the last one
+void releaseFrame(uint8_t* block);
+// References to a block from acquireFrame, 0 if it is not one
+uint16_t frameRefs(const uint8_t* block);
+// Distinct frames held and the PSRAM they take
+void frameTableUsage(size_t& frames, size_t& bytes);
+
+// SPIFFS items: an item file (e.g. /img/3.txt) only holds an ItemRecord,
+// the payload lives once in /blob/<hash> however many items point at it.
+struct ItemRecord {
+    uint32_t magic;
+    uint32_t size;   // payload bytes
+    uint64_t hash;   // contentHash() of the payload, names the blob
+    uint32_t crc32;  // taken while the payload was written, checked on first load
+    uint32_t reserved;
+};
+const uint32_t ITEM_MAGIC = 0x32564f50;      // "POV2", the record with crc32
+const uint32_t OLD_ITEM_MAGIC = 0x49564f50;  // "POVI", 16 byte records from before, refused
+
+// Mounts SPIFFS, formatting it if it will not mount, and rebuilds the blob
+// references and the generation from flash. Only the first call does the work;
+// later ones, from either core, wait for it and return its result.
+bool storageBegin();
+bool storeItem(const char* itemPath, const uint8_t* data, size_t len);
+bool readRecord(const char* itemPath, ItemRecord& record);  // size and content hash without touching the payload
+File openItem(const char* itemPath, ItemRecord* record = nullptr);  // the item's payload, opened for reading
+size_t loadItem(const char* itemPath, uint8_t* dst, size_t maxLen);  // returns bytes read, 0 on failure or CRC mismatch (dst untouched)
+bool verifyItem(const char* itemPath);  // streams the payload through CRC32 unless already verified since boot
+bool removeItem(const char* itemPath);
+void forgetAllItems();  // after the filesystem has been wiped
+
+// Content generations. The items of generation n live under /g<n>/img,
+// /g<n>/char and /g<n>/vec; generation 0 is the plain /img, /char and /vec.
+// The display lists the active generation while clients upload into a
+// staging one, so nothing goes blank. Video frames sent to /write stay in
+// their PSRAM slots and belong to no generation. The staging generation lasts
+// until it is activated or discarded, across reconnects and reboots, so an
+// interrupted upload carries on where it was. Activation only happens when a
+// client asks for it and stores the new number in the nvs partition, one
+// atomic write; the generations left behind are removed a few items at a time
+// by reclaimGenerations(). Blobs are shared across generations like across
+// items, so unchanged content is never rewritten.
+uint32_t activeGeneration();   // safe to read from either core
+uint32_t stagingGeneration();  // the active one while nothing is staged
+String generationPath(uint32_t generation, const char* directory);  // e.g. "/g3/img"
+inline String activePath(const char* directory) { return generationPath(activeGeneration(), directory); }
+inline String stagingPath(const char* directory) { return generationPath(stagingGeneration(), directory); }
+void beginGeneration();      // a fresh, empty staging generation unless one is staged already
+void discardGeneration();    // drops the staging generation and everything stored into it
+size_t stagedItems();        // items in the staging generation
+bool activateGeneration();   // the staging generation becomes active, false if nothing is staged
+size_t reclaimGenerations(size_t maxItems);  // removes up to maxItems items of dropped generations, returns how many
+
+// Resumable uploads, addressed by a client chosen id (up to 16 of [A-Za-z0-9_-]).
+// Data is appended to /part/<id>, which the renderer never looks at, and only
+// becomes an item on commitUpload().
+size_t uploadCommittedLength(const char* id);  // bytes already on flash, 0 if unknown
+bool appendUpload(const char* id, size_t offset, const uint8_t* data, size_t len);  // offset must equal the committed length, 0 restarts
+size_t readUpload(const char* id, uint8_t* dst, size_t maxLen);  // the bytes so far, to check them before commitUpload()
+bool commitUpload(const char* id, const char* itemPath);
+void abortUpload(const char* id);
+
+#endif // FRAME_STORE_H
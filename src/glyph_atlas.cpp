@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include <string.h>
+#include "glyph_atlas.h"
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#endif
+
+static void* atlasAlloc(size_t size) {
+#ifdef ESP_PLATFORM
+    void* p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    return p != nullptr ? p : malloc(size);
+#else
+    return malloc(size);
+#endif
+}
+
+GlyphAtlas::GlyphAtlas()
+    : words(nullptr), keys(nullptr), lastUse(nullptr), capacity(0), useClock(0), hitCount(0), missCount(0) {}
+
+GlyphAtlas::~GlyphAtlas() {
+    free(words);
+    free(keys);
+    free(lastUse);
+}
+
+bool GlyphAtlas::begin(size_t capacity) {
+    free(words);
+    free(keys);
+    free(lastUse);
+    words = (uint16_t*)atlasAlloc(capacity * WIRE_WORDS * sizeof(uint16_t));
+    // The keys are scanned on every column, keep them in internal RAM
+    keys = (Key*)malloc(capacity * sizeof(Key));
+    lastUse = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    if (words == nullptr || keys == nullptr || lastUse == nullptr) {
+        free(words);
+        free(keys);
+        free(lastUse);
+        words = nullptr;
+        keys = nullptr;
+        lastUse = nullptr;
+        this->capacity = 0;
+        return false;
+    }
+    this->capacity = capacity;
+    clear();
+    return true;
+}
+
+void GlyphAtlas::clear() {
+    if (lastUse != nullptr) {
+        memset(lastUse, 0, capacity * sizeof(uint32_t));
+    }
+    useClock = 0;
+}
+
+bool GlyphAtlas::sameKey(const Key& a, const Key& b) {
+    return a.bits == b.bits && a.color.r == b.color.r && a.color.g == b.color.g && a.color.b == b.color.b
+        && a.height == b.height && a.scale == b.scale && a.top == b.top;
+}
+
+const uint16_t* GlyphAtlas::column(const TextStrip& strip, int x) {
+    if (capacity == 0) {
+        return nullptr;
+    }
+    Key key = {stripColumnBits(strip, x), strip.color, strip.height, strip.scale, strip.top};
+
+    if (++useClock == 0) {
+        clear();  // wrapped after 4 billion columns, forget the order rather than keep it wrong
+        useClock = 1;
+    }
+    size_t victim = 0;
+    for (size_t i = 0; i < capacity; i++) {
+        if (lastUse[i] != 0 && sameKey(keys[i], key)) {
+            lastUse[i] = useClock;
+            hitCount++;
+            return words + i * WIRE_WORDS;
+        }
+        if (lastUse[i] < lastUse[victim]) {
+            victim = i;
+        }
+    }
+
+    missCount++;
+    RGB expanded[HEIGHT];
+    expandColumnBits(strip, key.bits, expanded);
+    uint16_t* slot = words + victim * WIRE_WORDS;
+    packColumn(expanded, slot);
+    keys[victim] = key;
+    lastUse[victim] = useClock;
+    return slot;
+}
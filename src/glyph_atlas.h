@@ -0,0 +1,46 @@
+#ifndef GLYPH_ATLAS_H
+#define GLYPH_ATLAS_H
+#include <stdint.h>
+#include <stddef.h>
+#include "column_pack.h"
+#include "text_render.h"
+
+// Cache of text columns already packed into wire order. Text only ever shows
+// a handful of distinct glyph columns, so each one is expanded and packed once
+// per colour/scale/position and afterwards a display column is a pointer into
+// the cache, or several ORed together where lines share a column.
+// Entries live in PSRAM, least recently used goes first.
+class GlyphAtlas {
+public:
+    GlyphAtlas();
+    ~GlyphAtlas();
+    bool begin(size_t capacity);     // allocates capacity packed columns
+    // Wire words for display column x of the strip, nullptr if the atlas has no memory
+    const uint16_t* column(const TextStrip& strip, int x);
+    void clear();
+    uint32_t hits() const { return hitCount; }
+    uint32_t misses() const { return missCount; }
+
+private:
+    // Packed words bake in the bitmask, colour and position
+    struct Key {
+        uint32_t bits;
+        RGB color;
+        uint8_t height;
+        uint8_t scale;
+        uint8_t top;
+    };
+    static bool sameKey(const Key& a, const Key& b);
+
+    uint16_t* words;      // capacity * WIRE_WORDS, in PSRAM when there is some
+    Key* keys;
+    uint32_t* lastUse;    // 0 = free slot
+    size_t capacity;
+    uint32_t useClock;
+    uint32_t hitCount;
+    uint32_t missCount;
+};
+
+const size_t GLYPH_ATLAS_ENTRIES = 64;   // ~70KB of PSRAM
+
+#endif // GLYPH_ATLAS_H
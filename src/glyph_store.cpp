@@ -0,0 +1,176 @@
+#include <string.h>
+#include "glyph_store.h"
+
+static uint16_t get16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+size_t encodeGlyphRuns(const uint8_t* pixels, size_t count, uint8_t* out, size_t outSize) {
+    size_t nibbles = 0;
+    uint8_t color = 0;
+    size_t i = 0;
+    while (i < count) {
+        size_t run = 0;
+        while (i + run < count && pixels[i + run] == color) {
+            run++;
+        }
+        i += run;
+        // 15 means "15 more of the same colour", anything less ends the run
+        while (true) {
+            uint8_t nibble = run >= 15 ? 15 : (uint8_t)run;
+            if (nibbles / 2 >= outSize) {
+                return 0;
+            }
+            if (nibbles % 2 == 0) {
+                out[nibbles / 2] = nibble;
+            } else {
+                out[nibbles / 2] |= nibble << 4;
+            }
+            nibbles++;
+            if (nibble < 15) {
+                break;
+            }
+            run -= 15;
+        }
+        color ^= 1;
+    }
+    return (nibbles + 1) / 2;
+}
+
+bool decodeGlyphRecord(const uint8_t* data, size_t len, uint8_t flags, uint8_t width, uint8_t height,
+                       uint32_t* columns) {
+    memset(columns, 0, width * sizeof(uint32_t));
+    size_t count = (size_t)width * height;
+    if (!(flags & GLYPH_RLE)) {
+        if (len < (count + 7) / 8) {
+            return false;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (data[i / 8] & (1 << (i % 8))) {
+                columns[i / height] |= 1UL << (i % height);
+            }
+        }
+        return true;
+    }
+
+    size_t pixel = 0;
+    uint8_t color = 0;
+    for (size_t n = 0; n < len * 2 && pixel < count; n++) {
+        uint8_t nibble = (data[n / 2] >> (4 * (n % 2))) & 0x0f;
+        if (pixel + nibble > count) {
+            return false;
+        }
+        if (color) {
+            for (uint8_t k = 0; k < nibble; k++, pixel++) {
+                columns[pixel / height] |= 1UL << (pixel % height);
+            }
+        } else {
+            pixel += nibble;
+        }
+        if (nibble < 15) {
+            color ^= 1;
+        }
+    }
+    // A trailing blank run may be left implicit
+    return true;
+}
+
+
+GlyphStore::GlyphStore()
+    : source(nullptr), fontHeight(0), fontAscent(0), pagesOffset(0), dataOffset(0), useClock(0), hitCount(0), missCount(0) {
+    memset(cache, 0, sizeof(cache));
+}
+
+bool GlyphStore::begin(GlyphSource& source) {
+    this->source = nullptr;
+    uint8_t header[GLYPH_STORE_HEADER_SIZE];
+    if (!source.read(0, header, sizeof(header)) || get32(header) != GLYPH_STORE_MAGIC
+        || header[4] != GLYPH_STORE_VERSION || header[5] == 0 || header[5] > MAX_STORE_HEIGHT) {
+        return false;
+    }
+    uint8_t index[256 * 2];
+    if (!source.read(GLYPH_STORE_HEADER_SIZE, index, sizeof(index))) {
+        return false;
+    }
+    for (int i = 0; i < 256; i++) {
+        pageIndex[i] = get16(index + 2 * i);
+    }
+    fontHeight = header[5];
+    fontAscent = header[6];
+    pagesOffset = get32(header + 16);
+    dataOffset = get32(header + 20);
+    memset(cache, 0, sizeof(cache));
+    useClock = 0;
+    this->source = &source;
+    return true;
+}
+
+bool GlyphStore::load(uint32_t codepoint, StoreGlyph& entry) {
+    if (codepoint > 0xffff || pageIndex[codepoint >> 8] == NO_GLYPH_PAGE) {
+        return false;
+    }
+    uint8_t raw[4];
+    uint32_t at = pagesOffset + ((uint32_t)pageIndex[codepoint >> 8] * 256 + (codepoint & 0xff)) * 4;
+    if (!source->read(at, raw, sizeof(raw))) {
+        return false;
+    }
+    uint32_t record = get32(raw);
+    if (record == NO_GLYPH_RECORD) {
+        return false;
+    }
+
+    // Header and the largest possible glyph in one flash read
+    uint8_t data[4 + (MAX_STORE_WIDTH * MAX_STORE_HEIGHT + 7) / 8];
+    if (!source->read(dataOffset + record, data, 4)) {
+        return false;
+    }
+    uint8_t width = data[0];
+    uint8_t flags = data[1];
+    uint16_t length = get16(data + 2);
+    if (width > MAX_STORE_WIDTH || length > sizeof(data) - 4
+        || (length > 0 && !source->read(dataOffset + record + 4, data + 4, length))) {
+        return false;
+    }
+    if (!decodeGlyphRecord(data + 4, length, flags, width, fontHeight, entry.columns)) {
+        return false;
+    }
+    entry.codepoint = codepoint;
+    entry.width = width;
+    return true;
+}
+
+const StoreGlyph* GlyphStore::glyph(uint32_t codepoint) {
+    if (source == nullptr) {
+        return nullptr;
+    }
+    if (++useClock == 0) {
+        for (size_t i = 0; i < GLYPH_CACHE_ENTRIES; i++) {
+            cache[i].lastUse = 0;
+        }
+        useClock = 1;
+    }
+    size_t victim = 0;
+    for (size_t i = 0; i < GLYPH_CACHE_ENTRIES; i++) {
+        if (cache[i].lastUse != 0 && cache[i].codepoint == codepoint) {
+            cache[i].lastUse = useClock;
+            hitCount++;
+            return &cache[i];
+        }
+        if (cache[i].lastUse < cache[victim].lastUse) {
+            victim = i;
+        }
+    }
+
+    missCount++;
+    StoreGlyph& entry = cache[victim];
+    entry.lastUse = 0;  // stays free if the load fails
+    if (!load(codepoint, entry)) {
+        return nullptr;
+    }
+    entry.lastUse = useClock;
+    return &entry;
+}
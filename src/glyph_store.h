@@ -0,0 +1,98 @@
+#ifndef GLYPH_STORE_H
+#define GLYPH_STORE_H
+#include <stdint.h>
+#include <stddef.h>
+
+// Large fonts (CJK) that cannot be compiled in live in the "glyphs" flash
+// partition, written by `font_compiler --store` and flashed with
+//   esptool.py write_flash 0x700000 glyphs.bin
+// Only the header and the first index level are held in RAM. A lookup reads
+// one index entry and one compressed glyph record from flash and decodes it
+// into a fixed cache, so memory use does not depend on the font or the text.
+//
+// Layout (little endian):
+//   header   u32 magic, u8 version, u8 height, u8 ascent, u8 descent,
+//            u32 glyph count, u32 page count, u32 pages offset, u32 data offset
+//   level 1  u16[256] page of each codepoint >> 8, 0xffff = no glyphs
+//   level 2  per page u32[256] record offset from the data offset, 0xffffffff = missing
+//   record   u8 width, u8 flags, u16 length, then `length` bytes of column-major
+//            pixels, bit packed or (GLYPH_RLE) as nibble runs
+// Codepoints are limited to the BMP, which covers the CJK unified ideographs.
+
+const uint32_t GLYPH_STORE_MAGIC = 0x594c4750;  // "PGLY"
+const uint8_t GLYPH_STORE_VERSION = 1;
+const size_t GLYPH_STORE_HEADER_SIZE = 24;
+const uint32_t NO_GLYPH_RECORD = 0xffffffff;
+const uint16_t NO_GLYPH_PAGE = 0xffff;
+const uint8_t GLYPH_RLE = 0x01;       // record flag: runs of 4 bit lengths, 15 = run continues
+const uint8_t MAX_STORE_HEIGHT = 32;  // glyph columns are decoded into 32 bit masks
+const uint8_t MAX_STORE_WIDTH = 32;
+const size_t GLYPH_CACHE_ENTRIES = 48;  // ~6.5KB, the whole RAM cost with the 512 byte index
+
+// Where the store is read from: the flash partition, or a file in the host tools
+class GlyphSource {
+public:
+    virtual ~GlyphSource() {}
+    virtual bool read(uint32_t offset, void* dst, size_t len) = 0;
+};
+
+#ifdef ESP_PLATFORM
+#include <esp_partition.h>
+
+class PartitionGlyphSource : public GlyphSource {
+public:
+    PartitionGlyphSource() : partition(nullptr) {}
+    bool begin(const char* label = "glyphs") {
+        partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+        return partition != nullptr;
+    }
+    bool read(uint32_t offset, void* dst, size_t len) override {
+        return partition != nullptr && esp_partition_read(partition, offset, dst, len) == ESP_OK;
+    }
+
+private:
+    const esp_partition_t* partition;
+};
+#endif
+
+struct StoreGlyph {
+    uint32_t codepoint;
+    uint32_t lastUse;     // 0 = free cache slot
+    uint8_t width;
+    uint32_t columns[MAX_STORE_WIDTH];  // bit 0 = top row
+};
+
+class GlyphStore {
+public:
+    GlyphStore();
+    bool begin(GlyphSource& source);
+    bool ready() const { return source != nullptr; }
+    uint8_t height() const { return fontHeight; }
+    uint8_t ascent() const { return fontAscent; }
+    // Decoded glyph, nullptr if the store has none. Valid until a later lookup evicts it.
+    const StoreGlyph* glyph(uint32_t codepoint);
+    uint32_t hits() const { return hitCount; }
+    uint32_t misses() const { return missCount; }
+
+private:
+    bool load(uint32_t codepoint, StoreGlyph& entry);
+
+    GlyphSource* source;
+    uint8_t fontHeight;
+    uint8_t fontAscent;
+    uint32_t pagesOffset;
+    uint32_t dataOffset;
+    uint16_t pageIndex[256];
+    StoreGlyph cache[GLYPH_CACHE_ENTRIES];
+    uint32_t useClock;
+    uint32_t hitCount;
+    uint32_t missCount;
+};
+
+// Bit packing and run length coding of one glyph, shared with the host compiler.
+// Pixels are column-major, `height` per column. decode returns false on a corrupt record.
+size_t encodeGlyphRuns(const uint8_t* pixels, size_t count, uint8_t* out, size_t outSize);
+bool decodeGlyphRecord(const uint8_t* data, size_t len, uint8_t flags, uint8_t width, uint8_t height,
+                       uint32_t* columns);
+
+#endif // GLYPH_STORE_H
@@ -0,0 +1,139 @@
+#include <string.h>
+#include "image_codec.h"
+
+static void put16(uint8_t* p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = v >> 24;
+}
+
+static uint16_t get16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void putHeader(uint8_t* out, ImageEncoding encoding, uint16_t paletteSize, uint32_t payloadLength) {
+    put32(out, IMAGE_MAGIC);
+    out[4] = encoding;
+    out[5] = 0;
+    put16(out + 6, paletteSize);
+    put32(out + 8, payloadLength);
+}
+
+size_t encodeImageRaw(const RGB* frame, uint8_t* out) {
+    putHeader(out, IMAGE_RAW, 0, RAW_IMAGE_SIZE);
+    memcpy(out + IMAGE_HEADER_SIZE, frame, RAW_IMAGE_SIZE);
+    return IMAGE_HEADER_SIZE + RAW_IMAGE_SIZE;
+}
+
+size_t encodeImageIndexed(const uint8_t* indices, const RGB* palette, uint16_t paletteSize,
+                          ImageEncoding encoding, uint8_t* out) {
+    if (paletteSize == 0 || paletteSize > MAX_PALETTE_SIZE || encoding == IMAGE_RAW) {
+        return 0;
+    }
+    uint8_t* p = out + IMAGE_HEADER_SIZE;
+    memcpy(p, palette, paletteSize * sizeof(RGB));
+    p += paletteSize * sizeof(RGB);
+    uint8_t* payload = p;
+
+    if (encoding == IMAGE_PALETTE) {
+        memcpy(p, indices, IMAGE_PIXELS);
+        p += IMAGE_PIXELS;
+    } else {
+        for (size_t x = 0; x < WIDTH; x++) {
+            const uint8_t* column = indices + x * HEIGHT;
+            size_t y = 0;
+            while (y < HEIGHT) {
+                uint8_t run = 1;
+                while (y + run < HEIGHT && run < 255 && column[y + run] == column[y]) {
+                    run++;
+                }
+                *p++ = run;
+                *p++ = column[y];
+                y += run;
+            }
+        }
+    }
+    putHeader(out, encoding, paletteSize, p - payload);
+    return p - out;
+}
+
+bool decodeImage(const uint8_t* data, size_t len, RGB* frame) {
+    if (len == RAW_IMAGE_SIZE && get32(data) != IMAGE_MAGIC) {
+        memcpy(frame, data, RAW_IMAGE_SIZE);
+        return true;
+    }
+    if (len < IMAGE_HEADER_SIZE || get32(data) != IMAGE_MAGIC) {
+        return false;
+    }
+    uint8_t encoding = data[4];
+    uint16_t paletteSize = get16(data + 6);
+    uint32_t payloadLength = get32(data + 8);
+    // Header and palette first, then the payload against what is left, so a huge length cannot wrap the sum
+    if (paletteSize > MAX_PALETTE_SIZE || len < IMAGE_HEADER_SIZE + paletteSize * 3
+        || payloadLength > len - IMAGE_HEADER_SIZE - paletteSize * 3) {
+        return false;
+    }
+    const RGB* palette = (const RGB*)(data + IMAGE_HEADER_SIZE);
+    const uint8_t* payload = data + IMAGE_HEADER_SIZE + paletteSize * 3;
+
+    switch (encoding) {
+        case IMAGE_RAW:
+            if (payloadLength != RAW_IMAGE_SIZE) {
+                return false;
+            }
+            memcpy(frame, payload, RAW_IMAGE_SIZE);
+            return true;
+
+        case IMAGE_PALETTE:
+            if (payloadLength != IMAGE_PIXELS || paletteSize == 0) {
+                return false;
+            }
+            for (size_t i = 0; i < IMAGE_PIXELS; i++) {
+                if (payload[i] >= paletteSize) {
+                    return false;
+                }
+                frame[i] = palette[payload[i]];
+            }
+            return true;
+
+        case IMAGE_RLE: {
+            if (paletteSize == 0) {
+                return false;
+            }
+            size_t at = 0;
+            for (size_t x = 0; x < WIDTH; x++) {
+                RGB* column = frame + x * HEIGHT;
+                size_t y = 0;
+                while (y < HEIGHT) {
+                    if (at + 2 > payloadLength) {
+                        return false;
+                    }
+                    uint8_t run = payload[at];
+                    uint8_t index = payload[at + 1];
+                    at += 2;
+                    if (run == 0 || y + run > HEIGHT || index >= paletteSize) {
+                        return false;
+                    }
+                    RGB color = palette[index];
+                    for (uint8_t k = 0; k < run; k++) {
+                        column[y++] = color;
+                    }
+                }
+            }
+            return at == payloadLength;
+        }
+
+        default:
+            return false;
+    }
+}
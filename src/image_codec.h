@@ -0,0 +1,44 @@
+#ifndef IMAGE_CODEC_H
+#define IMAGE_CODEC_H
+#include <stdint.h>
+#include <stddef.h>
+#include "display_types.h"
+
+// Stills as written by tools/asset_convert. Frames are column-major like the
+// scan: WIDTH columns of HEIGHT pixels, row 0 on top.
+//
+// Layout (little endian):
+//   u32 magic, u8 encoding, u8 reserved, u16 palette size, u32 payload length
+//   palette: palette size * 3 bytes RGB (PALETTE and RLE only)
+//   payload:
+//     RAW      WIDTH * HEIGHT RGB
+//     PALETTE  WIDTH * HEIGHT palette indices
+//     RLE      per column (count, index) byte pairs, count 1..255, runs stop at the column end
+// Files of exactly WIDTH * HEIGHT * 3 bytes without a header are the older raw dumps.
+// No Arduino headers here so the host tools encode with the same code.
+
+const uint32_t IMAGE_MAGIC = 0x474d4950;  // "PIMG"
+const size_t IMAGE_HEADER_SIZE = 12;
+const size_t IMAGE_PIXELS = (size_t)WIDTH * HEIGHT;
+const size_t RAW_IMAGE_SIZE = IMAGE_PIXELS * sizeof(RGB);
+const uint16_t MAX_PALETTE_SIZE = 256;
+
+enum ImageEncoding : uint8_t {
+    IMAGE_RAW = 0,
+    IMAGE_PALETTE = 1,
+    IMAGE_RLE = 2
+};
+
+// Largest encoded image, for sizing buffers
+const size_t MAX_ENCODED_IMAGE_SIZE = IMAGE_HEADER_SIZE + MAX_PALETTE_SIZE * 3 + RAW_IMAGE_SIZE;
+
+size_t encodeImageRaw(const RGB* frame, uint8_t* out);
+// indices are column-major like the frame; returns 0 if the palette is too large
+size_t encodeImageIndexed(const uint8_t* indices, const RGB* palette, uint16_t paletteSize,
+                          ImageEncoding encoding, uint8_t* out);
+
+// Decodes any of the above, or a headerless raw dump, into IMAGE_PIXELS RGB.
+// false on a truncated or corrupt image.
+bool decodeImage(const uint8_t* data, size_t len, RGB* frame);
+
+#endif // IMAGE_CODEC_H
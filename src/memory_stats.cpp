@@ -0,0 +1,143 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include "memory_stats.h"
+#include "frame_store.h"
+#include "deferred_log.h"
+
+typedef struct {
+    const uint8_t* block;     // nullptr when the slot is empty
+    uint32_t storedMs;
+} TrackedSlot;
+
+static TrackedSlot slots[MAX_TRACKED_SLOTS];
+static size_t slotCount = 0;
+static size_t usedSlots = 0;
+static size_t usedHighWater = 0;
+
+HeapStats heapStats(bool psram) {
+    uint32_t caps = psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+    return {(uint32_t)heap_caps_get_total_size(caps), (uint32_t)heap_caps_get_free_size(caps),
+            (uint32_t)heap_caps_get_largest_free_block(caps), (uint32_t)heap_caps_get_minimum_free_size(caps)};
+}
+
+void memorySlotStored(size_t slot, const uint8_t* block) {
+    if (slot >= MAX_TRACKED_SLOTS) {
+        return;
+    }
+    if (slots[slot].block == nullptr) {
+        usedSlots++;
+        usedHighWater = usedSlots > usedHighWater ? usedSlots : usedHighWater;
+    }
+    slots[slot] = {block, (uint32_t)millis()};
+    slotCount = slot + 1 > slotCount ? slot + 1 : slotCount;
+}
+
+void memorySlotCleared(size_t slot) {
+    if (slot >= MAX_TRACKED_SLOTS || slots[slot].block == nullptr) {
+        return;
+    }
+    slots[slot].block = nullptr;
+    usedSlots--;
+}
+
+SlotStats slotStats(size_t slot) {
+    if (slot >= MAX_TRACKED_SLOTS || slots[slot].block == nullptr) {
+        return {false, 0, 0};
+    }
+    return {true, (uint32_t)millis() - slots[slot].storedMs, frameRefs(slots[slot].block)};
+}
+
+size_t trackedSlots() {
+    return slotCount;
+}
+
+size_t usedSlotsHighWater() {
+    return usedHighWater;
+}
+
+// Share of the free space that is not in the largest block, in percent
+static unsigned fragmentation(const HeapStats& h) {
+    return h.freeBytes == 0 ? 0 : (unsigned)(100 - (uint64_t)h.largestBlock * 100 / h.freeBytes);
+}
+
+static void append(char* out, size_t size, size_t& at, const char* format, ...) __attribute__((format(printf, 4, 5)));
+static void append(char* out, size_t size, size_t& at, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(at < size ? out + at : nullptr, at < size ? size - at : 0, format, args);
+    va_end(args);
+    at += n > 0 ? n : 0;
+}
+
+size_t formatMemoryText(char* out, size_t size) {
+    size_t at = 0;
+    if (size > 0) {
+        out[0] = '\0';
+    }
+    const char* names[2] = {"DRAM", "PSRAM"};
+    for (int psram = 0; psram < 2; psram++) {
+        HeapStats h = heapStats(psram);
+        append(out, size, at, "%-5s free %u of %u, largest block %u (%u%% fragmented), lowest free %u\n",
+               names[psram], (unsigned)h.freeBytes, (unsigned)h.totalBytes, (unsigned)h.largestBlock,
+               fragmentation(h), (unsigned)h.minFreeBytes);
+    }
+    size_t frames, bytes;
+    frameTableUsage(frames, bytes);
+    append(out, size, at, "frames: %u distinct, %u bytes; slots: %u used, at most %u\n", (unsigned)frames,
+           (unsigned)bytes, (unsigned)usedSlots, (unsigned)usedHighWater);
+    for (size_t i = 0; i < slotCount; i++) {
+        SlotStats s = slotStats(i);
+        if (s.used) {
+            append(out, size, at, "  slot %2u: %u s old, shared by %u\n", (unsigned)i, (unsigned)(s.ageMs / 1000),
+                   (unsigned)s.refs);
+        }
+    }
+    return at;
+}
+
+size_t formatMemoryJson(char* out, size_t size) {
+    size_t at = 0;
+    if (size > 0) {
+        out[0] = '\0';
+    }
+    append(out, size, at, "{");
+    const char* names[2] = {"dram", "psram"};
+    for (int psram = 0; psram < 2; psram++) {
+        HeapStats h = heapStats(psram);
+        append(out, size, at, "\"%s\":{\"total\":%u,\"free\":%u,\"largestBlock\":%u,\"minFree\":%u},", names[psram],
+               (unsigned)h.totalBytes, (unsigned)h.freeBytes, (unsigned)h.largestBlock, (unsigned)h.minFreeBytes);
+    }
+    size_t frames, bytes;
+    frameTableUsage(frames, bytes);
+    append(out, size, at, "\"frames\":%u,\"frameBytes\":%u,\"slotsUsed\":%u,\"slotsHighWater\":%u,\"slots\":[",
+           (unsigned)frames, (unsigned)bytes, (unsigned)usedSlots, (unsigned)usedHighWater);
+    for (size_t i = 0; i < slotCount; i++) {
+        SlotStats s = slotStats(i);
+        append(out, size, at, "%s{\"used\":%s,\"ageMs\":%u,\"refs\":%u}", i ? "," : "", s.used ? "true" : "false",
+               (unsigned)s.ageMs, (unsigned)s.refs);
+    }
+    append(out, size, at, "]}");
+    return at;
+}
+
+void logMemory(const char* what, uint32_t bytes) {
+    HeapStats psram = heapStats(true);
+    HeapStats dram = heapStats(false);
+    size_t oldest = MAX_TRACKED_SLOTS;
+    uint32_t oldestAge = 0;
+    for (size_t i = 0; i < slotCount; i++) {
+        SlotStats s = slotStats(i);
+        if (s.used && s.ageMs >= oldestAge) {
+            oldest = i;
+            oldestAge = s.ageMs;
+        }
+    }
+    LOG(MEMORY, LOG_WARN, "No memory for %s of %u bytes", what, bytes);
+    LOG(MEMORY, LOG_WARN, "PSRAM free %u, largest %u, lowest %u", psram.freeBytes, psram.largestBlock,
+        psram.minFreeBytes);
+    LOG(MEMORY, LOG_WARN, "DRAM free %u, largest %u, lowest %u", dram.freeBytes, dram.largestBlock, dram.minFreeBytes);
+    LOG(MEMORY, LOG_WARN, "%u slots used, at most %u; oldest is slot %d, %u ms", usedSlots, usedHighWater,
+        oldest < MAX_TRACKED_SLOTS ? (int)oldest : -1, oldestAge);
+}
@@ -0,0 +1,42 @@
+#ifndef MEMORY_STATS_H
+#define MEMORY_STATS_H
+#include <stdint.h>
+#include <stddef.h>
+
+// Where the memory goes: internal DRAM and PSRAM free space, the largest
+// block either can still hand out, the lowest free space since boot, and
+// what every PSRAM video slot holds and for how long. Read with the 'mem'
+// command or GET /memory; logged whenever a frame cannot be allocated.
+
+struct HeapStats {
+    uint32_t totalBytes;
+    uint32_t freeBytes;
+    uint32_t largestBlock;    // biggest single allocation that can still succeed
+    uint32_t minFreeBytes;    // low-water mark since boot
+};
+
+struct SlotStats {
+    bool used;
+    uint32_t ageMs;           // since the slot was last written
+    uint16_t refs;            // slots sharing the same frame (frame_store.h)
+};
+
+const size_t MAX_TRACKED_SLOTS = 64;
+
+HeapStats heapStats(bool psram);
+
+// Called by the upload path as video slots are filled and emptied
+void memorySlotStored(size_t slot, const uint8_t* block);
+void memorySlotCleared(size_t slot);
+SlotStats slotStats(size_t slot);
+size_t trackedSlots();          // one past the highest slot ever stored
+size_t usedSlotsHighWater();
+
+// Summaries of the heaps, the shared frames and every slot; the return is the length, like snprintf
+size_t formatMemoryText(char* out, size_t size);
+size_t formatMemoryJson(char* out, size_t size);
+
+// Logs the heaps and slot use (deferred_log.h, module MEMORY) after an allocation failed
+void logMemory(const char* what, uint32_t bytes);
+
+#endif // MEMORY_STATS_H
@@ -0,0 +1,401 @@
+#include <stdlib.h>
+#include <string.h>
+#include "text_layout.h"
+
+// One glyph of the text with the style it is drawn in
+struct LayoutItem {
+    uint32_t codepoint;
+    RGB color;
+    uint8_t scale;
+    uint8_t fromStore;   // glyph comes from the store, not the font
+    uint8_t align;
+    uint8_t width;       // font columns, spacing included
+    int8_t kern;         // font columns against the previous glyph of the same span
+    uint8_t newline;     // item is a line break, no glyph
+};
+
+struct LayoutLine {
+    uint16_t start;      // items [start, end)
+    uint16_t end;
+    uint16_t width;      // display columns
+    uint16_t ascent;     // LED rows above the baseline
+    uint16_t descent;
+    uint8_t align;
+};
+
+static bool sameSpan(const LayoutItem& a, const LayoutItem& b) {
+    return a.fromStore == b.fromStore && a.scale == b.scale
+        && a.color.r == b.color.r && a.color.g == b.color.g && a.color.b == b.color.b;
+}
+
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Applies a {...} tag at text[i], returns its length or 0 if it is not markup
+static size_t parseTag(const char* text, size_t len, size_t i, RGB& color, uint8_t& scale, uint8_t& align) {
+    const char* end = (const char*)memchr(text + i, '}', len - i);
+    if (end == nullptr) {
+        return 0;
+    }
+    const char* tag = text + i + 1;
+    size_t tagLen = end - tag;
+    if (tagLen == 7 && tag[0] == '#') {
+        int v[6];
+        for (int k = 0; k < 6; k++) {
+            if ((v[k] = hexDigit(tag[1 + k])) < 0) {
+                return 0;
+            }
+        }
+        color = {(uint8_t)(v[0] << 4 | v[1]), (uint8_t)(v[2] << 4 | v[3]), (uint8_t)(v[4] << 4 | v[5])};
+    } else if (tagLen == 1 && tag[0] >= '1' && tag[0] <= '8') {
+        scale = tag[0] - '0';
+    } else if (tagLen == 1 && (tag[0] == '<' || tag[0] == '|' || tag[0] == '>')) {
+        align = tag[0] == '<' ? ALIGN_LEFT : tag[0] == '|' ? ALIGN_CENTER : ALIGN_RIGHT;
+    } else {
+        return 0;
+    }
+    return tagLen + 2;
+}
+
+// Picks the font for a codepoint, '?' when neither has it; false if there is nothing to draw
+static bool resolveGlyph(const LayoutFonts& fonts, LayoutItem& item) {
+    Glyph glyph;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        uint32_t cp = attempt == 0 ? item.codepoint : '?';
+        bool storeFirst = fonts.preferStore && fonts.store != nullptr && fonts.store->ready();
+        for (int pass = 0; pass < 2; pass++) {
+            bool useStore = (pass == 0) == storeFirst;
+            if (useStore) {
+                const StoreGlyph* stored = fonts.store != nullptr ? fonts.store->glyph(cp) : nullptr;
+                if (stored != nullptr) {
+                    item.codepoint = cp;
+                    item.fromStore = 1;
+                    item.width = stored->width;
+                    return true;
+                }
+            } else if (fonts.font != nullptr && fontGlyph(*fonts.font, cp, glyph)) {
+                item.codepoint = cp;
+                item.fromStore = 0;
+                item.width = glyph.width + fonts.font->spacing;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static uint8_t itemHeight(const LayoutFonts& fonts, const LayoutItem& item) {
+    return item.fromStore ? fonts.store->height() : fonts.font->height;
+}
+
+static uint8_t itemAscent(const LayoutFonts& fonts, const LayoutItem& item) {
+    return item.fromStore ? fonts.store->ascent() : fonts.font->ascent;
+}
+
+static int itemColumns(const LayoutItem& item, bool firstInLine) {
+    return ((firstInLine ? 0 : item.kern) + item.width) * item.scale;
+}
+
+// Turns text and markup into styled glyphs, returns the item count
+static size_t parseItems(const char* text, size_t len, const LayoutFonts& fonts, RGB color, LayoutItem* items) {
+    uint8_t scale = 0;   // 0 = the font's own
+    uint8_t align = ALIGN_LEFT;
+    size_t count = 0;
+    for (size_t i = 0; i < len;) {
+        if (text[i] == '{') {
+            if (i + 1 < len && text[i + 1] == '{') {
+                i++;  // "{{" draws the second brace
+            } else {
+                size_t tagLen = parseTag(text, len, i, color, scale, align);
+                if (tagLen > 0) {
+                    i += tagLen;
+                    continue;
+                }
+            }
+        }
+        LayoutItem& item = items[count];
+        memset(&item, 0, sizeof(item));
+        item.color = color;
+        item.align = align;
+        if (text[i] == '\n') {
+            item.newline = 1;
+            i++;
+            count++;
+            continue;
+        }
+        if (text[i] == '\r') {
+            i++;
+            continue;
+        }
+        item.codepoint = nextCodepoint(text, len, i);
+        if (!resolveGlyph(fonts, item)) {
+            continue;
+        }
+        item.scale = scale != 0 ? scale : item.fromStore ? STORE_TEXT_SCALE : TEXT_SCALE;
+        if (count > 0 && !item.fromStore && sameSpan(items[count - 1], item) && !items[count - 1].newline) {
+            int kern = fontKerning(*fonts.font, items[count - 1].codepoint, item.codepoint);
+            item.kern = -kern > items[count - 1].width ? -items[count - 1].width : kern;
+        }
+        count++;
+    }
+    return count;
+}
+
+// Greedy line breaking, returns the line count
+static size_t breakLines(const LayoutItem* items, size_t count, const LayoutFonts& fonts, bool wrap, LayoutLine* lines) {
+    size_t lineCount = 0;
+    size_t start = 0;
+    while (start < count || (lineCount == 0 && count == 0)) {
+        int width = 0;
+        size_t end = start;
+        size_t lastSpace = count;    // item index of the last break opportunity
+        size_t next;
+        while (true) {
+            if (end == count) {
+                next = count;
+                break;
+            }
+            const LayoutItem& item = items[end];
+            if (item.newline) {
+                next = end + 1;
+                break;
+            }
+            int w = itemColumns(item, end == start);
+            if (wrap && width + w > WIDTH && end > start) {
+                if (lastSpace != count && lastSpace > start) {
+                    end = lastSpace;   // break at the space, it is dropped
+                    next = lastSpace + 1;
+                } else {
+                    next = end;        // one word wider than the circumference
+                }
+                break;
+            }
+            if (item.codepoint == ' ') {
+                lastSpace = end;
+            }
+            width += w;
+            end++;
+        }
+
+        LayoutLine& line = lines[lineCount++];
+        line.start = start;
+        // Trailing spaces do not count for alignment
+        while (end > start && items[end - 1].codepoint == ' ') {
+            end--;
+        }
+        line.end = end;
+        line.width = 0;
+        line.ascent = 0;
+        line.descent = 0;
+        // The alignment in effect at the end of the line (its break, if any) applies to all of it
+        line.align = next > 0 && next <= count ? items[next - 1].align : (uint8_t)ALIGN_LEFT;
+        for (size_t k = start; k < end; k++) {
+            line.width += itemColumns(items[k], k == start);
+            uint16_t ascent = itemAscent(fonts, items[k]) * items[k].scale;
+            uint16_t descent = (itemHeight(fonts, items[k]) - itemAscent(fonts, items[k])) * items[k].scale;
+            line.ascent = ascent > line.ascent ? ascent : line.ascent;
+            line.descent = descent > line.descent ? descent : line.descent;
+        }
+        if (end == start) {
+            // Empty line, as tall as the default font
+            line.ascent = fonts.font->ascent * TEXT_SCALE;
+            line.descent = (fonts.font->height - fonts.font->ascent) * TEXT_SCALE;
+        }
+        start = next;
+        if (count == 0) {
+            break;
+        }
+    }
+    return lineCount;
+}
+
+// Glyph columns of one item ORed into the span's columns at font column x
+static void drawItem(const LayoutFonts& fonts, const LayoutItem& item, uint32_t* columns, int x) {
+    if (item.fromStore) {
+        const StoreGlyph* stored = fonts.store->glyph(item.codepoint);
+        if (stored != nullptr) {
+            for (uint8_t c = 0; c < stored->width && c < item.width; c++) {
+                columns[x + c] |= stored->columns[c];
+            }
+        }
+        return;
+    }
+    Glyph glyph;
+    if (!fontGlyph(*fonts.font, item.codepoint, glyph)) {
+        return;
+    }
+    for (uint8_t c = 0; c < glyph.width; c++) {
+        const uint8_t* bytes = glyph.columns + c * fonts.font->bytesPerColumn;
+        uint32_t bits = 0;
+        for (uint8_t b = 0; b < fonts.font->bytesPerColumn; b++) {
+            bits |= (uint32_t)bytes[b] << (8 * b);
+        }
+        columns[x + c] |= bits;
+    }
+}
+
+bool layoutText(TextLayout& layout, const char* text, size_t len, const LayoutFonts& fonts, RGB color, bool wrap) {
+    memset(&layout, 0, sizeof(layout));
+    if (fonts.font == nullptr || fonts.font->height > 32 || fonts.font->bitsPerPixel != 1 || len > 0xffff) {
+        return false;
+    }
+    LayoutItem* items = (LayoutItem*)malloc((len + 1) * sizeof(LayoutItem));
+    LayoutLine* lines = (LayoutLine*)malloc((len + 1) * sizeof(LayoutLine));
+    if (items == nullptr || lines == nullptr) {
+        free(items);
+        free(lines);
+        return false;
+    }
+    size_t count = parseItems(text, len, fonts, color, items);
+    size_t lineCount = breakLines(items, count, fonts, wrap, lines);
+
+    // Sizes of the span list and the column pool
+    size_t spanCount = 0;
+    size_t poolSize = 0;
+    int blockHeight = 0;
+    for (size_t l = 0; l < lineCount; l++) {
+        const LayoutLine& line = lines[l];
+        for (size_t k = line.start; k < line.end; k++) {
+            if (k == line.start || !sameSpan(items[k - 1], items[k])) {
+                spanCount++;
+            }
+            poolSize += items[k].width + (items[k].kern > 0 ? items[k].kern : 0);
+        }
+        blockHeight += line.ascent + line.descent + (l > 0 ? LINE_SPACING : 0);
+    }
+    layout.spans = (LayoutSpan*)malloc((spanCount > 0 ? spanCount : 1) * sizeof(LayoutSpan));
+    layout.pool = (uint32_t*)calloc(poolSize > 0 ? poolSize : 1, sizeof(uint32_t));
+    if (layout.spans == nullptr || layout.pool == nullptr) {
+        free(items);
+        free(lines);
+        freeTextLayout(layout);
+        return false;
+    }
+
+    // The block of lines is centred vertically, lines below the bottom are cut off
+    int y = blockHeight < HEIGHT ? (HEIGHT - blockHeight) / 2 : 0;
+    uint32_t* pool = layout.pool;
+    for (size_t l = 0; l < lineCount && y < HEIGHT; l++) {
+        const LayoutLine& line = lines[l];
+        int baseline = y + line.ascent;
+        int x = 0;
+        if (wrap || line.width < WIDTH) {
+            int room = line.width < WIDTH ? WIDTH - line.width : 0;   // a word wider than the display starts at 0
+            x = line.align == ALIGN_CENTER ? room / 2 : line.align == ALIGN_RIGHT ? room : 0;
+        }
+        LayoutSpan* span = nullptr;
+        int spanColumn = 0;   // next font column inside the current span
+        for (size_t k = line.start; k < line.end; k++) {
+            const LayoutItem& item = items[k];
+            if (span == nullptr || !sameSpan(items[k - 1], item)) {
+                int top = baseline - itemAscent(fonts, item) * item.scale;
+                span = &layout.spans[layout.spanCount++];
+                span->x = x;
+                span->strip = {pool, 0, itemHeight(fonts, item), item.scale, (uint8_t)(top < HEIGHT ? top : HEIGHT), item.color};
+                spanColumn = 0;
+            } else {
+                spanColumn += item.kern;
+            }
+            drawItem(fonts, item, span->strip.columns, spanColumn);
+            spanColumn += item.width;
+            if (spanColumn > span->strip.width) {
+                pool += spanColumn - span->strip.width;
+                span->strip.width = spanColumn;
+            }
+            x += itemColumns(item, k == line.start);
+        }
+        if (line.width > layout.width) {
+            layout.width = line.width;
+        }
+        y = baseline + line.descent + LINE_SPACING;
+    }
+    free(items);
+    free(lines);
+    return true;
+}
+
+void freeTextLayout(TextLayout& layout) {
+    free(layout.spans);
+    free(layout.pool);
+    memset(&layout, 0, sizeof(layout));
+}
+
+bool copyTextLayout(TextLayout& dst, const TextLayout& src) {
+    // Every span's columns lie in the pool, the last one ends it
+    size_t poolSize = 0;
+    for (uint16_t i = 0; i < src.spanCount; i++) {
+        size_t end = (src.spans[i].strip.columns - src.pool) + src.spans[i].strip.width;
+        poolSize = end > poolSize ? end : poolSize;
+    }
+    dst = src;
+    dst.spans = (LayoutSpan*)malloc((src.spanCount > 0 ? src.spanCount : 1) * sizeof(LayoutSpan));
+    dst.pool = (uint32_t*)malloc((poolSize > 0 ? poolSize : 1) * sizeof(uint32_t));
+    if (dst.spans == nullptr || dst.pool == nullptr) {
+        freeTextLayout(dst);
+        return false;
+    }
+    memcpy(dst.pool, src.pool, poolSize * sizeof(uint32_t));
+    for (uint16_t i = 0; i < src.spanCount; i++) {
+        dst.spans[i] = src.spans[i];
+        dst.spans[i].strip.columns = dst.pool + (src.spans[i].strip.columns - src.pool);
+    }
+    return true;
+}
+
+size_t layoutSpansAt(const TextLayout& layout, int x, const LayoutSpan** out, size_t max) {
+    size_t n = 0;
+    for (uint16_t i = 0; i < layout.spanCount && n < max; i++) {
+        const LayoutSpan& span = layout.spans[i];
+        if (x >= span.x && x < span.x + stripDisplayWidth(span.strip)) {
+            out[n++] = &span;
+        }
+    }
+    return n;
+}
+
+
+LayoutCache::LayoutCache() : useClock(0) {
+    memset(entries, 0, sizeof(entries));
+}
+
+LayoutCache::~LayoutCache() {
+    clear();
+}
+
+void LayoutCache::clear() {
+    for (size_t i = 0; i < LAYOUT_CACHE_ENTRIES; i++) {
+        freeTextLayout(entries[i].layout);
+        entries[i].lastUse = 0;
+    }
+}
+
+const TextLayout* LayoutCache::find(uint64_t source, bool wrap) {
+    for (size_t i = 0; i < LAYOUT_CACHE_ENTRIES; i++) {
+        if (entries[i].lastUse != 0 && entries[i].source == source && entries[i].wrap == wrap) {
+            entries[i].lastUse = ++useClock;
+            return &entries[i].layout;
+        }
+    }
+    return nullptr;
+}
+
+const TextLayout* LayoutCache::insert(uint64_t source, bool wrap, TextLayout& layout) {
+    size_t victim = 0;
+    for (size_t i = 1; i < LAYOUT_CACHE_ENTRIES; i++) {
+        if (entries[i].lastUse < entries[victim].lastUse) {
+            victim = i;
+        }
+    }
+    Entry& entry = entries[victim];
+    freeTextLayout(entry.layout);
+    entry.source = source;
+    entry.wrap = wrap;
+    entry.lastUse = ++useClock;
+    entry.layout = layout;
+    memset(&layout, 0, sizeof(layout));
+    return &entry.layout;
+}
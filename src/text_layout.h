@@ -0,0 +1,82 @@
+#ifndef TEXT_LAYOUT_H
+#define TEXT_LAYOUT_H
+#include <stdint.h>
+#include <stddef.h>
+#include "text_render.h"
+
+// Lays stored text out on the WIDTH x HEIGHT surface: explicit and wrapped
+// lines, alignment, and per-span size and colour. The result is a short list
+// of spans, each a strip of glyph columns placed at a display column, so
+// showing a layout again costs no layout work.
+//
+// Markup in stored text:
+//   '\n'         new line
+//   {#rrggbb}    colour of the following text
+//   {1} .. {8}   size of the following text, LEDs per font pixel
+//   {<} {|} {>}  left, centre or right alignment, from the current line on
+//   {{           a literal '{'
+// Anything else in braces is shown as written.
+
+enum TextAlign : uint8_t {
+    ALIGN_LEFT = 0,
+    ALIGN_CENTER = 1,
+    ALIGN_RIGHT = 2
+};
+
+struct LayoutSpan {
+    uint16_t x;        // display column of the strip's first column
+    TextStrip strip;   // columns point into the layout's pool
+};
+
+struct TextLayout {
+    LayoutSpan* spans;
+    uint16_t spanCount;
+    uint32_t* pool;    // glyph columns of all spans
+    uint16_t width;    // widest line in display columns
+};
+
+// Where glyphs come from. Each size defaults to the font's own scale.
+struct LayoutFonts {
+    const Font* font;    // compiled-in, TEXT_SCALE
+    GlyphStore* store;   // flash glyph store or nullptr, STORE_TEXT_SCALE
+    bool preferStore;    // look in the store first, for non-ASCII text
+};
+
+const uint8_t LINE_SPACING = 4;  // blank LED rows between lines
+
+// wrap breaks lines at spaces so none is wider than the circumference;
+// without it only '\n' starts a line and long lines scroll
+bool layoutText(TextLayout& layout, const char* text, size_t len, const LayoutFonts& fonts, RGB color, bool wrap);
+void freeTextLayout(TextLayout& layout);
+// A copy with its own spans and pool, for holders that outlive a LayoutCache entry
+bool copyTextLayout(TextLayout& dst, const TextLayout& src);
+
+// Spans covering display column x, at most max of them, returns how many
+size_t layoutSpansAt(const TextLayout& layout, int x, const LayoutSpan** out, size_t max);
+
+// Layouts of recently shown text items keyed by content hash, so going back
+// to an item or re-selecting it reuses its layout and only changed items are
+// laid out again
+const size_t LAYOUT_CACHE_ENTRIES = 8;
+
+class LayoutCache {
+public:
+    LayoutCache();
+    ~LayoutCache();
+    const TextLayout* find(uint64_t source, bool wrap);
+    // Takes ownership of the layout's memory, evicting the least recently used entry
+    const TextLayout* insert(uint64_t source, bool wrap, TextLayout& layout);
+    void clear();
+
+private:
+    struct Entry {
+        uint64_t source;
+        bool wrap;
+        uint32_t lastUse;   // 0 = free
+        TextLayout layout;
+    };
+    Entry entries[LAYOUT_CACHE_ENTRIES];
+    uint32_t useClock;
+};
+
+#endif // TEXT_LAYOUT_H
@@ -0,0 +1,65 @@
+#include <string.h>
+#include "text_render.h"
+
+uint32_t nextCodepoint(const char* text, size_t len, size_t& i) {
+    uint8_t lead = (uint8_t)text[i++];
+    if (lead < 0x80) {
+        return lead;
+    }
+    size_t extra = lead >= 0xf0 ? 3 : lead >= 0xe0 ? 2 : lead >= 0xc0 ? 1 : 0;
+    if (extra == 0 || lead >= 0xf8) {
+        return '?';
+    }
+    uint32_t codepoint = lead & (0x3f >> extra);
+    for (size_t k = 0; k < extra; k++) {
+        if (i >= len || ((uint8_t)text[i] & 0xc0) != 0x80) {
+            return '?';
+        }
+        codepoint = (codepoint << 6) | ((uint8_t)text[i++] & 0x3f);
+    }
+    return codepoint;
+}
+
+bool isAsciiText(const char* text, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if ((uint8_t)text[i] >= 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t stripColumnBits(const TextStrip& strip, int x) {
+    if (x < 0 || x >= stripDisplayWidth(strip)) {
+        return 0;
+    }
+    return strip.columns[x / strip.scale];
+}
+
+void expandColumnBits(const TextStrip& strip, uint32_t bits, RGB* column) {
+    memset(column, 0, HEIGHT * sizeof(RGB));
+    int y = strip.top;
+    for (uint8_t row = 0; row < strip.height && bits != 0; row++, bits >>= 1) {
+        if (bits & 1) {
+            for (int s = 0; s < strip.scale && y + s < HEIGHT; s++) {
+                column[y + s] = strip.color;
+            }
+        }
+        y += strip.scale;
+    }
+}
+
+void renderStripColumn(const TextStrip& strip, int x, RGB* column) {
+    expandColumnBits(strip, stripColumnBits(strip, x), column);
+}
+
+void advanceScroll(TextScroll& scroll, int width) {
+    int64_t span = (int64_t)scrollPeriod(width) << 16;
+    int64_t pos = (((int64_t)scroll.column << 16) | scroll.fraction) + scroll.speed;
+    pos %= span;
+    if (pos < 0) {
+        pos += span;
+    }
+    scroll.column = pos >> 16;
+    scroll.fraction = pos & 0xffff;
+}
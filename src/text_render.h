@@ -0,0 +1,64 @@
+#ifndef TEXT_RENDER_H
+#define TEXT_RENDER_H
+#include <stddef.h>
+#include "display_types.h"
+#include "font.h"
+#include "glyph_store.h"
+
+// Text rendered on the device from the stored string instead of uploaded as an image.
+// Text is rasterized once into strips of glyph column bitmasks at font
+// resolution (see text_layout.h); display columns are expanded from the strips
+// as they are scanned.
+struct TextStrip {
+    uint32_t* columns;   // one bitmask per font column, bit 0 = top row
+    uint16_t width;      // font columns
+    uint8_t height;      // font rows, up to 32
+    uint8_t scale;       // every font pixel covers scale x scale LEDs
+    uint8_t top;         // LED row of the first font row
+    RGB color;
+};
+
+const uint8_t TEXT_SCALE = 4;        // 5x7 glyphs become 20x28 LEDs, about 13 characters around the cylinder
+const uint8_t STORE_TEXT_SCALE = 2;  // 16 row CJK glyphs become 32x32 LEDs
+
+// Next codepoint of UTF-8 text starting at i, advances i; malformed bytes come back as '?'
+uint32_t nextCodepoint(const char* text, size_t len, size_t& i);
+bool isAsciiText(const char* text, size_t len);
+
+// Width of the strip in display columns
+inline int stripDisplayWidth(const TextStrip& strip) {
+    return strip.width * strip.scale;
+}
+
+// Glyph column bitmask behind display column x; 0 (blank) past the end of the strip
+uint32_t stripColumnBits(const TextStrip& strip, int x);
+// Fills one HEIGHT tall display column from a bitmask in the strip's style
+void expandColumnBits(const TextStrip& strip, uint32_t bits, RGB* column);
+// Fills one HEIGHT tall display column; x past the end of the strip is blank
+void renderStripColumn(const TextStrip& strip, int x, RGB* column);
+
+// Rotating text: every revolution starts the scan at a different column of the
+// already rendered text, so scrolling needs no re-rendering and no extra memory.
+// The offset is 16.16 fixed point; the fraction shifts the start of the
+// revolution by part of a column for smooth slow scrolls.
+struct TextScroll {
+    uint32_t column;     // text column shown at display column 0
+    uint16_t fraction;   // sub-column part of the offset, 1/65536 column
+    int32_t speed;       // 16.16 columns per revolution, negative scrolls the other way, 0 = static
+};
+
+const int TEXT_GAP = 24;                   // blank columns between the end of long text and its start
+const int32_t TEXT_SCROLL_SPEED = 0x8000;  // half a column per revolution
+
+// Columns after which the scroll wraps: the circumference, or the text plus a gap if longer
+inline int scrollPeriod(int width) {
+    return width + TEXT_GAP > WIDTH ? width + TEXT_GAP : WIDTH;
+}
+
+inline int scrollColumn(const TextScroll& scroll, int width, int x) {
+    return (int)((scroll.column + x) % scrollPeriod(width));
+}
+
+void advanceScroll(TextScroll& scroll, int width);
+
+#endif // TEXT_RENDER_H
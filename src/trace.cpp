@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include "trace.h"
+
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#else
+#include <chrono>
+#endif
+
+const char* traceEventName(uint16_t event) {
+    static const char* const names[TRACE_EVENT_COUNT] = {"render", "command", "upload", "flash read", "flash write"};
+    return event < TRACE_EVENT_COUNT ? names[event] : "unknown";
+}
+
+#if TRACE_ENABLED
+static TraceRecord* ring = nullptr;
+static std::atomic<uint32_t> head(0);       // records ever claimed
+static std::atomic<uint32_t> cleared(0);    // head when last cleared
+static std::atomic<bool> enabled(false);
+
+static inline uint32_t traceNow() {
+#ifdef ESP_PLATFORM
+    return (uint32_t)esp_timer_get_time();
+#else
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+bool traceBegin() {
+    if (ring == nullptr) {
+#ifdef ESP_PLATFORM
+        ring = (TraceRecord*)heap_caps_malloc(TRACE_RECORDS * sizeof(TraceRecord), MALLOC_CAP_SPIRAM);
+#else
+        ring = (TraceRecord*)malloc(TRACE_RECORDS * sizeof(TraceRecord));
+#endif
+        if (ring == nullptr) {
+            return false;
+        }
+    }
+    enabled = true;
+    return true;
+}
+
+// Dumps reading the ring in place. Tracing stays off until the last one ends,
+// then goes back to what it was before the first, or was set to meanwhile.
+static std::mutex dumpMutex;
+static uint32_t dumping = 0;
+static bool enabledAfterDump = false;
+
+void traceEnable(bool on) {
+    std::lock_guard<std::mutex> lock(dumpMutex);
+    if (dumping > 0) {
+        enabledAfterDump = on;
+    } else {
+        enabled = on && ring != nullptr;
+    }
+}
+
+void traceClear() {
+    cleared = head.load();
+}
+
+void traceRecord(TraceEvent event, TracePhase phase, uint32_t arg) {
+    if (!enabled.load(std::memory_order_relaxed)) {
+        return;
+    }
+    uint32_t slot = head.fetch_add(1, std::memory_order_relaxed) % TRACE_RECORDS;
+    TraceRecord& r = ring[slot];
+    r.us = traceNow();
+#ifdef ESP_PLATFORM
+    r.core = (uint8_t)xPortGetCoreID();
+#else
+    r.core = 0;
+#endif
+    r.phase = phase;
+    r.event = event;
+    r.arg = arg;
+}
+
+TraceDump traceStop(TraceHeader& header) {
+    std::lock_guard<std::mutex> lock(dumpMutex);
+    bool wasEnabled = enabled.exchange(false);
+    if (dumping++ == 0) {
+        enabledAfterDump = wasEnabled;
+    }
+    uint32_t end = head.load();
+    uint32_t available = end - cleared.load();
+    uint32_t kept = available < TRACE_RECORDS ? available : TRACE_RECORDS;
+    // A writer that claimed the newest slot just before tracing stopped may still be filling it
+    TraceDump dump = {end - 1, ring == nullptr || kept == 0 ? 0 : kept - 1};
+    header = {TRACE_MAGIC, TRACE_VERSION, sizeof(TraceRecord), dump.count, available - dump.count};
+    return dump;
+}
+
+TraceRecord traceRead(const TraceDump& dump, size_t i) {
+    return ring[(dump.end - dump.count + (uint32_t)i) % TRACE_RECORDS];
+}
+
+void traceResume() {
+    std::lock_guard<std::mutex> lock(dumpMutex);
+    if (dumping > 0 && --dumping == 0) {
+        enabled = enabledAfterDump && ring != nullptr;
+    }
+}
+#else
+TraceDump traceStop(TraceHeader& header) {
+    header = {TRACE_MAGIC, TRACE_VERSION, sizeof(TraceRecord), 0, 0};
+    return {0, 0};
+}
+
+TraceRecord traceRead(const TraceDump&, size_t) {
+    return TraceRecord();
+}
+
+void traceResume() {}
+#endif
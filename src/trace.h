@@ -0,0 +1,109 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <stdint.h>
+#include <stddef.h>
+
+// Event trace for timing problems the column stats (column_stats.h) only
+// count: what else was running when a revolution came late, on which core.
+//
+// Events are fixed 12 byte records written into a ring in PSRAM. Writers
+// claim a slot with one atomic increment and never wait, so any task on
+// either core can trace; the oldest records are overwritten.
+//
+// 'trace:dump' streams the ring over serial as hex lines, GET /trace as a
+// binary file; tools/trace_convert turns either into Chrome trace JSON for
+// chrome://tracing or ui.perfetto.dev. Release builds (-DPOV_RELEASE)
+// compile the trace out like the stats.
+
+#ifndef POV_RELEASE
+#define TRACE_ENABLED 1
+#else
+#define TRACE_ENABLED 0
+#endif
+
+enum TraceEvent : uint16_t {
+    TRACE_RENDER,          // one revolution or frame shown, arg: display mode
+    TRACE_COMMAND,         // a menu command, arg: first 4 characters of the verb
+    TRACE_UPLOAD,          // an HTTP upload request or chunk, arg: bytes
+    TRACE_FLASH_READ,      // payload read from SPIFFS, arg: bytes
+    TRACE_FLASH_WRITE,     // payload written to SPIFFS, arg: bytes
+    TRACE_EVENT_COUNT
+};
+
+enum TracePhase : uint8_t {
+    TRACE_BEGIN,
+    TRACE_END,
+    TRACE_INSTANT
+};
+
+struct TraceRecord {
+    uint32_t us;        // esp_timer time, wraps after 71 minutes
+    uint8_t core;
+    uint8_t phase;      // TracePhase
+    uint16_t event;     // TraceEvent
+    uint32_t arg;
+};
+
+// Binary dump: this header, then count records, oldest first
+struct TraceHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t count;
+    uint32_t dropped;   // records overwritten before the dump
+};
+const uint32_t TRACE_MAGIC = 0x43525450;   // "PTRC"
+const uint16_t TRACE_VERSION = 1;
+const size_t TRACE_RECORDS = 16384;        // 192 KB of PSRAM, a power of two
+
+const char* traceEventName(uint16_t event);
+
+#if TRACE_ENABLED
+// Allocates the ring and starts tracing, false without memory
+bool traceBegin();
+void traceEnable(bool on);
+void traceClear();
+void traceRecord(TraceEvent event, TracePhase phase, uint32_t arg);
+#else
+inline bool traceBegin() { return false; }
+inline void traceEnable(bool) {}
+inline void traceClear() {}
+inline void traceRecord(TraceEvent, TracePhase, uint32_t) {}
+#endif
+
+// Where one dump's records are in the ring, so dumps from serial and HTTP
+// at the same time each read their own
+struct TraceDump {
+    uint32_t end;      // ring index of the newest record, which is left out
+    uint32_t count;
+};
+
+// Stops tracing for a dump and fills in the header; the records are then
+// read in place, oldest first, with traceRead(dump, 0 .. header.count - 1).
+// traceResume() ends the dump; tracing is back on only if it was on before
+// (or was turned on meanwhile) and no other dump is still reading.
+TraceDump traceStop(TraceHeader& header);
+TraceRecord traceRead(const TraceDump& dump, size_t i);
+void traceResume();
+
+// Begin and end events around a scope
+class TraceSpan {
+public:
+    TraceSpan(TraceEvent event, uint32_t arg) : event(event), arg(arg) { traceRecord(event, TRACE_BEGIN, arg); }
+    ~TraceSpan() { traceRecord(event, TRACE_END, arg); }
+
+private:
+    TraceEvent event;
+    uint32_t arg;
+};
+
+// Four characters of a command verb packed into an argument, for TRACE_COMMAND
+inline uint32_t traceTag(const char* s, size_t len) {
+    uint32_t tag = 0;
+    for (size_t i = 0; i < 4 && i < len; i++) {
+        tag |= (uint32_t)(uint8_t)s[i] << (8 * i);
+    }
+    return tag;
+}
+
+#endif // TRACE_H
@@ -0,0 +1,283 @@
+#include <string.h>
+#include "transfer_frame.h"
+#include "checksum.h"
+
+static void putHeader(uint8_t* frame, uint8_t type, uint8_t status, uint16_t seq) {
+    frame[0] = type;
+    frame[1] = status;
+    frame[2] = seq & 0xff;
+    frame[3] = seq >> 8;
+}
+
+static uint16_t get16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put16(uint8_t* p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = v >> 24;
+}
+
+
+TransferReceiver::TransferReceiver(TransferSink& sink, TransferLink& link)
+    : sink(sink), link(link), open(false), window(DEFAULT_WINDOW), expectedSeq(0),
+      sinceAck(0), totalLength(0), received(0), crc(0), repairSent(false), gapSeq(0) {}
+
+void TransferReceiver::sendAck() {
+    uint8_t frame[FRAME_HEADER_SIZE + 2];
+    putHeader(frame, FRAME_ACK, TRANSFER_OK, expectedSeq);
+    put16(frame + FRAME_HEADER_SIZE, window);
+    link.send(frame, sizeof(frame));
+    sinceAck = 0;
+}
+
+void TransferReceiver::finish(TransferStatus status) {
+    uint8_t frame[FRAME_HEADER_SIZE];
+    putHeader(frame, FRAME_DONE, status, expectedSeq);
+    link.send(frame, sizeof(frame));
+    if (open) {
+        sink.close(status == TRANSFER_OK);
+        open = false;
+    }
+}
+
+void TransferReceiver::onFrame(const uint8_t* frame, size_t len) {
+    if (len < FRAME_HEADER_SIZE) {
+        return;
+    }
+    uint16_t seq = get16(frame + 2);
+    const uint8_t* payload = frame + FRAME_HEADER_SIZE;
+    size_t payloadLen = len - FRAME_HEADER_SIZE;
+
+    switch (frame[0]) {
+        case FRAME_OPEN: {
+            if (payloadLen < 6) {
+                finish(TRANSFER_BAD_FRAME);
+                return;
+            }
+            if (open) {
+                sink.close(false);  // a new OPEN abandons whatever was in progress
+                open = false;
+            }
+            char name[MAX_NAME_LEN + 1];
+            size_t nameLen = payloadLen - 6 < MAX_NAME_LEN ? payloadLen - 6 : MAX_NAME_LEN;
+            memcpy(name, payload + 6, nameLen);
+            name[nameLen] = '\0';
+
+            totalLength = get32(payload);
+            window = get16(payload + 4);
+            if (window == 0 || window > MAX_WINDOW) {
+                window = MAX_WINDOW;
+            }
+            if (!sink.open(name, totalLength)) {
+                finish(TRANSFER_IO_ERROR);
+                return;
+            }
+            open = true;
+            expectedSeq = 0;
+            received = 0;
+            crc = 0;
+            repairSent = false;
+            gapSeq = 0;
+            sendAck();
+            break;
+        }
+
+        case FRAME_DATA:
+            if (!open) {
+                return;
+            }
+            if (seq != expectedSeq) {
+                // Gap or duplicate: one ACK tells the sender where to resume,
+                // the rest of the stale burst is dropped quietly. A gap frame
+                // that is not past the previous one means the sender already
+                // went back and the resent frame was lost too, so ask again.
+                bool ahead = (int16_t)(seq - expectedSeq) > 0;
+                if (!repairSent || (ahead && (int16_t)(seq - gapSeq) <= 0)) {
+                    sendAck();
+                    repairSent = true;
+                }
+                if (ahead) {
+                    gapSeq = seq;
+                }
+                return;
+            }
+            if (received + payloadLen > totalLength) {
+                finish(TRANSFER_BAD_LENGTH);
+                return;
+            }
+            if (!sink.write(payload, payloadLen)) {
+                finish(TRANSFER_IO_ERROR);
+                return;
+            }
+            crc = crc32Update(crc, payload, payloadLen);
+            received += payloadLen;
+            expectedSeq++;
+            repairSent = false;
+            if (++sinceAck >= (window + 1) / 2 || received == totalLength) {
+                sendAck();
+            }
+            break;
+
+        case FRAME_CLOSE:
+            if (!open) {
+                return;
+            }
+            if (payloadLen < 4) {
+                finish(TRANSFER_BAD_FRAME);
+            } else if (received != totalLength) {
+                finish(TRANSFER_BAD_LENGTH);
+            } else if (get32(payload) != crc) {
+                finish(TRANSFER_BAD_CRC);
+            } else {
+                finish(TRANSFER_OK);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+TransferSender::TransferSender(TransferSource& source, TransferLink& link)
+    : source(source), link(link), name(), payloadSize(0), window(DEFAULT_WINDOW), totalLength(0), frameCount(0),
+      acked(0), nextFrame(0), crc(0), crcFrames(0), opened(false), closeSent(false), finished(true),
+      result(TRANSFER_OK) {}
+
+void TransferSender::begin(const char* name, uint32_t totalLength, uint16_t mtu, uint16_t window) {
+    this->payloadSize = framePayloadSize(mtu);
+    this->window = window == 0 || window > MAX_WINDOW ? MAX_WINDOW : window;
+    this->totalLength = totalLength;
+    frameCount = payloadSize > 0 ? (totalLength + payloadSize - 1) / payloadSize : 0;
+    acked = 0;
+    nextFrame = 0;
+    crc = 0;
+    crcFrames = 0;
+    opened = false;
+    closeSent = false;
+    finished = payloadSize == 0;
+    result = finished ? TRANSFER_BAD_FRAME : TRANSFER_OK;
+    if (finished) {
+        return;
+    }
+
+    size_t nameLen = strlen(name);
+    if (nameLen > MAX_NAME_LEN) {
+        nameLen = MAX_NAME_LEN;
+    }
+    if (6 + nameLen > payloadSize) {
+        nameLen = payloadSize - 6;
+    }
+    memcpy(this->name, name, nameLen);
+    this->name[nameLen] = '\0';
+    sendOpen();
+}
+
+void TransferSender::sendOpen() {
+    uint8_t frame[MAX_FRAME_SIZE];
+    size_t nameLen = strlen(name);
+    putHeader(frame, FRAME_OPEN, 0, 0);
+    put32(frame + FRAME_HEADER_SIZE, totalLength);
+    put16(frame + FRAME_HEADER_SIZE + 4, this->window);
+    memcpy(frame + FRAME_HEADER_SIZE + 6, name, nameLen);
+    link.send(frame, FRAME_HEADER_SIZE + 6 + nameLen);
+}
+
+void TransferSender::sendData(uint32_t index) {
+    uint8_t frame[MAX_FRAME_SIZE];
+    uint32_t offset = index * payloadSize;
+    size_t len = totalLength - offset < payloadSize ? totalLength - offset : payloadSize;
+    size_t got = source.read(offset, frame + FRAME_HEADER_SIZE, len);
+    if (got != len) {
+        finished = true;
+        result = TRANSFER_IO_ERROR;
+        return;
+    }
+    // Resent frames carry the same bytes, fold each frame in only once
+    if (index == crcFrames) {
+        crc = crc32Update(crc, frame + FRAME_HEADER_SIZE, len);
+        crcFrames++;
+    }
+    putHeader(frame, FRAME_DATA, 0, (uint16_t)index);
+    link.send(frame, FRAME_HEADER_SIZE + len);
+}
+
+void TransferSender::pump() {
+    // DATA waits for the receiver to accept the OPEN, otherwise its first ACK looks like a gap
+    if (!opened) {
+        return;
+    }
+    while (!finished && nextFrame < frameCount && nextFrame < acked + window) {
+        sendData(nextFrame++);
+    }
+    if (!finished && !closeSent && acked == frameCount) {
+        uint8_t frame[FRAME_HEADER_SIZE + 4];
+        putHeader(frame, FRAME_CLOSE, 0, (uint16_t)frameCount);
+        put32(frame + FRAME_HEADER_SIZE, crc);
+        link.send(frame, sizeof(frame));
+        closeSent = true;
+    }
+}
+
+void TransferSender::onTimeout() {
+    if (finished) {
+        return;
+    }
+    if (!opened) {
+        sendOpen();
+        return;
+    }
+    nextFrame = acked;
+    closeSent = false;
+    pump();
+}
+
+void TransferSender::onFrame(const uint8_t* frame, size_t len) {
+    if (finished || len < FRAME_HEADER_SIZE) {
+        return;
+    }
+    if (frame[0] == FRAME_DONE) {
+        finished = true;
+        result = (TransferStatus)frame[1];
+        return;
+    }
+    if (frame[0] != FRAME_ACK) {
+        return;
+    }
+    if (!opened) {
+        opened = true;
+        pump();
+        return;
+    }
+
+    // Widen the 16 bit sequence number against what is in flight
+    uint16_t delta = get16(frame + 2) - (uint16_t)acked;
+    uint32_t ackedNow = acked + delta;
+    if (ackedNow > nextFrame) {
+        return;
+    }
+    if (len >= FRAME_HEADER_SIZE + 2) {
+        uint16_t offered = get16(frame + FRAME_HEADER_SIZE);
+        if (offered > 0 && offered < window) {
+            window = offered;
+        }
+    }
+    if (ackedNow > acked) {
+        acked = ackedNow;
+    } else if (nextFrame > acked) {
+        nextFrame = acked;  // receiver reported a gap, go back to it
+    }
+    pump();
+}
@@ -0,0 +1,135 @@
+#ifndef TRANSFER_FRAME_H
+#define TRANSFER_FRAME_H
+#include <stdint.h>
+#include <stddef.h>
+
+// Binary bulk transfer over BLE, one frame per GATT write / notification.
+// Frames are sized to the negotiated MTU and carry a 16 bit sequence number.
+// The sender keeps up to `window` DATA frames in flight, the receiver answers
+// with cumulative ACK notifications; a gap makes it ACK the frame it still
+// expects and the sender goes back to it.
+//
+// Frame layout (little endian):
+//   [0] type  [1] status/flags  [2..3] seq  [4..] payload
+//   OPEN   payload: u32 total length, u16 window, name bytes
+//   DATA   payload: file bytes, every frame but the last is full
+//   ACK    seq = next expected DATA seq, payload: u16 window
+//   CLOSE  payload: u32 CRC32 of the whole file
+//   DONE   status = TransferStatus, sent in answer to CLOSE or on failure
+//   READ   payload: name; asks the device to send that file, it answers
+//          with OPEN/DATA/CLOSE and the client takes the receiver role
+// No Arduino headers here so the same code runs in the host harness.
+
+enum TransferFrameType : uint8_t {
+    FRAME_OPEN = 0x01,
+    FRAME_DATA = 0x02,
+    FRAME_ACK = 0x03,
+    FRAME_CLOSE = 0x04,
+    FRAME_DONE = 0x05,
+    FRAME_READ = 0x06
+};
+
+enum TransferStatus : uint8_t {
+    TRANSFER_OK = 0,
+    TRANSFER_BAD_FRAME = 1,
+    TRANSFER_IO_ERROR = 2,
+    TRANSFER_BAD_CRC = 3,
+    TRANSFER_BAD_LENGTH = 4
+};
+
+const size_t FRAME_HEADER_SIZE = 4;
+const size_t ATT_OVERHEAD = 3;  // ATT opcode + handle in every write/notification
+const size_t MAX_FRAME_SIZE = 512 - ATT_OVERHEAD;
+const uint16_t DEFAULT_WINDOW = 8;
+const uint16_t MAX_WINDOW = 32;
+const size_t MAX_NAME_LEN = 64;
+
+// Bytes of file data in one DATA frame for a given ATT MTU
+inline size_t framePayloadSize(uint16_t mtu) {
+    size_t frame = mtu > ATT_OVERHEAD ? mtu - ATT_OVERHEAD : 0;
+    if (frame > MAX_FRAME_SIZE) {
+        frame = MAX_FRAME_SIZE;
+    }
+    return frame > FRAME_HEADER_SIZE ? frame - FRAME_HEADER_SIZE : 0;
+}
+
+// Where frames go: a BLE notification on the device, a queue in the harness
+class TransferLink {
+public:
+    virtual ~TransferLink() {}
+    virtual void send(const uint8_t* frame, size_t len) = 0;
+};
+
+// Where received data goes, written as it arrives
+class TransferSink {
+public:
+    virtual ~TransferSink() {}
+    virtual bool open(const char* name, uint32_t totalLength) = 0;
+    virtual bool write(const uint8_t* data, size_t len) = 0;
+    virtual void close(bool ok) = 0;
+};
+
+// Where sent data comes from, read by offset so frames can be resent
+class TransferSource {
+public:
+    virtual ~TransferSource() {}
+    virtual size_t read(uint32_t offset, uint8_t* dst, size_t len) = 0;
+};
+
+class TransferReceiver {
+public:
+    TransferReceiver(TransferSink& sink, TransferLink& link);
+    void onFrame(const uint8_t* frame, size_t len);
+    bool active() const { return open; }
+
+private:
+    void sendAck();
+    void finish(TransferStatus status);
+
+    TransferSink& sink;
+    TransferLink& link;
+    bool open;
+    uint16_t window;
+    uint16_t expectedSeq;
+    uint16_t sinceAck;      // DATA frames taken since the last ACK
+    uint32_t totalLength;
+    uint32_t received;
+    uint32_t crc;
+    bool repairSent;        // ACK for the current gap already sent
+    uint16_t gapSeq;        // last frame seen past the gap, a resent burst starts below it again
+};
+
+class TransferSender {
+public:
+    TransferSender(TransferSource& source, TransferLink& link);
+    // Queues the OPEN frame, DATA follows from pump()
+    void begin(const char* name, uint32_t totalLength, uint16_t mtu, uint16_t window = DEFAULT_WINDOW);
+    void pump();                                  // send DATA/CLOSE frames while the window allows
+    void onFrame(const uint8_t* frame, size_t len);  // ACK and DONE frames from the receiver
+    void onTimeout();                             // nothing heard for a while: resend from the last confirmed frame
+    void abort() { finished = true; result = TRANSFER_IO_ERROR; }  // peer gone, give up
+    bool done() const { return finished; }
+    TransferStatus status() const { return result; }
+
+private:
+    void sendOpen();
+    void sendData(uint32_t index);
+
+    TransferSource& source;
+    TransferLink& link;
+    char name[MAX_NAME_LEN + 1];
+    size_t payloadSize;
+    uint16_t window;
+    uint32_t totalLength;
+    uint32_t frameCount;
+    uint32_t acked;         // frames below this index are confirmed
+    uint32_t nextFrame;     // next frame index to send
+    uint32_t crc;           // over bytes sent the first time round
+    uint32_t crcFrames;     // frames folded into crc
+    bool opened;            // receiver ACKed the OPEN frame
+    bool closeSent;
+    bool finished;
+    TransferStatus result;
+};
+
+#endif // TRANSFER_FRAME_H
@@ -0,0 +1,377 @@
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "vector_scene.h"
+#include "effects.h"
+
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#endif
+
+static void* sceneAlloc(size_t size) {
+#ifdef ESP_PLATFORM
+    void* p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    return p != nullptr ? p : malloc(size);
+#else
+    return malloc(size);
+#endif
+}
+
+static int16_t get16(const uint8_t* p) {
+    return (int16_t)(p[0] | (p[1] << 8));
+}
+
+static int32_t ceilDiv16(int32_t a) {
+    return a >= 0 ? (a + 15) / 16 : -(-a / 16);
+}
+
+const int32_t SCENE_WIDTH = WIDTH * 16;
+
+struct Point {
+    int32_t x;
+    int32_t y;
+};
+
+// Collects the edges of closed contours, or only counts them when out is nullptr.
+// columnEdges, when set, gets +1 at the first and -1 past the last column each edge is active in.
+struct EdgeSink {
+    VectorEdge* out;
+    size_t count;
+    uint16_t shape;
+    int16_t* columnEdges;   // WIDTH + 1 entries
+    bool tooSteep;          // an edge's slope does not fit 16.16
+
+    void edge(Point a, Point b) {
+        if (a.x == b.x) {
+            return;   // never crosses a column centre
+        }
+        if (a.x > b.x) {
+            Point t = a;
+            a = b;
+            b = t;
+        }
+        int64_t slope = ((int64_t)(b.y - a.y) << 16) / (b.x - a.x);
+        if (slope > INT32_MAX || slope < INT32_MIN) {
+            tooSteep = true;
+            return;
+        }
+        // A copy for every turn of the cylinder the edge reaches into
+        for (int32_t shift = -8 * SCENE_WIDTH; shift <= 8 * SCENE_WIDTH; shift += SCENE_WIDTH) {
+            if (b.x + shift <= 0 || a.x + shift >= SCENE_WIDTH) {
+                continue;
+            }
+            if (count < MAX_VECTOR_EDGES && out != nullptr) {
+                VectorEdge& e = out[count];
+                e.x0 = a.x + shift;
+                e.x1 = b.x + shift;
+                e.y0 = a.y;
+                e.slope = (int32_t)slope;
+                e.shape = shape;
+            }
+            if (columnEdges != nullptr) {
+                // Active in column x while x0 <= x * 16 + 8 < x1, as in VectorScene::column()
+                int32_t first = std::max(ceilDiv16(a.x + shift - 8), (int32_t)0);
+                int32_t end = std::min(ceilDiv16(b.x + shift - 8), (int32_t)WIDTH);
+                if (first < end) {
+                    columnEdges[first]++;
+                    columnEdges[end]--;
+                }
+            }
+            count++;
+        }
+    }
+
+    void contour(const Point* points, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            edge(points[i], points[(i + 1) % n]);
+        }
+    }
+};
+
+// Points along a circle, clockwise from 12 o'clock
+static Point arcPoint(Point center, int32_t radius, uint16_t angle) {
+    return {center.x + (int32_t)(((int64_t)radius * fixedSin(angle)) >> 15),
+            center.y - (int32_t)(((int64_t)radius * fixedCos(angle)) >> 15)};
+}
+
+// Segments for an arc, so that no chord is more than a quarter LED inside the circle
+static size_t arcSegments(int32_t radius, uint32_t sweep) {
+    // Segment angle sqrt(2 / r) radians, r in LEDs
+    uint32_t sqrtHalfRadius = fixedSqrt((uint32_t)radius * 8);   // sqrt(r / 2) * 16
+    uint64_t n = ((uint64_t)sweep * 628 * sqrtHalfRadius) / (65536ULL * 100 * 16) + 1;
+    return n < 4 ? 4 : n > 96 ? 96 : (size_t)n;
+}
+
+const size_t MAX_ARC_POINTS = 2 * (96 + 1);
+
+static void arcShape(EdgeSink& sink, Point center, int32_t radius, uint16_t start, uint32_t sweep, int32_t width,
+                     bool filled) {
+    bool full = sweep == 0;
+    if (full) {
+        sweep = 65536;
+    }
+    int32_t halfWidth = width < 16 ? 8 : width / 2;
+    int32_t outer = filled ? radius : radius + halfWidth;
+    int32_t inner = filled ? 0 : radius - halfWidth;
+    size_t n = arcSegments(outer, sweep);
+    Point points[MAX_ARC_POINTS];
+    size_t count = 0;
+
+    if (full) {
+        for (size_t i = 0; i < n; i++) {
+            points[count++] = arcPoint(center, outer, start + (uint16_t)(sweep * i / n));
+        }
+        sink.contour(points, count);
+        if (inner > 0) {
+            // The hole, even-odd filling leaves a ring
+            count = 0;
+            for (size_t i = 0; i < n; i++) {
+                points[count++] = arcPoint(center, inner, start + (uint16_t)(sweep * i / n));
+            }
+            sink.contour(points, count);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i <= n; i++) {
+        points[count++] = arcPoint(center, outer, start + (uint16_t)(sweep * i / n));
+    }
+    if (filled || inner <= 0) {
+        points[count++] = center;
+    } else {
+        for (size_t i = n + 1; i-- > 0;) {
+            points[count++] = arcPoint(center, inner, start + (uint16_t)(sweep * i / n));
+        }
+    }
+    sink.contour(points, count);
+}
+
+static void lineShape(EdgeSink& sink, Point a, Point b, int32_t width) {
+    int32_t halfWidth = width < 16 ? 8 : width / 2;
+    int64_t dx = b.x - a.x;
+    int64_t dy = b.y - a.y;
+    uint64_t lengthSquared = dx * dx + dy * dy;
+    int shift = 0;
+    while (lengthSquared > 0xffffffffULL) {
+        lengthSquared >>= 2;
+        shift++;
+    }
+    int64_t length = (int64_t)fixedSqrt((uint32_t)lengthSquared) << shift;
+    Point corners[4];
+    if (length == 0) {
+        // A dot
+        corners[0] = {a.x - halfWidth, a.y - halfWidth};
+        corners[1] = {a.x + halfWidth, a.y - halfWidth};
+        corners[2] = {a.x + halfWidth, a.y + halfWidth};
+        corners[3] = {a.x - halfWidth, a.y + halfWidth};
+    } else {
+        int32_t nx = (int32_t)(-dy * halfWidth / length);
+        int32_t ny = (int32_t)(dx * halfWidth / length);
+        corners[0] = {a.x + nx, a.y + ny};
+        corners[1] = {b.x + nx, b.y + ny};
+        corners[2] = {b.x - nx, b.y - ny};
+        corners[3] = {a.x - nx, a.y - ny};
+    }
+    sink.contour(corners, 4);
+}
+
+// Walks the shapes of a scene into the sink, false if it is malformed
+static bool compileScene(const uint8_t* data, size_t len, EdgeSink& sink, RGB* colors, uint16_t& shapeCount) {
+    if (len < VECTOR_HEADER_SIZE || len > MAX_VECTOR_SCENE_SIZE
+        || (uint32_t)(data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24)) != VECTOR_MAGIC
+        || data[4] != VECTOR_VERSION) {
+        return false;
+    }
+    shapeCount = (uint16_t)get16(data + 6);
+    size_t at = VECTOR_HEADER_SIZE;
+    for (uint16_t s = 0; s < shapeCount; s++) {
+        if (at + 5 > len) {
+            return false;
+        }
+        uint8_t type = data[at];
+        uint8_t flags = data[at + 1];
+        if (colors != nullptr) {
+            colors[s] = {data[at + 2], data[at + 3], data[at + 4]};
+        }
+        const uint8_t* p = data + at + 5;
+        size_t size;
+        sink.shape = s;
+        switch (type) {
+            case VECTOR_LINE:
+                size = 10;
+                if (at + 5 + size > len) {
+                    return false;
+                }
+                lineShape(sink, {get16(p), get16(p + 2)}, {get16(p + 4), get16(p + 6)}, (uint16_t)get16(p + 8));
+                break;
+            case VECTOR_RECT: {
+                size = 8;
+                if (at + 5 + size > len) {
+                    return false;
+                }
+                int32_t x = get16(p), y = get16(p + 2), w = get16(p + 4), h = get16(p + 6);
+                Point corners[4] = {{x, y}, {x + w, y}, {x + w, y + h}, {x, y + h}};
+                sink.contour(corners, 4);
+                break;
+            }
+            case VECTOR_POLYGON: {
+                if (at + 6 > len) {
+                    return false;
+                }
+                uint8_t n = p[0];
+                size = 1 + 4 * (size_t)n;
+                if (at + 5 + size > len) {
+                    return false;
+                }
+                Point points[256];
+                for (uint8_t i = 0; i < n; i++) {
+                    points[i] = {get16(p + 1 + 4 * i), get16(p + 3 + 4 * i)};
+                }
+                sink.contour(points, n);
+                break;
+            }
+            case VECTOR_ARC:
+                size = 12;
+                if (at + 5 + size > len) {
+                    return false;
+                }
+                arcShape(sink, {get16(p), get16(p + 2)}, (uint16_t)get16(p + 4), (uint16_t)get16(p + 6),
+                         (uint16_t)get16(p + 8), (uint16_t)get16(p + 10), flags & VECTOR_FILLED);
+                break;
+            default:
+                return false;
+        }
+        at += 5 + size;
+    }
+    return at == len;
+}
+
+// Walks a scene without storing its edges, false if it is malformed or more
+// than the scan can hold: too many edges in all or over one column
+static bool sizeScene(const uint8_t* data, size_t len, size_t& edgeCount, uint16_t& shapes) {
+    int16_t columnEdges[WIDTH + 1] = {};
+    EdgeSink sizing = {nullptr, 0, 0, columnEdges, false};
+    if (!compileScene(data, len, sizing, nullptr, shapes) || sizing.count > MAX_VECTOR_EDGES || sizing.tooSteep) {
+        return false;
+    }
+    int32_t active = 0;
+    for (int x = 0; x < WIDTH; x++) {
+        active += columnEdges[x];
+        if (active > (int32_t)MAX_ACTIVE_EDGES) {
+            return false;
+        }
+    }
+    edgeCount = sizing.count;
+    return true;
+}
+
+bool validVectorScene(const uint8_t* data, size_t len) {
+    size_t edgeCount;
+    uint16_t shapes;
+    return sizeScene(data, len, edgeCount, shapes);
+}
+
+VectorScene::VectorScene()
+    : edges(nullptr), colors(nullptr), count(0), shapeCount(0), lastX(WIDTH), nextEdge(0), activeCount(0) {}
+
+VectorScene::~VectorScene() {
+    clear();
+}
+
+void VectorScene::clear() {
+    free(edges);
+    free(colors);
+    edges = nullptr;
+    colors = nullptr;
+    count = 0;
+    shapeCount = 0;
+}
+
+bool VectorScene::load(const uint8_t* data, size_t len) {
+    clear();
+    size_t edgeCount;
+    uint16_t shapes;
+    if (!sizeScene(data, len, edgeCount, shapes)) {
+        return false;
+    }
+    // An empty scene still counts as loaded
+    edges = (VectorEdge*)sceneAlloc((edgeCount + 1) * sizeof(VectorEdge));
+    colors = (RGB*)malloc((shapes + 1) * sizeof(RGB));
+    if (edges == nullptr || colors == nullptr) {
+        clear();
+        return false;
+    }
+    EdgeSink sink = {edges, 0, 0, nullptr, false};
+    compileScene(data, len, sink, colors, shapes);
+    std::sort(edges, edges + sink.count, [](const VectorEdge& a, const VectorEdge& b) { return a.x0 < b.x0; });
+    count = sink.count;
+    shapeCount = shapes;
+    lastX = WIDTH;
+    return true;
+}
+
+struct Crossing {
+    uint16_t shape;
+    int32_t y;
+};
+
+void VectorScene::column(int x, RGB* out) {
+    memset(out, 0, HEIGHT * sizeof(RGB));
+    if (edges == nullptr) {
+        return;
+    }
+    // Columns going backwards start a new scan
+    if (x <= lastX) {
+        nextEdge = 0;
+        activeCount = 0;
+    }
+    lastX = x;
+    int32_t xc = x * 16 + 8;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < activeCount; i++) {
+        if (edges[active[i]].x1 > xc) {
+            active[kept++] = active[i];
+        }
+    }
+    activeCount = kept;
+    while (nextEdge < count && edges[nextEdge].x0 <= xc) {
+        if (edges[nextEdge].x1 > xc && activeCount < MAX_ACTIVE_EDGES) {
+            active[activeCount++] = nextEdge;
+        }
+        nextEdge++;
+    }
+    if (activeCount == 0) {
+        return;
+    }
+
+    // Where the active edges cross this column, in paint order then top to bottom
+    Crossing crossings[MAX_ACTIVE_EDGES];
+    for (size_t i = 0; i < activeCount; i++) {
+        const VectorEdge& e = edges[active[i]];
+        Crossing c = {e.shape, e.y0 + (int32_t)(((int64_t)(xc - e.x0) * e.slope) >> 16)};
+        size_t j = i;
+        while (j > 0 && (crossings[j - 1].shape > c.shape
+                         || (crossings[j - 1].shape == c.shape && crossings[j - 1].y > c.y))) {
+            crossings[j] = crossings[j - 1];
+            j--;
+        }
+        crossings[j] = c;
+    }
+
+    // Even-odd: a shape covers the rows between pairs of its crossings
+    for (size_t i = 0; i + 1 < activeCount; i++) {
+        if (crossings[i].shape != crossings[i + 1].shape) {
+            continue;
+        }
+        int32_t first = ceilDiv16(crossings[i].y - 8);
+        int32_t last = ceilDiv16(crossings[i + 1].y - 8) - 1;
+        first = first < 0 ? 0 : first;
+        last = last >= HEIGHT ? HEIGHT - 1 : last;
+        RGB color = colors[crossings[i].shape];
+        for (int32_t y = first; y <= last; y++) {
+            out[y] = color;
+        }
+        i++;
+    }
+}
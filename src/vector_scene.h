@@ -0,0 +1,78 @@
+#ifndef VECTOR_SCENE_H
+#define VECTOR_SCENE_H
+#include <stdint.h>
+#include <stddef.h>
+#include "display_types.h"
+
+// Logos and shapes uploaded as a few hundred bytes of vector data instead of
+// a frame, rasterized as each column is scanned.
+//
+// Scene format (little endian). Coordinates are 1/16 LED: x in display
+// columns from column 0, wrapping around the cylinder, y in rows from the top.
+//   header   u32 magic, u8 version, u8 reserved, u16 shape count
+//   shape    u8 type, u8 flags, u8 r, u8 g, u8 b, then by type:
+//     LINE     i16 x0, y0, x1, y1, u16 width
+//     RECT     i16 x, y, w, h                                 (filled)
+//     POLYGON  u8 n, n * (i16 x, i16 y)                       (filled, even-odd)
+//     ARC      i16 cx, cy, u16 radius, u16 start, u16 sweep, u16 width
+//              angles 65536 per turn clockwise from 12 o'clock, sweep 0 is a
+//              full circle; VECTOR_FILLED fills the sector instead of stroking
+// Later shapes are drawn over earlier ones.
+//
+// Loading turns every shape into closed polygons and their edges into a
+// table sorted by the column they start at. Columns are scanned in order,
+// so each column only updates the active edges and intersects those.
+
+const uint32_t VECTOR_MAGIC = 0x43455650;  // "PVEC"
+const uint8_t VECTOR_VERSION = 1;
+const size_t VECTOR_HEADER_SIZE = 8;
+const size_t MAX_VECTOR_SCENE_SIZE = 4096;
+const size_t MAX_VECTOR_EDGES = 2048;      // after arcs and wide lines are split into polygons
+const size_t MAX_ACTIVE_EDGES = 128;       // edges one column can cross, scenes needing more are refused
+
+enum VectorShapeType : uint8_t {
+    VECTOR_LINE = 1,
+    VECTOR_RECT = 2,
+    VECTOR_POLYGON = 3,
+    VECTOR_ARC = 4
+};
+
+const uint8_t VECTOR_FILLED = 0x01;
+
+struct VectorEdge {
+    int32_t x0;        // 1/16 LED, x0 < x1
+    int32_t x1;
+    int32_t y0;        // at x0
+    int32_t slope;     // dy/dx, 16.16
+    uint16_t shape;    // paint order
+};
+
+// True if the bytes are a scene load() would accept, without storing its edges
+bool validVectorScene(const uint8_t* data, size_t len);
+
+class VectorScene {
+public:
+    VectorScene();
+    ~VectorScene();
+    // Parses and compiles a scene, false if it is malformed or too complex
+    bool load(const uint8_t* data, size_t len);
+    void clear();
+    bool loaded() const { return edges != nullptr; }
+    size_t edgeCount() const { return count; }
+
+    // Display column x, fastest when called for x = 0, 1, 2, ... every revolution
+    void column(int x, RGB* out);
+
+private:
+    VectorEdge* edges;     // sorted by x0
+    RGB* colors;           // per shape
+    size_t count;
+    uint16_t shapeCount;
+    // Scan state
+    int lastX;
+    size_t nextEdge;                       // first edge not yet active
+    uint16_t active[MAX_ACTIVE_EDGES];
+    size_t activeCount;
+};
+
+#endif // VECTOR_SCENE_H
@@ -1,11 +1,12 @@
 #ifndef DATA_WRITER_H
 #define DATA_WRITER_H
 #include <Arduino.h>
+#include "../src/command_parser.h"
 
 void setupDataWriter();
-void writeFile(String path, String data);
+void writeFile(const char* path, const char* data, size_t len);
 void wait_input();
-void readFile(String path);
-void processCommand(String data);
+void readFile(const char* path);
+void processCommand(const Command& cmd);
 
 #endif // DATA_WRITER_H
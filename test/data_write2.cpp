@@ -4,16 +4,110 @@
 #include <BLEUtils.h>
 #include <BLEServer.h>
 #include <BLE2902.h>
+#include <mutex>
 #include "data_write.h"
+#include "../src/transfer_frame.h"
 
 #define SERVICE_UUID             "4fafc201-1fb5-459e-8fcc-c5c9c331914b"  // Random UUID for service
 #define COMMAND_RESULT_UUID      "beb5483e-36e1-4688-b7f5-ea07361b26a8"  // Random UUID for command/result characteristic
 #define NOTIFY_CHARACTERISTIC_UUID "c5c9c3d2-1fb5-459e-8fcc-c5c9c331914b"  // Random UUID for notification characteristic
+#define TRANSFER_CHARACTERISTIC_UUID "7d3e9a10-2c4b-4f1e-9a57-0b8e61c2f4d3"  // Random UUID for binary bulk transfer
 
 BLEServer* pServer = NULL;
 BLECharacteristic* pCommandResultCharacteristic = NULL;
 BLECharacteristic* pNotifyCharacteristic = NULL;
-String inputBuffer = "";
+BLECharacteristic* pTransferCharacteristic = NULL;
+CommandRing inputBuffer;
+const size_t MAX_PATH_LEN = 64;
+
+// Bulk transfer sink: every DATA frame goes straight into the open LittleFS file
+class LittleFSSink : public TransferSink {
+public:
+    bool open(const char* name, uint32_t totalLength) override {
+        file = LittleFS.open(name, FILE_WRITE);
+        return (bool)file;
+    }
+    bool write(const uint8_t* data, size_t len) override {
+        return file.write(data, len) == len;
+    }
+    void close(bool ok) override {
+        String path = file.path();
+        file.close();
+        if (!ok) {
+            LittleFS.remove(path);  // never leave a truncated file behind
+        }
+    }
+private:
+    File file;
+};
+
+// ACK/DONE frames go back as notifications on the transfer characteristic
+class NotifyLink : public TransferLink {
+public:
+    void send(const uint8_t* frame, size_t len) override {
+        pTransferCharacteristic->setValue((uint8_t*)frame, len);
+        pTransferCharacteristic->notify();
+    }
+};
+
+// File reads for the sender: whole flash blocks are read into one fixed buffer
+// and sliced into notification sized frames, so memory does not grow with the file
+class LittleFSSource : public TransferSource {
+public:
+    bool open(const char* path) {
+        file = LittleFS.open(path, FILE_READ);
+        blockLen = 0;
+        return (bool)file;
+    }
+    uint32_t size() {
+        return file.size();
+    }
+    size_t read(uint32_t offset, uint8_t* dst, size_t len) override {
+        size_t done = 0;
+        while (done < len) {
+            uint32_t pos = offset + done;
+            if (pos < blockStart || pos >= blockStart + blockLen) {
+                blockStart = pos - pos % READ_BLOCK_SIZE;
+                if (!file.seek(blockStart)) {
+                    blockLen = 0;
+                    return done;
+                }
+                blockLen = file.read(block, READ_BLOCK_SIZE);
+                if (pos >= blockStart + blockLen) {
+                    return done;
+                }
+            }
+            size_t n = blockStart + blockLen - pos < len - done ? blockStart + blockLen - pos : len - done;
+            memcpy(dst + done, block + (pos - blockStart), n);
+            done += n;
+        }
+        return done;
+    }
+    void close() {
+        if (file) {
+            file.close();
+        }
+    }
+private:
+    static const size_t READ_BLOCK_SIZE = 4096;  // LittleFS block size on the ESP32
+    File file;
+    uint8_t block[READ_BLOCK_SIZE];
+    uint32_t blockStart = 0;
+    size_t blockLen = 0;
+};
+
+LittleFSSink transferSink;
+LittleFSSource transferSource;
+NotifyLink transferLink;
+TransferReceiver transferReceiver(transferSink, transferLink);
+TransferSender transferSender(transferSource, transferLink);
+unsigned long lastTransferFrame = 0;
+uint8_t transferRetries = 0;
+// The sender is driven from the BLE write callback and from the timeout loop in bleTask
+std::mutex transferMutex;
+const unsigned long TRANSFER_TIMEOUT_MS = 2000;
+const uint8_t MAX_TRANSFER_RETRIES = 5;
+
 
 void setupDataWriter() {
     if (!LittleFS.begin()) {
@@ -25,14 +119,14 @@ void setupDataWriter() {
     pNotifyCharacteristic->notify();
 }
 
-void writeFile(String path, String data) {
+void writeFile(const char* path, const char* data, size_t len) {
     File file = LittleFS.open(path, FILE_WRITE);
     if (!file) {
         pNotifyCharacteristic->setValue("Failed to open file for writing");
         pNotifyCharacteristic->notify();
         return;
     }
-    if (file.print(data)) {
+    if (file.write((const uint8_t*)data, len) == len) {
         pNotifyCharacteristic->setValue("Data written to LittleFS");
         pNotifyCharacteristic->notify();
     } else {
@@ -42,22 +136,29 @@ void writeFile(String path, String data) {
     file.close();
 }
 
-void readFile(String path) {
-    File file = LittleFS.open(path, FILE_READ);
-    if (!file) {
-        pNotifyCharacteristic->setValue("Failed to open file for reading");
+// Streams the file back over the transfer characteristic: OPEN, then DATA frames
+// sized to the peer MTU while the client's ACK window allows, then CLOSE with the CRC
+void readFile(const char* path) {
+    std::lock_guard<std::mutex> lock(transferMutex);
+    if (!transferSender.done()) {
+        pNotifyCharacteristic->setValue("Transfer already in progress");
         pNotifyCharacteristic->notify();
         return;
     }
-
-    String result = "";
-    while (file.available()) {
-        result += (char)file.read();
+    if (!transferSource.open(path)) {
+        pNotifyCharacteristic->setValue("Failed to open file for reading");
+        pNotifyCharacteristic->notify();
+        return;
     }
+    lastTransferFrame = millis();
+    transferRetries = 0;
+    transferSender.begin(path, transferSource.size(), pServer->getPeerMTU(pServer->getConnId()));
+}
 
-    file.close();
-    pCommandResultCharacteristic->setValue(result.c_str());
-    pCommandResultCharacteristic->notify();
+void finishRead() {
+    transferSource.close();
+    pNotifyCharacteristic->setValue(transferSender.status() == TRANSFER_OK ? "Read complete" : "Read failed");
+    pNotifyCharacteristic->notify();
 }
 
 void listDir(fs::FS &fs, const char * dirname, uint8_t levels) {
@@ -94,24 +195,23 @@ void listDir(fs::FS &fs, const char * dirname, uint8_t levels) {
     pCommandResultCharacteristic->notify();
 }
 
-void processCommand(String data) {
-    int firstColon = data.indexOf(':');
-    int secondColon = data.indexOf(':', firstColon + 1);
-
-    if (firstColon == -1 || secondColon == -1) {
+void processCommand(const Command& cmd) {
+    // COMMAND:fileName:content, content may contain further colons
+    if (cmd.argc < 2) {
         pNotifyCharacteristic->setValue("Invalid command format");
         pNotifyCharacteristic->notify();
         return;
     }
 
-    String command = data.substring(0, firstColon);
-    String fileName = data.substring(firstColon + 1, secondColon);
-    String content = data.substring(secondColon + 1);
+    const Token& command = cmd.verb;
+    char fileName[MAX_PATH_LEN];
+    cmd.args[0].copyTo(fileName, sizeof(fileName));
+    const Token& content = cmd.args[1];
 
     if (command.equals("WRITE")) {
         pNotifyCharacteristic->setValue("Write received");
         pNotifyCharacteristic->notify();
-        writeFile(fileName, content);
+        writeFile(fileName, content.ptr, content.len);
     } else if (command.equals("READ")) {
         pNotifyCharacteristic->setValue("READ received");
         pNotifyCharacteristic->notify();
@@ -126,18 +226,50 @@ void processCommand(String data) {
     }
 }
 
+class TransferCallbacks : public BLECharacteristicCallbacks {
+    void onWrite(BLECharacteristic* pCharacteristic) {
+        // One GATT write is one frame, handed over without copying it into a String
+        const uint8_t* frame = pCharacteristic->getData();
+        size_t len = pCharacteristic->getLength();
+        if (len < FRAME_HEADER_SIZE) {
+            return;
+        }
+        if (frame[0] == FRAME_READ) {
+            char path[MAX_PATH_LEN];
+            Token{(const char*)frame + FRAME_HEADER_SIZE, len - FRAME_HEADER_SIZE}.copyTo(path, sizeof(path));
+            readFile(path);  // takes transferMutex itself
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(transferMutex);
+        lastTransferFrame = millis();
+        transferRetries = 0;
+        if (frame[0] == FRAME_ACK || frame[0] == FRAME_DONE) {
+            // Answers to a read in progress
+            bool wasRunning = !transferSender.done();
+            transferSender.onFrame(frame, len);
+            if (wasRunning && transferSender.done()) {
+                finishRead();
+            }
+        } else {
+            transferReceiver.onFrame(frame, len);
+        }
+    }
+};
+
 class MyCallbacks : public BLECharacteristicCallbacks {
     void onWrite(BLECharacteristic* pCharacteristic) {
-        std::string rxValue = pCharacteristic->getValue();
-        if (rxValue.length() > 0) {
-            inputBuffer += rxValue.c_str();
-
-            int newlineIndex = inputBuffer.indexOf('\n');
-            while (newlineIndex != -1) {
-                String command = inputBuffer.substring(0, newlineIndex);
-                processCommand(command);
-                inputBuffer = inputBuffer.substring(newlineIndex + 1);
-                newlineIndex = inputBuffer.indexOf('\n');
+        const char* rx = (const char*)pCharacteristic->getData();
+        size_t len = pCharacteristic->getLength();
+
+        // Chunks land in a fixed ring, commands are parsed in place as lines complete
+        Command cmd;
+        while (len > 0) {
+            size_t taken = inputBuffer.push(rx, len);
+            rx += taken;
+            len -= taken;
+            while (inputBuffer.next(cmd, 3)) {
+                processCommand(cmd);
             }
         }
     }
@@ -145,6 +277,7 @@ class MyCallbacks : public BLECharacteristicCallbacks {
 
 void bleTask(void * parameter) {
     BLEDevice::init("ESP32_BLE");
+    BLEDevice::setMTU(517);  // transfer frames are sized to whatever the client negotiates
     pServer = BLEDevice::createServer();
     BLEService* pService = pServer->createService(SERVICE_UUID);
 
@@ -160,9 +293,18 @@ void bleTask(void * parameter) {
         BLECharacteristic::PROPERTY_NOTIFY
     );
 
+    pTransferCharacteristic = pService->createCharacteristic(
+        TRANSFER_CHARACTERISTIC_UUID,
+        BLECharacteristic::PROPERTY_WRITE |
+        BLECharacteristic::PROPERTY_WRITE_NR |
+        BLECharacteristic::PROPERTY_NOTIFY
+    );
+
     pCommandResultCharacteristic->setCallbacks(new MyCallbacks());
     pCommandResultCharacteristic->addDescriptor(new BLE2902());
     pNotifyCharacteristic->addDescriptor(new BLE2902());
+    pTransferCharacteristic->setCallbacks(new TransferCallbacks());
+    pTransferCharacteristic->addDescriptor(new BLE2902());
 
     pService->start();
 
@@ -174,9 +316,21 @@ void bleTask(void * parameter) {
     BLEDevice::startAdvertising();
     Serial.println("Waiting for a client connection to notify...");
 
-    // Keep the task running
+    // Keep the task running, resending a stalled read window
     while (true) {
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
+        vTaskDelay(250 / portTICK_PERIOD_MS);
+        std::lock_guard<std::mutex> lock(transferMutex);
+        if (!transferSender.done() && millis() - lastTransferFrame > TRANSFER_TIMEOUT_MS) {
+            lastTransferFrame = millis();
+            if (++transferRetries > MAX_TRANSFER_RETRIES) {
+                transferSender.abort();  // client went away mid read
+            } else {
+                transferSender.onTimeout();
+            }
+            if (transferSender.done()) {
+                finishRead();
+            }
+        }
     }
 }
 
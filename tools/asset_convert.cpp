@@ -0,0 +1,636 @@
+// Converts content into device-ready files, spread over all cores:
+//
+//   asset_convert [-j N] [--colors N] [--encoding auto|raw|palette|rle] [--fit stretch|contain|cover]
+//                 [--filter lanczos|box] [--wrap] [--cylinder <circumference>x<height>]
+//                 -o <out dir> <input>...
+//
+// Inputs by kind:
+//   *.png, *.jpg    still  -> img/<name>.pimg   (src/image_codec.h, quantized unless raw)
+//   directory       frames of a sequence, sorted by name -> video/<name>/NNNNN.rgb
+//                   (headerless raw frames, the format the PSRAM player shows)
+//   *.txt           text item, UTF-8 with layout markup -> char/<name>.txt
+//   *.vec           vector scene, one shape per line -> vec/<name>.pvec (src/vector_scene.h)
+//                     line <x0> <y0> <x1> <y1> <width> #rrggbb
+//                     rect <x> <y> <w> <h> #rrggbb
+//                     poly <x> <y> <x> <y> <x> <y>... #rrggbb
+//                     arc <cx> <cy> <radius> <start deg> <sweep deg, 360 = circle> <width> #rrggbb [fill]
+//                   in LEDs, x in display columns; lines starting with '#' are comments
+// --wrap treats images as 360 degree panoramas, --cylinder gives the surface
+// proportions when its columns and rows are not equally spaced (see
+// image_resample.h). manifest.json in the output directory lists every file with its size and the
+// content hash and CRC32 the device's frame store will compute for it.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <png.h>
+#include <jpeglib.h>
+#include "checksum.h"
+#include "image_codec.h"
+#include "image_resample.h"
+#include "vector_writer.h"
+
+namespace fs = std::filesystem;
+
+const size_t MAX_TEXT_BYTES = 256;  // MAX_TEXT_LEN in display.cpp
+
+enum JobKind {
+    JOB_STILL,
+    JOB_FRAME,
+    JOB_TEXT,
+    JOB_VECTOR
+};
+
+struct Job {
+    JobKind kind;
+    fs::path source;
+    fs::path output;
+    size_t item;         // manifest entry the job belongs to
+};
+
+struct JobResult {
+    bool ok = false;
+    std::string error;
+    size_t bytes = 0;
+    uint64_t hash = 0;
+    uint32_t crc = 0;
+    const char* encoding = "";
+};
+
+struct ManifestItem {
+    const char* type;
+    fs::path source;
+    fs::path path;       // relative to the output directory
+    size_t firstJob;
+    size_t jobCount;
+};
+
+struct Options {
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    int colors = 256;
+    std::string encoding = "auto";
+    ResampleOptions resample;
+    fs::path outDir;
+    std::vector<fs::path> inputs;
+};
+
+static std::string lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+static bool isImageFile(const fs::path& path) {
+    std::string ext = lower(path.extension().string());
+    return ext == ".png" || ext == ".jpg" || ext == ".jpeg";
+}
+
+static bool loadPng(const fs::path& path, HostImage& image, std::string& error) {
+    png_image png;
+    memset(&png, 0, sizeof(png));
+    png.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_file(&png, path.string().c_str())) {
+        error = png.message;
+        return false;
+    }
+    png.format = PNG_FORMAT_RGB;
+    image.width = png.width;
+    image.height = png.height;
+    image.rgb.resize(PNG_IMAGE_SIZE(png));
+    png_color black = {0, 0, 0};  // transparent areas stay dark, the LEDs are off there
+    if (!png_image_finish_read(&png, &black, image.rgb.data(), 0, nullptr)) {
+        error = png.message;
+        png_image_free(&png);
+        return false;
+    }
+    return true;
+}
+
+struct JpegError {
+    jpeg_error_mgr mgr;
+    jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+};
+
+static void jpegErrorExit(j_common_ptr info) {
+    JpegError* err = (JpegError*)info->err;
+    (*info->err->format_message)(info, err->message);
+    longjmp(err->jump, 1);
+}
+
+static bool loadJpeg(const fs::path& path, HostImage& image, std::string& error) {
+    FILE* file = fopen(path.string().c_str(), "rb");
+    if (file == nullptr) {
+        error = "cannot open";
+        return false;
+    }
+    jpeg_decompress_struct info;
+    JpegError err;
+    info.err = jpeg_std_error(&err.mgr);
+    err.mgr.error_exit = jpegErrorExit;
+    if (setjmp(err.jump)) {
+        error = err.message;
+        jpeg_destroy_decompress(&info);
+        fclose(file);
+        return false;
+    }
+    jpeg_create_decompress(&info);
+    jpeg_stdio_src(&info, file);
+    jpeg_read_header(&info, TRUE);
+    info.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&info);
+    image.width = info.output_width;
+    image.height = info.output_height;
+    image.rgb.resize((size_t)image.width * image.height * 3);
+    while (info.output_scanline < info.output_height) {
+        JSAMPROW row = &image.rgb[(size_t)info.output_scanline * image.width * 3];
+        jpeg_read_scanlines(&info, &row, 1);
+    }
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+    fclose(file);
+    return true;
+}
+
+static bool loadImage(const fs::path& path, HostImage& image, std::string& error) {
+    std::string ext = lower(path.extension().string());
+    return ext == ".png" ? loadPng(path, image, error) : loadJpeg(path, image, error);
+}
+
+// Median cut over a 5:5:5 histogram; every pixel maps to the colour of its box.
+// Images with few enough exact colours keep them exactly.
+static uint16_t quantize(const RGB* frame, int colors, RGB* palette, uint8_t* indices) {
+    std::vector<uint32_t> exact;
+    exact.reserve(colors + 1);
+    for (size_t i = 0; i < IMAGE_PIXELS && (int)exact.size() <= colors; i++) {
+        uint32_t c = frame[i].r << 16 | frame[i].g << 8 | frame[i].b;
+        if (std::find(exact.begin(), exact.end(), c) == exact.end()) {
+            exact.push_back(c);
+        }
+    }
+    if ((int)exact.size() <= colors) {
+        for (size_t k = 0; k < exact.size(); k++) {
+            palette[k] = {(uint8_t)(exact[k] >> 16), (uint8_t)(exact[k] >> 8), (uint8_t)exact[k]};
+        }
+        for (size_t i = 0; i < IMAGE_PIXELS; i++) {
+            uint32_t c = frame[i].r << 16 | frame[i].g << 8 | frame[i].b;
+            indices[i] = std::find(exact.begin(), exact.end(), c) - exact.begin();
+        }
+        return exact.size();
+    }
+
+    struct Bin {
+        uint32_t count = 0;
+        uint64_t r = 0, g = 0, b = 0;
+    };
+    std::vector<Bin> bins(1 << 15);
+    auto binOf = [](const RGB& c) { return (c.r >> 3) << 10 | (c.g >> 3) << 5 | (c.b >> 3); };
+    for (size_t i = 0; i < IMAGE_PIXELS; i++) {
+        Bin& bin = bins[binOf(frame[i])];
+        bin.count++;
+        bin.r += frame[i].r;
+        bin.g += frame[i].g;
+        bin.b += frame[i].b;
+    }
+    std::vector<uint16_t> used;
+    for (uint32_t k = 0; k < bins.size(); k++) {
+        if (bins[k].count > 0) {
+            used.push_back(k);
+        }
+    }
+
+    // Boxes are ranges of `used`, split along their widest channel at the median pixel
+    struct Box {
+        size_t begin, end;
+        int axis;
+        int range;
+        uint32_t pixels;
+    };
+    auto measure = [&](Box& box) {
+        int lo[3] = {31, 31, 31}, hi[3] = {0, 0, 0};
+        box.pixels = 0;
+        for (size_t k = box.begin; k < box.end; k++) {
+            int v[3] = {used[k] >> 10, (used[k] >> 5) & 31, used[k] & 31};
+            for (int a = 0; a < 3; a++) {
+                lo[a] = std::min(lo[a], v[a]);
+                hi[a] = std::max(hi[a], v[a]);
+            }
+            box.pixels += bins[used[k]].count;
+        }
+        box.axis = 0;
+        for (int a = 1; a < 3; a++) {
+            if (hi[a] - lo[a] > hi[box.axis] - lo[box.axis]) {
+                box.axis = a;
+            }
+        }
+        box.range = hi[box.axis] - lo[box.axis];
+    };
+    std::vector<Box> boxes(1, Box{0, used.size(), 0, 0, 0});
+    measure(boxes[0]);
+    while ((int)boxes.size() < colors) {
+        size_t pick = boxes.size();
+        uint64_t best = 0;
+        for (size_t b = 0; b < boxes.size(); b++) {
+            uint64_t score = (uint64_t)boxes[b].range * boxes[b].pixels;
+            if (boxes[b].end - boxes[b].begin > 1 && score > best) {
+                best = score;
+                pick = b;
+            }
+        }
+        if (pick == boxes.size()) {
+            break;
+        }
+        Box box = boxes[pick];
+        int shift = box.axis == 0 ? 10 : box.axis == 1 ? 5 : 0;
+        std::sort(used.begin() + box.begin, used.begin() + box.end,
+                  [shift](uint16_t a, uint16_t b) { return ((a >> shift) & 31) < ((b >> shift) & 31); });
+        uint32_t half = 0;
+        size_t split = box.begin;
+        while (split < box.end - 1 && half + bins[used[split]].count <= box.pixels / 2) {
+            half += bins[used[split++]].count;
+        }
+        if (split == box.begin) {
+            split++;
+        }
+        Box left{box.begin, split, 0, 0, 0};
+        Box right{split, box.end, 0, 0, 0};
+        measure(left);
+        measure(right);
+        boxes[pick] = left;
+        boxes.push_back(right);
+    }
+
+    std::vector<uint8_t> binIndex(bins.size(), 0);
+    for (size_t b = 0; b < boxes.size(); b++) {
+        uint64_t r = 0, g = 0, bl = 0, n = 0;
+        for (size_t k = boxes[b].begin; k < boxes[b].end; k++) {
+            const Bin& bin = bins[used[k]];
+            r += bin.r;
+            g += bin.g;
+            bl += bin.b;
+            n += bin.count;
+            binIndex[used[k]] = b;
+        }
+        palette[b] = {(uint8_t)((r + n / 2) / n), (uint8_t)((g + n / 2) / n), (uint8_t)((bl + n / 2) / n)};
+    }
+    for (size_t i = 0; i < IMAGE_PIXELS; i++) {
+        indices[i] = binIndex[binOf(frame[i])];
+    }
+    return boxes.size();
+}
+
+static bool writeFile(const fs::path& path, const uint8_t* data, size_t len, JobResult& result) {
+    std::ofstream out(path, std::ios::binary);
+    out.write((const char*)data, len);
+    if (!out) {
+        result.error = "cannot write " + path.string();
+        return false;
+    }
+    result.bytes = len;
+    result.hash = contentHash(data, len);
+    result.crc = crc32Update(0, data, len);
+    return true;
+}
+
+static bool validUtf8(const std::string& s) {
+    for (size_t i = 0; i < s.size();) {
+        uint8_t lead = s[i];
+        size_t extra = lead < 0x80 ? 0 : lead >= 0xf0 && lead < 0xf8 ? 3 : lead >= 0xe0 ? 2 : lead >= 0xc0 ? 1 : 4;
+        if (extra == 4 || i + extra >= s.size()) {
+            return false;
+        }
+        for (size_t k = 1; k <= extra; k++) {
+            if (((uint8_t)s[i + k] & 0xc0) != 0x80) {
+                return false;
+            }
+        }
+        i += extra + 1;
+    }
+    return true;
+}
+
+static bool parseColor(const std::string& word, RGB& color) {
+    unsigned long v;
+    char* end;
+    if (word.size() != 7 || word[0] != '#') {
+        return false;
+    }
+    v = strtoul(word.c_str() + 1, &end, 16);
+    color = {(uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v};
+    return *end == '\0';
+}
+
+// Compiles the text form of a scene, see the top of this file
+static bool compileVector(const fs::path& source, std::vector<uint8_t>& scene, std::string& error) {
+    std::ifstream in(source);
+    VectorWriter writer;
+    std::string line;
+    for (int lineNumber = 1; std::getline(in, line); lineNumber++) {
+        std::istringstream words(line);
+        std::string shape, word;
+        std::vector<double> v;
+        RGB color = {};
+        bool hasColor = false, fill = false, ok = true;
+        if (!(words >> shape) || shape[0] == '#') {
+            continue;
+        }
+        while (words >> word) {
+            char* end;
+            double d = strtod(word.c_str(), &end);
+            if (hasColor) {
+                fill = fill || word == "fill";
+                ok = ok && word == "fill";
+            } else if (word[0] == '#') {
+                hasColor = parseColor(word, color);
+                ok = ok && hasColor;
+            } else {
+                v.push_back(d);
+                ok = ok && *end == '\0';
+            }
+        }
+        ok = ok && hasColor;
+        if (ok && shape == "line" && v.size() == 5) {
+            writer.line(v[0], v[1], v[2], v[3], v[4], color);
+        } else if (ok && shape == "rect" && v.size() == 4) {
+            writer.rect(v[0], v[1], v[2], v[3], color);
+        } else if (ok && shape == "poly" && v.size() >= 6 && v.size() % 2 == 0 && v.size() <= 2 * 255) {
+            writer.polygon(v, color);
+        } else if (ok && shape == "arc" && v.size() == 6) {
+            writer.arc(v[0], v[1], v[2], v[3], v[4], v[5], fill, color);
+        } else {
+            error = "line " + std::to_string(lineNumber) + ": bad shape";
+            return false;
+        }
+    }
+    scene = writer.scene();
+    if (!validVectorScene(scene.data(), scene.size())) {
+        error = "scene is over " + std::to_string(MAX_VECTOR_SCENE_SIZE) + " bytes or " +
+                std::to_string(MAX_VECTOR_EDGES) + " edges";
+        return false;
+    }
+    return true;
+}
+
+static void runJob(const Job& job, const Options& opt, JobResult& result) {
+    if (job.kind == JOB_VECTOR) {
+        std::vector<uint8_t> scene;
+        if (!compileVector(job.source, scene, result.error)) {
+            return;
+        }
+        result.encoding = "vector";
+        result.ok = writeFile(job.output, scene.data(), scene.size(), result);
+        return;
+    }
+    if (job.kind == JOB_TEXT) {
+        std::ifstream in(job.source, std::ios::binary);
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) {
+            text.pop_back();
+        }
+        if (text.empty() || text.size() > MAX_TEXT_BYTES || !validUtf8(text)) {
+            result.error = "text must be 1.." + std::to_string(MAX_TEXT_BYTES) + " bytes of UTF-8";
+            return;
+        }
+        result.encoding = "utf-8";
+        result.ok = writeFile(job.output, (const uint8_t*)text.data(), text.size(), result);
+        return;
+    }
+
+    HostImage image;
+    if (!loadImage(job.source, image, result.error)) {
+        return;
+    }
+    std::vector<RGB> frame(IMAGE_PIXELS);
+    resampleToFrame(image, opt.resample, frame.data());
+
+    if (job.kind == JOB_FRAME || opt.encoding == "raw") {
+        if (job.kind == JOB_FRAME) {
+            result.encoding = "raw-frame";
+            result.ok = writeFile(job.output, (const uint8_t*)frame.data(), RAW_IMAGE_SIZE, result);
+            return;
+        }
+        std::vector<uint8_t> out(MAX_ENCODED_IMAGE_SIZE);
+        result.encoding = "raw";
+        result.ok = writeFile(job.output, out.data(), encodeImageRaw(frame.data(), out.data()), result);
+        return;
+    }
+
+    RGB palette[MAX_PALETTE_SIZE];
+    std::vector<uint8_t> indices(IMAGE_PIXELS);
+    uint16_t paletteSize = quantize(frame.data(), opt.colors, palette, indices.data());
+    std::vector<uint8_t> paletted(MAX_ENCODED_IMAGE_SIZE);
+    std::vector<uint8_t> rle(MAX_ENCODED_IMAGE_SIZE);
+    size_t palettedSize = 0;
+    size_t rleSize = 0;
+    if (opt.encoding != "rle") {
+        palettedSize = encodeImageIndexed(indices.data(), palette, paletteSize, IMAGE_PALETTE, paletted.data());
+    }
+    if (opt.encoding != "palette") {
+        rleSize = encodeImageIndexed(indices.data(), palette, paletteSize, IMAGE_RLE, rle.data());
+    }
+    bool useRle = rleSize > 0 && (palettedSize == 0 || rleSize < palettedSize);
+    result.encoding = useRle ? "rle" : "palette";
+    result.ok = writeFile(job.output, useRle ? rle.data() : paletted.data(), useRle ? rleSize : palettedSize, result);
+}
+
+static std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((uint8_t)c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+static bool writeManifest(const Options& opt, const std::vector<ManifestItem>& items, const std::vector<Job>& jobs,
+                          const std::vector<JobResult>& results) {
+    std::ofstream out(opt.outDir / "manifest.json");
+    out << "{\n  \"width\": " << WIDTH << ",\n  \"height\": " << HEIGHT << ",\n  \"items\": [\n";
+    for (size_t i = 0; i < items.size(); i++) {
+        const ManifestItem& item = items[i];
+        size_t bytes = 0;
+        for (size_t j = item.firstJob; j < item.firstJob + item.jobCount; j++) {
+            bytes += results[j].bytes;
+        }
+        out << "    {\"type\": \"" << item.type << "\", \"source\": " << jsonString(item.source.string())
+            << ", \"path\": " << jsonString(item.path.generic_string()) << ", \"bytes\": " << bytes;
+        // A sequence always lists its frames, even when it has only one
+        if (strcmp(item.type, "sequence") != 0) {
+            char hash[40];
+            snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)results[item.firstJob].hash);
+            out << ", \"encoding\": \"" << results[item.firstJob].encoding << "\", \"hash\": \"" << hash
+                << "\", \"crc32\": " << results[item.firstJob].crc;
+        } else {
+            out << ", \"frames\": [";
+            for (size_t j = item.firstJob; j < item.firstJob + item.jobCount; j++) {
+                char hash[40];
+                snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)results[j].hash);
+                out << (j == item.firstJob ? "" : ", ") << "{\"file\": "
+                    << jsonString(jobs[j].output.filename().string()) << ", \"hash\": \"" << hash
+                    << "\", \"crc32\": " << results[j].crc << "}";
+            }
+            out << "]";
+        }
+        out << "}" << (i + 1 < items.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return (bool)out;
+}
+
+static int usage() {
+    fprintf(stderr, "usage: asset_convert [-j N] [--colors N] [--encoding auto|raw|palette|rle] "
+                    "[--fit stretch|contain|cover] [--filter lanczos|box] [--wrap] [--cylinder <circumference>x<height>] "
+                    "-o <out dir> <image|directory|text|vec>...\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            opt.threads = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--colors" && i + 1 < argc) {
+            opt.colors = atoi(argv[++i]);
+        } else if (arg == "--encoding" && i + 1 < argc) {
+            opt.encoding = argv[++i];
+        } else if (arg == "--fit" && i + 1 < argc) {
+            std::string fit = argv[++i];
+            opt.resample.fit = fit == "contain" ? FIT_CONTAIN : fit == "cover" ? FIT_COVER : FIT_STRETCH;
+        } else if (arg == "--filter" && i + 1 < argc) {
+            opt.resample.filter = std::string(argv[++i]) == "box" ? FILTER_BOX : FILTER_LANCZOS3;
+        } else if (arg == "--wrap") {
+            opt.resample.wrap = true;
+        } else if (arg == "--cylinder" && i + 1 < argc) {
+            if (sscanf(argv[++i], "%lfx%lf", &opt.resample.circumference, &opt.resample.height) != 2
+                || opt.resample.circumference <= 0 || opt.resample.height <= 0) {
+                return usage();
+            }
+        } else if (arg == "-o" && i + 1 < argc) {
+            opt.outDir = argv[++i];
+        } else if (arg.compare(0, 1, "-") == 0) {
+            return usage();
+        } else {
+            opt.inputs.push_back(arg);
+        }
+    }
+    if (opt.outDir.empty() || opt.inputs.empty() || opt.colors < 2 || opt.colors > MAX_PALETTE_SIZE
+        || (opt.encoding != "auto" && opt.encoding != "raw" && opt.encoding != "palette" && opt.encoding != "rle")) {
+        return usage();
+    }
+
+    std::vector<ManifestItem> items;
+    std::vector<Job> jobs;
+    std::error_code ec;
+    auto taken = [&](const fs::path& input, const fs::path& path) {
+        for (const ManifestItem& item : items) {
+            if (item.path == path) {
+                fprintf(stderr, "asset_convert: %s and %s both become %s\n", item.source.string().c_str(),
+                        input.string().c_str(), path.generic_string().c_str());
+                return true;
+            }
+        }
+        return false;
+    };
+    for (const fs::path& input : opt.inputs) {
+        std::string name = input.has_filename() ? input.stem().string() : input.parent_path().filename().string();
+        if (fs::is_directory(input)) {
+            std::vector<fs::path> frames;
+            for (const fs::directory_entry& entry : fs::directory_iterator(input)) {
+                if (entry.is_regular_file() && isImageFile(entry.path())) {
+                    frames.push_back(entry.path());
+                }
+            }
+            std::sort(frames.begin(), frames.end());
+            if (frames.empty()) {
+                fprintf(stderr, "asset_convert: no frames in %s\n", input.string().c_str());
+                return 1;
+            }
+            fs::path dir = fs::path("video") / name;
+            if (taken(input, dir)) {
+                return 1;
+            }
+            fs::create_directories(opt.outDir / dir, ec);
+            items.push_back({"sequence", input, dir, jobs.size(), frames.size()});
+            for (size_t f = 0; f < frames.size(); f++) {
+                char file[32];
+                snprintf(file, sizeof(file), "%05zu.rgb", f);
+                jobs.push_back({JOB_FRAME, frames[f], opt.outDir / dir / file, items.size() - 1});
+            }
+        } else if (isImageFile(input)) {
+            fs::path path = fs::path("img") / (name + ".pimg");
+            if (taken(input, path)) {
+                return 1;
+            }
+            fs::create_directories(opt.outDir / "img", ec);
+            items.push_back({"image", input, path, jobs.size(), 1});
+            jobs.push_back({JOB_STILL, input, opt.outDir / path, items.size() - 1});
+        } else if (lower(input.extension().string()) == ".txt") {
+            fs::path path = fs::path("char") / (name + ".txt");
+            if (taken(input, path)) {
+                return 1;
+            }
+            fs::create_directories(opt.outDir / "char", ec);
+            items.push_back({"text", input, path, jobs.size(), 1});
+            jobs.push_back({JOB_TEXT, input, opt.outDir / path, items.size() - 1});
+        } else if (lower(input.extension().string()) == ".vec") {
+            fs::path path = fs::path("vec") / (name + ".pvec");
+            if (taken(input, path)) {
+                return 1;
+            }
+            fs::create_directories(opt.outDir / "vec", ec);
+            items.push_back({"vector", input, path, jobs.size(), 1});
+            jobs.push_back({JOB_VECTOR, input, opt.outDir / path, items.size() - 1});
+        } else {
+            fprintf(stderr, "asset_convert: don't know what to do with %s\n", input.string().c_str());
+            return 1;
+        }
+    }
+
+    // Workers take the next job until none are left, results land at the job's index
+    std::vector<JobResult> results(jobs.size());
+    std::atomic<size_t> next(0);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    unsigned threadCount = std::min<size_t>(opt.threads, jobs.size());
+    for (unsigned t = 0; t < threadCount; t++) {
+        workers.emplace_back([&]() {
+            for (size_t j = next++; j < jobs.size(); j = next++) {
+                runJob(jobs[j], opt, results[j]);
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t failed = 0;
+    for (size_t j = 0; j < jobs.size(); j++) {
+        if (!results[j].ok) {
+            fprintf(stderr, "asset_convert: %s: %s\n", jobs[j].source.string().c_str(), results[j].error.c_str());
+            failed++;
+        }
+    }
+    if (failed > 0 || !writeManifest(opt, items, jobs, results)) {
+        return 1;
+    }
+    printf("%zu items, %zu files in %.2f s on %u threads (%.0f files/s)\n", items.size(), jobs.size(), seconds,
+           threadCount, jobs.size() / (seconds > 0 ? seconds : 1e-9));
+    return 0;
+}
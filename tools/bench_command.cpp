@@ -0,0 +1,121 @@
+// Host benchmark for the command parser (src/command_parser.cpp).
+// Feeds BLE-sized chunks of WRITE/READ/LIST lines through CommandRing and
+// reports commands per second and heap allocations per command, next to the
+// substring-based splitting it replaced (std::string standing in for String).
+//
+//   bench_command [commands]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#include "command_parser.h"
+
+// Counting replacement for the global allocator. GCC flags the free() in the
+// inlined delete as mismatched, which it is not once new is replaced too.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+const size_t CHUNK = 20;  // default ATT payload, the worst case for reassembly
+
+// The old path: inputBuffer += chunk, indexOf('\n'), three substrings per command
+size_t legacySplit(const std::string& stream, size_t& checksum) {
+    std::string inputBuffer;
+    size_t commands = 0;
+    for (size_t pos = 0; pos < stream.size(); pos += CHUNK) {
+        inputBuffer += stream.substr(pos, CHUNK);
+        size_t newline = inputBuffer.find('\n');
+        while (newline != std::string::npos) {
+            std::string data = inputBuffer.substr(0, newline);
+            size_t firstColon = data.find(':');
+            size_t secondColon = data.find(':', firstColon + 1);
+            std::string command = data.substr(0, firstColon);
+            std::string fileName = data.substr(firstColon + 1, secondColon - firstColon - 1);
+            std::string content = data.substr(secondColon + 1);
+            checksum += command.size() + fileName.size() + content.size();
+            commands++;
+            inputBuffer = inputBuffer.substr(newline + 1);
+            newline = inputBuffer.find('\n');
+        }
+    }
+    return commands;
+}
+
+size_t ringSplit(CommandRing& ring, const std::string& stream, size_t& checksum) {
+    size_t commands = 0;
+    Command cmd;
+    for (size_t pos = 0; pos < stream.size(); pos += CHUNK) {
+        size_t len = stream.size() - pos < CHUNK ? stream.size() - pos : CHUNK;
+        const char* data = stream.data() + pos;
+        while (len > 0) {
+            size_t taken = ring.push(data, len);
+            data += taken;
+            len -= taken;
+            while (ring.next(cmd, 3)) {
+                checksum += cmd.verb.len + cmd.args[0].len + cmd.args[1].len;
+                commands++;
+            }
+        }
+    }
+    return commands;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+
+    std::string stream;
+    for (size_t i = 0; i < count; i++) {
+        switch (i % 3) {
+            case 0: stream += "WRITE:/char/" + std::to_string(i % 50) + ".txt:Hello: rotating text " + std::to_string(i) + "\n"; break;
+            case 1: stream += "READ:/char/" + std::to_string(i % 50) + ".txt:\n"; break;
+            default: stream += "LIST:/:\n"; break;
+        }
+    }
+
+    size_t legacySum = 0, ringSum = 0;
+    allocations = 0;
+    auto start = std::chrono::steady_clock::now();
+    size_t legacyCommands = legacySplit(stream, legacySum);
+    double legacySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t legacyAllocs = allocations;
+
+    CommandRing* ring = new CommandRing();
+    allocations = 0;
+    start = std::chrono::steady_clock::now();
+    size_t ringCommands = ringSplit(*ring, stream, ringSum);
+    double ringSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t ringAllocs = allocations;
+    delete ring;
+
+    printf("%zu commands in %zu-byte chunks\n", count, CHUNK);
+    printf("%-12s %14s %16s\n", "parser", "commands/s", "allocs/command");
+    printf("%-12s %14.0f %16.2f\n", "substring", legacyCommands / legacySeconds, (double)legacyAllocs / legacyCommands);
+    printf("%-12s %14.0f %16.2f\n", "ring", ringCommands / ringSeconds, (double)ringAllocs / ringCommands);
+
+    bool ok = legacyCommands == count && ringCommands == count && legacySum == ringSum && ringAllocs == 0;
+    if (!ok) {
+        printf("MISMATCH\n");
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,67 @@
+// Host benchmark for the procedural effects (src/effects.cpp).
+// Renders whole revolutions of every built-in effect at a moving time and
+// estimates what a column costs on the device against its time budget.
+//
+// The estimate converts host time to host clock cycles, measured with a
+// chain of dependent single-cycle operations, and assumes the host retires
+// HOST_IPC instructions per cycle where the in-order LX7 retires one.
+// 'b' in Effects mode times the same code on the device.
+//
+//   bench_effects [revolutions]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "effects.h"
+
+const double DEVICE_MHZ = 240;
+const double HOST_IPC = 2;
+
+// Nanoseconds per host clock cycle
+static double hostCycleNs() {
+    const long iterations = 50000000;
+    volatile uint32_t sink;
+    uint32_t x = 1;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) {
+        x = (x ^ (uint32_t)i) + 0x9e3779b9u;   // two dependent operations
+    }
+    sink = x;
+    (void)sink;
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return ns / (2.0 * iterations);
+}
+
+int main(int argc, char** argv) {
+    int revolutions = argc > 1 ? atoi(argv[1]) : 2000;
+    double cycleNs = hostCycleNs();
+    double budgetCycles = COLUMN_BUDGET_NS * DEVICE_MHZ / 1000;
+
+    printf("host %.0f MHz, budget %u ns = %.0f device cycles per column\n", 1000 / cycleNs, COLUMN_BUDGET_NS,
+           budgetCycles);
+    printf("%-14s %12s %16s %10s\n", "effect", "host ns/col", "device cycles/col", "of budget");
+    bool allOk = true;
+    uint32_t checksum = 0;
+    RGB column[HEIGHT];
+    for (size_t e = 0; e < BUILTIN_EFFECT_COUNT; e++) {
+        Effect* effect = builtinEffects[e];
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < revolutions; r++) {
+            // 40 revolutions a second, starting at 10:00
+            EffectTime time = {(uint32_t)r, (uint32_t)r * 25, (uint32_t)(10 * 3600000UL + r * 25)};
+            effect->prepare(time);
+            for (int x = 0; x < WIDTH; x++) {
+                effect->column(columnAngle(x), time, column);
+                checksum += column[x % HEIGHT].r + column[(x * 7) % HEIGHT].g;
+            }
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        double perColumn = ns / ((double)revolutions * WIDTH);
+        double deviceCycles = perColumn / cycleNs * HOST_IPC;
+        bool ok = deviceCycles <= budgetCycles;
+        printf("%-14s %12.1f %16.0f %9.0f%%%s\n", effect->name(), perColumn, deviceCycles,
+               100 * deviceCycles / budgetCycles, ok ? "" : "  OVER BUDGET");
+        allOk = allOk && ok;
+    }
+    printf("(checksum %u)\n", checksum);
+    return allOk ? 0 : 1;
+}
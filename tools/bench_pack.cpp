@@ -0,0 +1,70 @@
+// Host benchmark for the column pack kernels (src/column_pack.cpp).
+// Checks that packColumn gives exactly the words of packColumnReference for
+// random, saturated and single-LED columns, then reports columns per second
+// for both. Built twice: with the vector kernel of this CPU, and as
+// bench_pack_scalar with only the table kernel the device runs.
+//
+//   bench_pack [columns]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "column_pack.h"
+
+static double columnsPerSecond(void (*pack)(const RGB*, uint16_t*), const std::vector<RGB>& columns,
+                               size_t count, uint32_t& checksum) {
+    uint16_t wire[WIRE_WORDS];
+    size_t available = columns.size() / HEIGHT;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        pack(&columns[(i % available) * HEIGHT], wire);
+        checksum += wire[i % WIRE_WORDS];
+    }
+    return count / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool sameWords(const RGB* column) {
+    uint16_t expected[WIRE_WORDS], actual[WIRE_WORDS];
+    packColumnReference(column, expected);
+    memset(actual, 0xa5, sizeof(actual));
+    packColumn(column, actual);
+    return memcmp(expected, actual, sizeof(expected)) == 0;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000000;
+    initColumnPack();
+
+    // One full frame of random columns
+    std::vector<RGB> columns((size_t)WIDTH * HEIGHT);
+    uint32_t seed = 12345;
+    for (RGB& led : columns) {
+        seed = seed * 1103515245 + 12345;
+        led = {(uint8_t)(seed >> 24), (uint8_t)(seed >> 16), (uint8_t)(seed >> 8)};
+    }
+
+    size_t checked = 0, mismatched = 0;
+    for (int x = 0; x < WIDTH; x++, checked++) {
+        mismatched += !sameWords(&columns[(size_t)x * HEIGHT]);
+    }
+    std::vector<RGB> single(HEIGHT);
+    for (size_t byte = 0; byte < HEIGHT * 3; byte++, checked++) {
+        memset(single.data(), 0, HEIGHT * sizeof(RGB));
+        ((uint8_t*)single.data())[byte] = 0xff;
+        mismatched += !sameWords(single.data());
+    }
+    memset(single.data(), 0xff, HEIGHT * sizeof(RGB));
+    mismatched += !sameWords(single.data());
+    checked++;
+
+    uint32_t checksum = 0;
+    double reference = columnsPerSecond(packColumnReference, columns, count, checksum);
+    double fast = columnsPerSecond(packColumn, columns, count, checksum);
+    printf("%zu columns checked, %zu mismatched\n", checked, mismatched);
+    printf("%-10s %14.0f columns/s %8.1f ns/column\n", "reference", reference, 1e9 / reference);
+    printf("%-10s %14.0f columns/s %8.1f ns/column  %.2fx\n", columnPackKernel(), fast, 1e9 / fast,
+           fast / reference);
+    printf("(checksum %u)\n", checksum);
+    return mismatched == 0 ? 0 : 1;
+}
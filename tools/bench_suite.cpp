@@ -0,0 +1,471 @@
+// Host benchmark suite for the pure computation on the data path: packing,
+// the glyph atlas and palette lookups, image decode, text layout and
+// rasterization, command parsing, effects, vector scenes and the resampler.
+// Every kernel runs in isolation on synthetic content and reports its time
+// per unit (a display column, a frame or a command), frames per second where
+// that means something, and the bytes it allocates per run.
+//
+// Baselines are plain text, one kernel per line, and belong to the machine
+// they were taken on:
+//   bench_suite --save baseline.txt
+//   bench_suite --baseline baseline.txt [--tolerance 15]
+// fails (exit 1) when a kernel got slower than the tolerance in percent or
+// allocates more than before.
+//
+//   bench_suite [--filter <substring>] [--min-time <seconds>] [--save <file>]
+//               [--baseline <file>] [--tolerance <percent>]
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#ifdef BENCH_JPEG
+#include <jpeglib.h>
+#endif
+#include "column_pack.h"
+#include "command_parser.h"
+#include "effects.h"
+#include "font.h"
+#include "glyph_atlas.h"
+#include "image_codec.h"
+#include "image_resample.h"
+#include "text_layout.h"
+#include "text_render.h"
+#include "vector_scene.h"
+#include "vector_writer.h"
+
+// Allocation counting: every malloc while a kernel runs, glibc only
+static std::atomic<bool> counting(false);
+static std::atomic<uint64_t> allocatedBytes(0);
+
+#ifdef __GLIBC__
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* p, size_t size);
+
+void* malloc(size_t size) {
+    if (counting.load(std::memory_order_relaxed)) {
+        allocatedBytes += size;
+    }
+    return __libc_malloc(size);
+}
+void* calloc(size_t count, size_t size) {
+    if (counting.load(std::memory_order_relaxed)) {
+        allocatedBytes += count * size;
+    }
+    return __libc_calloc(count, size);
+}
+void* realloc(void* p, size_t size) {
+    if (counting.load(std::memory_order_relaxed)) {
+        allocatedBytes += size;
+    }
+    return __libc_realloc(p, size);
+}
+}
+const bool ALLOCATIONS_COUNTED = true;
+#else
+const bool ALLOCATIONS_COUNTED = false;
+#endif
+
+enum Unit {
+    PER_COLUMN,   // a run renders units display columns
+    PER_FRAME,    // a run produces units whole frames
+    PER_CALL      // a run makes units calls, no frame rate
+};
+
+struct Kernel {
+    std::string name;
+    Unit unit;
+    size_t units;                   // per run
+    std::function<void()> run;
+};
+
+struct Result {
+    double nsPerUnit;
+    double framesPerSecond;         // 0 for PER_CALL
+    uint64_t bytesPerRun;
+};
+
+static uint32_t checksum = 0;
+
+// Content shared by the kernels: a frame with gradients, flat areas and edges
+static std::vector<RGB> testFrame() {
+    std::vector<RGB> frame(IMAGE_PIXELS);
+    std::mt19937 rng(48);
+    for (int x = 0; x < WIDTH; x++) {
+        for (int y = 0; y < HEIGHT; y++) {
+            RGB& p = frame[(size_t)x * HEIGHT + y];
+            bool logo = (x - 157) * (x - 157) + (y - 93) * (y - 93) < 60 * 60;
+            p.r = logo ? 255 : (uint8_t)(x * 255 / WIDTH);
+            p.g = logo ? 200 : (uint8_t)(y * 255 / HEIGHT);
+            p.b = (x / 20 + y / 20) % 2 ? 40 : 0;
+            if (rng() % 50 == 0) {
+                p = {(uint8_t)rng(), (uint8_t)rng(), (uint8_t)rng()};
+            }
+        }
+    }
+    return frame;
+}
+
+// Palette and indices of the frame, colours reduced to 6 levels per channel
+static void indexFrame(const std::vector<RGB>& frame, std::vector<RGB>& palette, std::vector<uint8_t>& indices) {
+    std::map<uint32_t, uint8_t> lookup;
+    indices.resize(frame.size());
+    for (size_t i = 0; i < frame.size(); i++) {
+        RGB q = {(uint8_t)(frame[i].r / 51 * 51), (uint8_t)(frame[i].g / 51 * 51), (uint8_t)(frame[i].b / 51 * 51)};
+        uint32_t key = q.r << 16 | q.g << 8 | q.b;
+        auto it = lookup.find(key);
+        if (it == lookup.end()) {
+            it = lookup.insert({key, (uint8_t)palette.size()}).first;
+            palette.push_back(q);
+        }
+        indices[i] = it->second;
+    }
+}
+
+#ifdef BENCH_JPEG
+// The frame as a row-major JPEG, the form the asset converter reads stills in
+static std::vector<uint8_t> jpegOf(const std::vector<RGB>& frame) {
+    std::vector<uint8_t> rows((size_t)WIDTH * HEIGHT * 3);
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            memcpy(&rows[((size_t)y * WIDTH + x) * 3], &frame[(size_t)x * HEIGHT + y], 3);
+        }
+    }
+    jpeg_compress_struct c;
+    jpeg_error_mgr err;
+    c.err = jpeg_std_error(&err);
+    jpeg_create_compress(&c);
+    unsigned char* out = nullptr;
+    unsigned long outSize = 0;
+    jpeg_mem_dest(&c, &out, &outSize);
+    c.image_width = WIDTH;
+    c.image_height = HEIGHT;
+    c.input_components = 3;
+    c.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&c);
+    jpeg_set_quality(&c, 90, TRUE);
+    jpeg_start_compress(&c, TRUE);
+    while (c.next_scanline < c.image_height) {
+        JSAMPROW row = &rows[(size_t)c.next_scanline * WIDTH * 3];
+        jpeg_write_scanlines(&c, &row, 1);
+    }
+    jpeg_finish_compress(&c);
+    jpeg_destroy_compress(&c);
+    std::vector<uint8_t> jpeg(out, out + outSize);
+    free(out);
+    return jpeg;
+}
+
+static void decodeJpeg(const std::vector<uint8_t>& jpeg, std::vector<uint8_t>& rows) {
+    jpeg_decompress_struct d;
+    jpeg_error_mgr err;
+    d.err = jpeg_std_error(&err);
+    jpeg_create_decompress(&d);
+    jpeg_mem_src(&d, jpeg.data(), jpeg.size());
+    jpeg_read_header(&d, TRUE);
+    d.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&d);
+    rows.resize((size_t)d.output_width * d.output_height * 3);
+    while (d.output_scanline < d.output_height) {
+        JSAMPROW row = &rows[(size_t)d.output_scanline * d.output_width * 3];
+        jpeg_read_scanlines(&d, &row, 1);
+    }
+    jpeg_finish_decompress(&d);
+    jpeg_destroy_decompress(&d);
+}
+#endif
+
+static std::vector<Kernel> kernels() {
+    static std::vector<RGB> frame = testFrame();
+    static std::vector<RGB> decoded(IMAGE_PIXELS);
+    static uint16_t wire[WIRE_WORDS];
+    static RGB column[HEIGHT];
+    std::vector<Kernel> k;
+
+    initColumnPack();
+    k.push_back({std::string("pack_") + columnPackKernel(), PER_COLUMN, WIDTH, [] {
+        for (int x = 0; x < WIDTH; x++) {
+            packColumn(&frame[(size_t)x * HEIGHT], wire);
+            checksum += wire[x % WIRE_WORDS];
+        }
+    }});
+    k.push_back({"pack_reference", PER_COLUMN, WIDTH, [] {
+        for (int x = 0; x < WIDTH; x++) {
+            packColumnReference(&frame[(size_t)x * HEIGHT], wire);
+            checksum += wire[x % WIRE_WORDS];
+        }
+    }});
+
+    // Decode of every image encoding the device reads
+    static std::vector<RGB> palette;
+    static std::vector<uint8_t> indices;
+    indexFrame(frame, palette, indices);
+    static std::vector<uint8_t> raw(MAX_ENCODED_IMAGE_SIZE), pal(MAX_ENCODED_IMAGE_SIZE), rle(MAX_ENCODED_IMAGE_SIZE);
+    raw.resize(encodeImageRaw(frame.data(), raw.data()));
+    pal.resize(encodeImageIndexed(indices.data(), palette.data(), (uint16_t)palette.size(), IMAGE_PALETTE, pal.data()));
+    rle.resize(encodeImageIndexed(indices.data(), palette.data(), (uint16_t)palette.size(), IMAGE_RLE, rle.data()));
+    for (auto encoded : {std::make_pair("decode_raw", &raw), std::make_pair("decode_palette", &pal),
+                         std::make_pair("decode_rle", &rle)}) {
+        const std::vector<uint8_t>* data = encoded.second;
+        k.push_back({encoded.first, PER_FRAME, 1, [data] {
+            if (!decodeImage(data->data(), data->size(), decoded.data())) {
+                fprintf(stderr, "bench_suite: decode failed\n");
+                exit(1);
+            }
+            checksum += decoded[checksum % IMAGE_PIXELS].r;
+        }});
+    }
+#ifdef BENCH_JPEG
+    static std::vector<uint8_t> jpeg = jpegOf(frame);
+    static std::vector<uint8_t> jpegRows;
+    k.push_back({"decode_jpeg", PER_FRAME, 1, [] {
+        decodeJpeg(jpeg, jpegRows);
+        checksum += jpegRows[checksum % jpegRows.size()];
+    }});
+#endif
+
+    // Text: layout of a stored string, then its columns rasterized or looked up in the atlas
+    static const char text[] = "{#ffcc00}POV {#00ccff}display\n{2}{|}12:34 Hello, cylinder!";
+    static LayoutFonts fonts = {&font5x7, nullptr, false};
+    k.push_back({"text_layout", PER_FRAME, 1, [] {
+        TextLayout layout;
+        layoutText(layout, text, strlen(text), fonts, {255, 255, 255}, true);
+        checksum += layout.width;
+        freeTextLayout(layout);
+    }});
+    static TextLayout layout;
+    layoutText(layout, text, strlen(text), fonts, {255, 255, 255}, true);
+    k.push_back({"text_render", PER_COLUMN, WIDTH, [] {
+        const LayoutSpan* spans[8];
+        RGB spanColumn[HEIGHT];
+        for (int x = 0; x < WIDTH; x++) {
+            size_t n = layoutSpansAt(layout, x, spans, 8);
+            memset(column, 0, sizeof(column));
+            for (size_t i = 0; i < n; i++) {
+                renderStripColumn(spans[i]->strip, x - spans[i]->x, spanColumn);
+                for (int y = 0; y < HEIGHT; y++) {
+                    if (spanColumn[y].r | spanColumn[y].g | spanColumn[y].b) {
+                        column[y] = spanColumn[y];
+                    }
+                }
+            }
+            packColumn(column, wire);
+            checksum += wire[x % WIRE_WORDS];
+        }
+    }});
+    static GlyphAtlas atlas;
+    atlas.begin(GLYPH_ATLAS_ENTRIES);
+    k.push_back({"text_atlas", PER_COLUMN, WIDTH, [] {
+        const LayoutSpan* spans[8];
+        for (int x = 0; x < WIDTH; x++) {
+            size_t n = layoutSpansAt(layout, x, spans, 8);
+            if (n == 0) {
+                continue;
+            }
+            memcpy(wire, atlas.column(spans[0]->strip, x - spans[0]->x), sizeof(wire));
+            for (size_t i = 1; i < n; i++) {
+                orWireColumn(wire, atlas.column(spans[i]->strip, x - spans[i]->x));
+            }
+            checksum += wire[x % WIRE_WORDS];
+        }
+    }});
+
+    // Command lines as they arrive over serial and /cmd
+    static const char* const lines[] = {"n", "p", "time:12:34:56", "image:3:128", "spin:1:-256", "stats:reset",
+                                        "text:0", "trace:dump"};
+    k.push_back({"command_parse", PER_CALL, 8, [] {
+        Command cmd;
+        for (const char* line : lines) {
+            parseCommand(line, strlen(line), cmd);
+            checksum += cmd.argc + cmd.verb.len;
+        }
+    }});
+
+    // Columns generated on the fly
+    static EffectTime effectTime = {0, 0, 10 * 3600000UL};
+    for (size_t e = 0; e < BUILTIN_EFFECT_COUNT; e++) {
+        Effect* effect = builtinEffects[e];
+        std::string name = std::string("effect_") + effect->name();
+        std::replace(name.begin(), name.end(), ' ', '_');   // names are one word in baselines
+        k.push_back({name, PER_COLUMN, WIDTH, [effect] {
+            effect->prepare(effectTime);
+            for (int x = 0; x < WIDTH; x++) {
+                effect->column(columnAngle(x), effectTime, column);
+                checksum += column[x % HEIGHT].g;
+            }
+            effectTime.ms += 25;
+            effectTime.dayMs += 25;
+            effectTime.revolution++;
+        }});
+    }
+    static VectorScene scene;
+    VectorWriter w;
+    w.rect(-40, 20, 80, 40, {0, 0, 160});
+    w.arc(0, 93, 60, 0, 360, 8, false, {255, 255, 255});
+    w.arc(0, 93, 45, 45, 90, 0, true, {255, 0, 0});
+    w.line(-70, 93, 70, 93, 4, {0, 255, 0});
+    w.polygon({150, 20, 250, 40, 200, 160, 120, 120}, {255, 200, 0});
+    std::vector<uint8_t> bytes = w.scene();
+    scene.load(bytes.data(), bytes.size());
+    k.push_back({"vector_scene", PER_COLUMN, WIDTH, [] {
+        for (int x = 0; x < WIDTH; x++) {
+            scene.column(x, column);
+            checksum += column[x % HEIGHT].r;
+        }
+    }});
+
+    // Resampling a 640x360 still for the cylinder
+    static HostImage image;
+    image.width = 640;
+    image.height = 360;
+    image.rgb.resize((size_t)image.width * image.height * 3);
+    for (size_t i = 0; i < image.rgb.size(); i++) {
+        image.rgb[i] = (uint8_t)(i * 7 + i / 1920);
+    }
+    for (ResampleFilter filter : {FILTER_LANCZOS3, FILTER_BOX}) {
+        ResampleOptions options;
+        options.filter = filter;
+        k.push_back({filter == FILTER_LANCZOS3 ? "resample_lanczos3" : "resample_box", PER_FRAME, 1, [options] {
+            resampleToFrame(image, options, decoded.data());
+            checksum += decoded[checksum % IMAGE_PIXELS].b;
+        }});
+    }
+    return k;
+}
+
+// Best of three, each repeating the kernel for at least minTime
+static Result measure(const Kernel& kernel, double minTime) {
+    kernel.run();   // warm up: caches, lazily built tables
+    allocatedBytes = 0;
+    counting = true;
+    kernel.run();
+    counting = false;
+    uint64_t bytes = allocatedBytes;
+
+    double best = INFINITY;
+    for (int attempt = 0; attempt < 3; attempt++) {
+        size_t runs = 0;
+        auto start = std::chrono::steady_clock::now();
+        double elapsed;
+        do {
+            kernel.run();
+            runs++;
+            elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        } while (elapsed < minTime * 1e9);
+        best = std::min(best, elapsed / ((double)runs * kernel.units));
+    }
+    double fps = kernel.unit == PER_COLUMN ? 1e9 / (best * WIDTH) : kernel.unit == PER_FRAME ? 1e9 / best : 0;
+    return {best, fps, bytes};
+}
+
+static std::map<std::string, Result> loadBaseline(const char* path, bool& ok) {
+    std::map<std::string, Result> baseline;
+    std::ifstream in(path);
+    ok = (bool)in;
+    std::string name;
+    Result r;
+    while (in >> name >> r.nsPerUnit >> r.bytesPerRun) {
+        baseline[name] = r;
+    }
+    return baseline;
+}
+
+static int usage() {
+    fprintf(stderr, "usage: bench_suite [--filter <substring>] [--min-time <seconds>] [--save <file>] "
+                    "[--baseline <file>] [--tolerance <percent>]\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    const char* filter = "";
+    const char* savePath = nullptr;
+    const char* baselinePath = nullptr;
+    double minTime = 0.2;
+    double tolerance = 15;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return usage();
+        }
+        if (arg == "--filter") {
+            filter = argv[++i];
+        } else if (arg == "--min-time") {
+            minTime = atof(argv[++i]);
+        } else if (arg == "--save") {
+            savePath = argv[++i];
+        } else if (arg == "--baseline") {
+            baselinePath = argv[++i];
+        } else if (arg == "--tolerance") {
+            tolerance = atof(argv[++i]);
+        } else {
+            return usage();
+        }
+    }
+
+    std::map<std::string, Result> baseline;
+    if (baselinePath != nullptr) {
+        bool ok;
+        baseline = loadBaseline(baselinePath, ok);
+        if (!ok) {
+            fprintf(stderr, "bench_suite: cannot read %s\n", baselinePath);
+            return 1;
+        }
+    }
+    FILE* save = nullptr;
+    if (savePath != nullptr && (save = fopen(savePath, "w")) == nullptr) {
+        fprintf(stderr, "bench_suite: cannot write %s\n", savePath);
+        return 1;
+    }
+
+    const char* unitNames[] = {"column", "frame", "call"};
+    printf("%-20s %14s %10s %12s %10s\n", "kernel", "ns/unit", "unit", "frames/s", "bytes/run");
+    int regressions = 0;
+    for (const Kernel& kernel : kernels()) {
+        if (kernel.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        Result r = measure(kernel, minTime);
+        char fps[16] = "-";
+        if (r.framesPerSecond > 0) {
+            snprintf(fps, sizeof(fps), "%.0f", r.framesPerSecond);
+        }
+        char bytes[24] = "n/a";
+        if (ALLOCATIONS_COUNTED) {
+            snprintf(bytes, sizeof(bytes), "%llu", (unsigned long long)r.bytesPerRun);
+        }
+        printf("%-20s %14.1f %10s %12s %10s", kernel.name.c_str(), r.nsPerUnit, unitNames[kernel.unit], fps, bytes);
+        auto base = baseline.find(kernel.name);
+        if (base != baseline.end()) {
+            double change = 100 * (r.nsPerUnit / base->second.nsPerUnit - 1);
+            bool slower = change > tolerance;
+            bool allocates = ALLOCATIONS_COUNTED && r.bytesPerRun > base->second.bytesPerRun;
+            printf("  %+6.1f%%%s%s", change, slower ? "  SLOWER" : "", allocates ? "  ALLOCATES MORE" : "");
+            regressions += slower || allocates;
+        } else if (baselinePath != nullptr) {
+            printf("  (no baseline)");
+        }
+        printf("\n");
+        if (save != nullptr) {
+            fprintf(save, "%s %.3f %llu\n", kernel.name.c_str(), r.nsPerUnit, (unsigned long long)r.bytesPerRun);
+        }
+    }
+    if (save != nullptr) {
+        fclose(save);
+    }
+    printf("(checksum %u)\n", checksum);
+    if (regressions > 0) {
+        printf("%d kernels regressed against %s\n", regressions, baselinePath);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+// Host harness for the BLE transfer framing (src/transfer_frame.cpp).
+// Runs sender and receiver against a simulated link and reports the
+// effective payload bytes per second for several MTU / window settings.
+//
+// The link model: every connection interval each direction can carry a
+// fixed number of packets, and notifications/writes arrive in order.
+// Loss can be injected to exercise the go-back path: each DATA frame is
+// dropped with probability 1/n from a fixed seed, so runs are repeatable
+// without the loss lining up with the retransmit pattern.
+//
+//   bench_transfer [size_bytes] [loss_one_in_n]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <vector>
+#include "transfer_frame.h"
+
+const double CONNECTION_INTERVAL_S = 0.0075;  // 7.5 ms, the shortest BLE allows
+const int PACKETS_PER_EVENT = 6;              // per direction, typical for phones with DLE
+const int TIMEOUT_EVENTS = 40;
+const long MAX_EVENTS = 10000000;             // a run still going after this is reported as given up
+
+struct Queue : public TransferLink {
+    std::deque<std::vector<uint8_t>> packets;
+    void send(const uint8_t* frame, size_t len) override {
+        packets.emplace_back(frame, frame + len);
+    }
+};
+
+struct MemorySink : public TransferSink {
+    std::vector<uint8_t> data;
+    bool closedOk = false;
+    bool open(const char*, uint32_t totalLength) override {
+        data.clear();
+        data.reserve(totalLength);
+        return true;
+    }
+    bool write(const uint8_t* bytes, size_t len) override {
+        data.insert(data.end(), bytes, bytes + len);
+        return true;
+    }
+    void close(bool ok) override { closedOk = ok; }
+};
+
+struct MemorySource : public TransferSource {
+    const std::vector<uint8_t>& data;
+    explicit MemorySource(const std::vector<uint8_t>& data) : data(data) {}
+    size_t read(uint32_t offset, uint8_t* dst, size_t len) override {
+        if (offset > data.size()) {
+            return 0;
+        }
+        size_t n = data.size() - offset < len ? data.size() - offset : len;
+        memcpy(dst, data.data() + offset, n);
+        return n;
+    }
+};
+
+struct Result {
+    bool ok;
+    bool gaveUp;
+    long events;
+    long packets;
+    long dropped;
+    double cpuSeconds;
+};
+
+Result run(const std::vector<uint8_t>& payload, uint16_t mtu, uint16_t window, int lossEvery) {
+    Queue toDevice, toHost;
+    MemorySink sink;
+    MemorySource source(payload);
+    TransferReceiver receiver(sink, toHost);
+    TransferSender sender(source, toDevice);
+    Result result = {false, false, 0, 0, 0, 0};
+    std::mt19937 loss(mtu * 131u + window);
+
+    auto start = std::chrono::steady_clock::now();
+    sender.begin("/bench.bin", payload.size(), mtu, window);
+    int idle = 0;
+    while (!sender.done() && result.events < MAX_EVENTS) {
+        result.events++;
+        bool progress = false;
+        for (int i = 0; i < PACKETS_PER_EVENT && !toDevice.packets.empty(); i++) {
+            std::vector<uint8_t> frame = std::move(toDevice.packets.front());
+            toDevice.packets.pop_front();
+            result.packets++;
+            if (lossEvery > 0 && frame[0] == FRAME_DATA && loss() % lossEvery == 0) {
+                result.dropped++;
+                continue;
+            }
+            receiver.onFrame(frame.data(), frame.size());
+            progress = true;
+        }
+        for (int i = 0; i < PACKETS_PER_EVENT && !toHost.packets.empty(); i++) {
+            std::vector<uint8_t> frame = std::move(toHost.packets.front());
+            toHost.packets.pop_front();
+            result.packets++;
+            sender.onFrame(frame.data(), frame.size());
+            progress = true;
+        }
+        if (progress) {
+            idle = 0;
+        } else if (++idle >= TIMEOUT_EVENTS) {
+            sender.onTimeout();
+            idle = 0;
+        }
+    }
+    result.cpuSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.gaveUp = !sender.done();
+    result.ok = sender.done() && sender.status() == TRANSFER_OK && sink.closedOk && sink.data == payload;
+    return result;
+}
+
+int main(int argc, char** argv) {
+    size_t size = argc > 1 ? strtoul(argv[1], nullptr, 10) : 175 * 1024;
+    int lossEvery = argc > 2 ? atoi(argv[2]) : 0;
+
+    std::vector<uint8_t> payload(size);
+    uint32_t seed = 12345;
+    for (auto& b : payload) {
+        seed = seed * 1103515245 + 12345;
+        b = seed >> 24;
+    }
+
+    const uint16_t mtus[] = {23, 185, 247, 517};
+    const uint16_t windows[] = {1, 4, 8, 16, 32};
+    printf("payload %zu bytes, loss of 1 in %d DATA frames\n", size, lossEvery);
+    printf("%5s %6s %12s %10s %8s %14s\n", "mtu", "window", "link B/s", "packets", "dropped", "framing MB/s");
+
+    bool allOk = true;
+    for (uint16_t mtu : mtus) {
+        for (uint16_t window : windows) {
+            Result r = run(payload, mtu, window, lossEvery);
+            double linkSeconds = r.events * CONNECTION_INTERVAL_S;
+            printf("%5u %6u %12.0f %10ld %8ld %14.1f%s\n", mtu, window, size / linkSeconds, r.packets, r.dropped,
+                   size / r.cpuSeconds / 1e6, r.ok ? "" : r.gaveUp ? "  GAVE UP" : "  FAILED");
+            allOk = allOk && r.ok;
+        }
+    }
+    return allOk ? 0 : 1;
+}
@@ -0,0 +1,340 @@
+// Host test and benchmark for the vector scene rasterizer (src/vector_scene.cpp).
+// Random scenes, and one drawn across the seam of the cylinder, are rendered
+// column by column and compared with a reference that tests every pixel
+// centre against the exact shapes. Arcs become polygons and coordinates are
+// 1/16 LED, so the two may only disagree on pixels within BOUNDARY_LEDS of
+// an edge. Then times a revolution against the column budget.
+//
+//   bench_vector [scenes]
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "effects.h"
+#include "vector_scene.h"
+#include "vector_writer.h"
+
+const double BOUNDARY_LEDS = 0.5;
+
+struct RefShape {
+    int type;
+    bool filled;
+    RGB color;
+    std::vector<double> v;   // LEDs, in the order of the scene format
+};
+
+// Decodes a scene back into shapes, in LEDs
+static std::vector<RefShape> parseScene(const std::vector<uint8_t>& scene) {
+    std::vector<RefShape> shapes;
+    auto get16 = [&](size_t at) { return (int16_t)(scene[at] | (scene[at + 1] << 8)); };
+    size_t count = (uint16_t)get16(6);
+    size_t at = VECTOR_HEADER_SIZE;
+    for (size_t s = 0; s < count; s++) {
+        RefShape shape;
+        shape.type = scene[at];
+        shape.filled = scene[at + 1] & VECTOR_FILLED;
+        shape.color = {scene[at + 2], scene[at + 3], scene[at + 4]};
+        at += 5;
+        size_t values = shape.type == VECTOR_LINE ? 5 : shape.type == VECTOR_RECT ? 4 : 6;
+        if (shape.type == VECTOR_POLYGON) {
+            values = 2 * scene[at++];
+        }
+        for (size_t i = 0; i < values; i++, at += 2) {
+            bool unsignedValue = (shape.type == VECTOR_LINE && i == 4) || (shape.type == VECTOR_ARC && i >= 2);
+            int v = unsignedValue ? (uint16_t)get16(at) : get16(at);
+            bool angle = shape.type == VECTOR_ARC && (i == 3 || i == 4);
+            shape.v.push_back(angle ? v : v / 16.0);
+        }
+        shapes.push_back(shape);
+    }
+    return shapes;
+}
+
+static bool insideOnce(const RefShape& s, double x, double y) {
+    const std::vector<double>& v = s.v;
+    switch (s.type) {
+        case VECTOR_LINE: {
+            double half = v[4] < 1 ? 0.5 : v[4] / 2;
+            double dx = v[2] - v[0], dy = v[3] - v[1];
+            double length = std::hypot(dx, dy);
+            if (length == 0) {
+                return std::fabs(x - v[0]) < half && std::fabs(y - v[1]) < half;
+            }
+            double along = ((x - v[0]) * dx + (y - v[1]) * dy) / length;
+            double across = ((x - v[0]) * dy - (y - v[1]) * dx) / length;
+            return along > 0 && along < length && std::fabs(across) < half;
+        }
+        case VECTOR_RECT: {
+            double x0 = std::min(v[0], v[0] + v[2]), x1 = std::max(v[0], v[0] + v[2]);
+            double y0 = std::min(v[1], v[1] + v[3]), y1 = std::max(v[1], v[1] + v[3]);
+            return x > x0 && x < x1 && y > y0 && y < y1;
+        }
+        case VECTOR_POLYGON: {
+            bool in = false;
+            size_t n = v.size() / 2;
+            for (size_t i = 0, j = n - 1; i < n; j = i++) {
+                double xi = v[2 * i], yi = v[2 * i + 1], xj = v[2 * j], yj = v[2 * j + 1];
+                if ((xi > x) != (xj > x) && y < yi + (x - xi) * (yj - yi) / (xj - xi)) {
+                    in = !in;
+                }
+            }
+            return in;
+        }
+        case VECTOR_ARC: {
+            double dx = x - v[0], dy = y - v[1];
+            double r = std::hypot(dx, dy);
+            double half = v[5] < 1 ? 0.5 : v[5] / 2;
+            if (s.filled ? r >= v[2] : std::fabs(r - v[2]) >= half) {
+                return false;
+            }
+            if (v[4] == 0) {
+                return true;
+            }
+            // Clockwise from 12 o'clock, in 1/65536 turns
+            double angle = std::atan2(dx, -dy) / (2 * M_PI) * 65536;
+            double fromStart = std::fmod(angle - v[3] + 2 * 65536, 65536);
+            return fromStart < v[4];
+        }
+    }
+    return false;
+}
+
+// Even-odd over the copies of the shape around the cylinder
+static bool inside(const RefShape& s, double x, double y) {
+    bool in = false;
+    for (int turn = -8; turn <= 8; turn++) {
+        in ^= insideOnce(s, x + turn * WIDTH, y);
+    }
+    return in;
+}
+
+static RGB referencePixel(const std::vector<RefShape>& shapes, double x, double y) {
+    RGB color = {0, 0, 0};
+    for (const RefShape& s : shapes) {
+        if (inside(s, x, y)) {
+            color = s.color;
+        }
+    }
+    return color;
+}
+
+static double segmentDistance(double x, double y, double ax, double ay, double bx, double by) {
+    double dx = bx - ax, dy = by - ay;
+    double lengthSquared = dx * dx + dy * dy;
+    double t = lengthSquared == 0 ? 0 : ((x - ax) * dx + (y - ay) * dy) / lengthSquared;
+    t = t < 0 ? 0 : t > 1 ? 1 : t;
+    return std::hypot(ax + t * dx - x, ay + t * dy - y);
+}
+
+static double outlineDistance(const std::vector<double>& points, double x, double y) {
+    double d = INFINITY;
+    size_t n = points.size() / 2;
+    for (size_t i = 0, j = n - 1; i < n; j = i++) {
+        d = std::min(d, segmentDistance(x, y, points[2 * j], points[2 * j + 1], points[2 * i], points[2 * i + 1]));
+    }
+    return d;
+}
+
+// Distance from the point to the outline of one copy of the shape
+static double boundaryDistance(const RefShape& s, double x, double y) {
+    const std::vector<double>& v = s.v;
+    switch (s.type) {
+        case VECTOR_LINE: {
+            double half = v[4] < 1 ? 0.5 : v[4] / 2;
+            double dx = v[2] - v[0], dy = v[3] - v[1];
+            double length = std::hypot(dx, dy);
+            if (length == 0) {
+                return outlineDistance({v[0] - half, v[1] - half, v[0] + half, v[1] - half, v[0] + half, v[1] + half,
+                                        v[0] - half, v[1] + half},
+                                       x, y);
+            }
+            double nx = -dy * half / length, ny = dx * half / length;
+            return outlineDistance({v[0] + nx, v[1] + ny, v[2] + nx, v[3] + ny, v[2] - nx, v[3] - ny, v[0] - nx,
+                                    v[1] - ny},
+                                   x, y);
+        }
+        case VECTOR_RECT:
+            return outlineDistance({v[0], v[1], v[0] + v[2], v[1], v[0] + v[2], v[1] + v[3], v[0], v[1] + v[3]}, x, y);
+        case VECTOR_POLYGON:
+            return outlineDistance(v, x, y);
+        case VECTOR_ARC: {
+            double half = v[5] < 1 ? 0.5 : v[5] / 2;
+            double outer = s.filled ? v[2] : v[2] + half, inner = s.filled ? 0 : v[2] - half;
+            double r = std::hypot(x - v[0], y - v[1]);
+            double d = std::min(std::fabs(r - outer), inner > 0 ? std::fabs(r - inner) : INFINITY);
+            if (v[4] != 0) {
+                for (double angle : {v[3], v[3] + v[4]}) {
+                    double a = angle / 65536 * 2 * M_PI;
+                    double inr = inner > 0 ? inner : 0;
+                    d = std::min(d, segmentDistance(x, y, v[0] + inr * std::sin(a), v[1] - inr * std::cos(a),
+                                                    v[0] + outer * std::sin(a), v[1] - outer * std::cos(a)));
+                }
+            }
+            return d;
+        }
+    }
+    return INFINITY;
+}
+
+// True if some shape's outline passes within BOUNDARY_LEDS of the point
+static bool nearBoundary(const std::vector<RefShape>& shapes, double x, double y) {
+    for (const RefShape& s : shapes) {
+        for (int turn = -8; turn <= 8; turn++) {
+            if (boundaryDistance(s, x + turn * WIDTH, y) < BOUNDARY_LEDS) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static bool sameColor(RGB a, RGB b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+static RGB randomColor(std::mt19937& rng) {
+    return {(uint8_t)(1 + rng() % 255), (uint8_t)(rng() % 256), (uint8_t)(rng() % 256)};
+}
+
+static std::vector<uint8_t> randomScene(std::mt19937& rng) {
+    std::uniform_real_distribution<double> anyX(-20, WIDTH + 20), anyY(-10, HEIGHT + 10), size(2, 70);
+    VectorWriter w;
+    int shapes = 4 + rng() % 20;
+    for (int i = 0; i < shapes; i++) {
+        double x = anyX(rng), y = anyY(rng);
+        switch (rng() % 4) {
+            case 0:
+                w.line(x, y, x + size(rng) - 36, y + size(rng) - 36, rng() % 6, randomColor(rng));
+                break;
+            case 1:
+                w.rect(x, y, size(rng), size(rng), randomColor(rng));
+                break;
+            case 2: {
+                std::vector<double> points;
+                int n = 3 + rng() % 8;
+                for (int p = 0; p < n; p++) {
+                    points.push_back(x + size(rng));
+                    points.push_back(y + size(rng));
+                }
+                w.polygon(points, randomColor(rng));
+                break;
+            }
+            default: {
+                double sweep = rng() % 3 == 0 ? 360 : rng() % 360;
+                w.arc(x, y, size(rng) / 2, rng() % 360, sweep, 1 + rng() % 8, rng() % 2 == 0, randomColor(rng));
+                break;
+            }
+        }
+    }
+    return w.scene();
+}
+
+// A logo across column 0: ring, cross, a sector and a triangle
+static std::vector<uint8_t> seamScene() {
+    VectorWriter w;
+    w.rect(-40, 20, 80, 40, {0, 0, 160});
+    w.arc(0, 93, 60, 0, 360, 8, false, {255, 255, 255});
+    w.arc(0, 93, 45, 45, 90, 0, true, {255, 0, 0});
+    w.line(-70, 93, 70, 93, 4, {0, 255, 0});
+    w.line(0, 20, 0, 166, 4, {0, 255, 0});
+    w.polygon({-30, 150, 30, 150, 0, 180}, {255, 200, 0});
+    return w.scene();
+}
+
+// Compares every pixel of the scene, the number of mismatches away from edges
+static size_t check(const std::vector<uint8_t>& scene, VectorScene& vectors, size_t& boundary) {
+    if (!vectors.load(scene.data(), scene.size())) {
+        return 1;
+    }
+    std::vector<RefShape> shapes = parseScene(scene);
+    size_t errors = 0;
+    RGB column[HEIGHT];
+    for (int x = 0; x < WIDTH; x++) {
+        vectors.column(x, column);
+        for (int y = 0; y < HEIGHT; y++) {
+            if (sameColor(column[y], referencePixel(shapes, x + 0.5, y + 0.5))) {
+                continue;
+            }
+            if (nearBoundary(shapes, x + 0.5, y + 0.5)) {
+                boundary++;
+            } else {
+                if (errors < 5) {
+                    printf("  mismatch at column %d row %d\n", x, y);
+                }
+                errors++;
+            }
+        }
+    }
+    return errors;
+}
+
+int main(int argc, char** argv) {
+    int scenes = argc > 1 ? atoi(argv[1]) : 100;
+    std::mt19937 rng(43);
+    VectorScene vectors;
+
+    // Malformed scenes must be refused
+    std::vector<uint8_t> good = seamScene();
+    bool refused = true;
+    for (size_t cut = 0; cut < good.size(); cut++) {
+        refused = refused && !vectors.load(good.data(), cut);
+    }
+    std::vector<uint8_t> badType = good;
+    badType[VECTOR_HEADER_SIZE] = 9;
+    refused = refused && !vectors.load(badType.data(), badType.size());
+    printf("malformed scenes %s\n", refused ? "refused" : "ACCEPTED");
+
+    // Scenes the column scan cannot hold must be refused too: more than
+    // MAX_ACTIVE_EDGES edges over one column, or an edge too steep for 16.16
+    VectorWriter full, over, steep;
+    for (size_t i = 0; i <= MAX_ACTIVE_EDGES / 2; i++) {
+        if (i < MAX_ACTIVE_EDGES / 2) {
+            full.rect(10, i, 4, 0.5, {255, 0, 0});   // two edges over columns 10 to 13
+        }
+        over.rect(10, i, 4, 0.5, {255, 0, 0});
+    }
+    steep.polygon({10, -2000, 10.0625, 2000, 10, 2000}, {255, 0, 0});
+    std::vector<uint8_t> fullScene = full.scene(), overScene = over.scene(), steepScene = steep.scene();
+    bool limits = validVectorScene(fullScene.data(), fullScene.size()) && vectors.load(fullScene.data(), fullScene.size())
+                  && !validVectorScene(overScene.data(), overScene.size()) && !vectors.load(overScene.data(), overScene.size())
+                  && !validVectorScene(steepScene.data(), steepScene.size());
+    printf("scenes over the scan limits %s\n", limits ? "refused" : "MISHANDLED");
+    refused = refused && limits;
+
+    size_t errors = 0, boundary = 0, pixels = 0;
+    errors += check(good, vectors, boundary);
+    pixels += WIDTH * HEIGHT;
+    printf("seam scene: %zu bytes, %zu edges\n", good.size(), vectors.edgeCount());
+    for (int s = 0; s < scenes; s++) {
+        std::vector<uint8_t> scene = randomScene(rng);
+        size_t e = check(scene, vectors, boundary);
+        if (e != 0) {
+            printf("random scene %d: %zu mismatches\n", s, e);
+        }
+        errors += e;
+        pixels += WIDTH * HEIGHT;
+    }
+    printf("%d scenes: %zu mismatches, %zu boundary pixels differ (%.3f%%)\n", scenes + 1, errors, boundary,
+           100.0 * boundary / pixels);
+
+    // Timing: the seam scene, one revolution after another
+    vectors.load(good.data(), good.size());
+    const int revolutions = 5000;
+    uint32_t checksum = 0;
+    RGB column[HEIGHT];
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < revolutions; r++) {
+        for (int x = 0; x < WIDTH; x++) {
+            vectors.column(x, column);
+            checksum += column[(x * 7) % HEIGHT].g;
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    double perColumn = ns / ((double)revolutions * WIDTH);
+    printf("seam scene: %.1f ns/column on the host, budget %u ns on the device (checksum %u)\n", perColumn,
+           COLUMN_BUDGET_NS, checksum);
+
+    return refused && errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,568 @@
+// Converts a BDF or TrueType font into the column-major tables of src/font.h.
+//
+//   font_compiler [--range 0x20-0x7e] [--spacing N] [--line-gap N] [--aa] <font> <height> <name> <out.cpp>
+//   font_compiler --store [--range 0x20-0x9fff] <font> <height> <out.bin>
+//
+// Writes a const Font <name> with 1 bit glyphs and, with --aa, <name>AA with
+// 4 bit coverage. Every table is constexpr so it lands in flash (rodata).
+// BDF fonts are used at their own size, <height> has to match ascent + descent.
+// TrueType fonts are scaled until ascent + descent fits <height> and carry
+// their kerning pairs. --spacing takes that many columns off every advance
+// and stores them as the font's spacing instead.
+// --store writes a compressed glyph store for the flash partition instead of
+// tables (src/glyph_store.h), for fonts too large to compile in.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifdef HAVE_FREETYPE
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#endif
+#include "glyph_store.h"
+
+struct GlyphImage {
+    int width = 0;                  // columns, after spacing was taken off
+    std::vector<uint8_t> coverage;  // width * height, column-major, 0..255
+};
+
+struct KernEntry {
+    uint32_t left;
+    uint32_t right;
+    int adjust;
+};
+
+struct FontImage {
+    int height = 0;
+    int ascent = 0;
+    int descent = 0;
+    int lineGap = 0;
+    uint32_t first = 0;
+    std::vector<GlyphImage> glyphs;  // first .. first + size - 1, width 0 if missing
+    std::vector<KernEntry> kerning;
+};
+
+struct Options {
+    uint32_t first = 0x20;
+    uint32_t last = 0x7e;
+    int spacing = 0;
+    int lineGap = -1;  // -1 = take it from the font
+    bool antiAliased = false;
+    bool store = false;
+    std::string fontPath;
+    int height = 0;
+    std::string name;
+    std::string outPath;
+};
+
+static bool endsWith(const std::string& s, const char* suffix) {
+    size_t n = strlen(suffix);
+    if (s.size() < n) {
+        return false;
+    }
+    std::string tail = s.substr(s.size() - n);
+    std::transform(tail.begin(), tail.end(), tail.begin(), ::tolower);
+    return tail == suffix;
+}
+
+// Glyph cell `advance` columns wide, pixels outside it are clipped
+static GlyphImage blankGlyph(int advance, int height) {
+    GlyphImage glyph;
+    glyph.width = advance > 0 ? advance : 0;
+    glyph.coverage.assign(glyph.width * height, 0);
+    return glyph;
+}
+
+static void plot(GlyphImage& glyph, int height, int x, int y, uint8_t value) {
+    if (x >= 0 && x < glyph.width && y >= 0 && y < height) {
+        glyph.coverage[x * height + y] = value;
+    }
+}
+
+static bool loadBdf(const Options& opt, FontImage& font, std::string& error) {
+    std::ifstream in(opt.fontPath);
+    if (!in) {
+        error = "cannot open " + opt.fontPath;
+        return false;
+    }
+    font.first = opt.first;
+    font.glyphs.assign(opt.last - opt.first + 1, GlyphImage());
+
+    bool haveAscent = false;
+    bool haveDescent = false;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream words(line);
+        std::string key;
+        words >> key;
+        if (key == "FONT_ASCENT") {
+            words >> font.ascent;
+            haveAscent = true;
+        } else if (key == "FONT_DESCENT") {
+            words >> font.descent;
+            haveDescent = true;
+        } else if (key == "STARTCHAR") {
+            if (!haveAscent || !haveDescent) {
+                error = "FONT_ASCENT/FONT_DESCENT missing before the first glyph";
+                return false;
+            }
+            font.height = font.ascent + font.descent;
+            if (font.height != opt.height) {
+                error = "BDF font is " + std::to_string(font.height) + " rows, asked for "
+                        + std::to_string(opt.height);
+                return false;
+            }
+            long encoding = -1;
+            int advance = 0;
+            int w = 0, h = 0, xoff = 0, yoff = 0;
+            while (std::getline(in, line) && line.compare(0, 6, "BITMAP") != 0) {
+                std::istringstream charWords(line);
+                charWords >> key;
+                if (key == "ENCODING") {
+                    charWords >> encoding;
+                } else if (key == "DWIDTH") {
+                    charWords >> advance;
+                } else if (key == "BBX") {
+                    charWords >> w >> h >> xoff >> yoff;
+                }
+            }
+            std::vector<std::string> rows;
+            while (std::getline(in, line) && line.compare(0, 7, "ENDCHAR") != 0) {
+                rows.push_back(line);
+            }
+            if (encoding < (long)opt.first || encoding > (long)opt.last) {
+                continue;
+            }
+            GlyphImage glyph = blankGlyph(advance, font.height);
+            // BBX y offset is from the baseline up to the bottom of the box
+            int top = font.ascent - (yoff + h);
+            for (int r = 0; r < h && r < (int)rows.size(); r++) {
+                for (int c = 0; c < w; c++) {
+                    size_t digit = c / 4;
+                    if (digit >= rows[r].size()) {
+                        break;
+                    }
+                    int nibble = (int)strtol(rows[r].substr(digit, 1).c_str(), nullptr, 16);
+                    if (nibble & (8 >> (c % 4))) {
+                        plot(glyph, font.height, xoff + c, top + r, 255);
+                    }
+                }
+            }
+            font.glyphs[encoding - opt.first] = glyph;
+        }
+    }
+    if (!haveAscent || !haveDescent) {
+        error = "not a BDF font: " + opt.fontPath;
+        return false;
+    }
+    font.lineGap = opt.lineGap >= 0 ? opt.lineGap : 0;
+    return true;
+}
+
+#ifdef HAVE_FREETYPE
+static int ceil26_6(long v) {
+    return (int)((v + 63) >> 6);
+}
+
+static bool loadTtf(const Options& opt, bool antiAliased, FontImage& font, std::string& error) {
+    FT_Library library;
+    FT_Face face;
+    if (FT_Init_FreeType(&library) != 0) {
+        error = "FreeType init failed";
+        return false;
+    }
+    if (FT_New_Face(library, opt.fontPath.c_str(), 0, &face) != 0) {
+        FT_Done_FreeType(library);
+        error = "cannot open " + opt.fontPath;
+        return false;
+    }
+
+    // Largest em size whose ascent + descent fits the requested height
+    int em = opt.height;
+    for (; em > 0; em--) {
+        FT_Set_Pixel_Sizes(face, 0, em);
+        font.ascent = ceil26_6(face->size->metrics.ascender);
+        font.descent = ceil26_6(-face->size->metrics.descender);
+        if (font.ascent + font.descent <= opt.height) {
+            break;
+        }
+    }
+    if (em == 0) {
+        FT_Done_Face(face);
+        FT_Done_FreeType(library);
+        error = "font does not fit in " + std::to_string(opt.height) + " rows";
+        return false;
+    }
+    font.ascent += opt.height - (font.ascent + font.descent);  // pad on top to the exact height
+    font.height = opt.height;
+    int naturalGap = ceil26_6(face->size->metrics.height) - font.height;
+    font.lineGap = opt.lineGap >= 0 ? opt.lineGap : std::max(naturalGap, 0);
+    font.first = opt.first;
+    font.glyphs.assign(opt.last - opt.first + 1, GlyphImage());
+
+    FT_Int32 loadFlags = antiAliased ? FT_LOAD_RENDER : FT_LOAD_RENDER | FT_LOAD_TARGET_MONO;
+    for (uint32_t cp = opt.first; cp <= opt.last; cp++) {
+        FT_UInt index = FT_Get_Char_Index(face, cp);
+        if (index == 0 || FT_Load_Glyph(face, index, loadFlags) != 0) {
+            continue;
+        }
+        FT_GlyphSlot slot = face->glyph;
+        const FT_Bitmap& bitmap = slot->bitmap;
+        GlyphImage glyph = blankGlyph(ceil26_6(slot->advance.x), font.height);
+        int top = font.ascent - slot->bitmap_top;
+        for (unsigned r = 0; r < bitmap.rows; r++) {
+            const uint8_t* row = bitmap.buffer + r * bitmap.pitch;
+            for (unsigned c = 0; c < bitmap.width; c++) {
+                uint8_t value;
+                if (bitmap.pixel_mode == FT_PIXEL_MODE_MONO) {
+                    value = (row[c / 8] & (0x80 >> (c % 8))) ? 255 : 0;
+                } else {
+                    value = row[c];
+                }
+                if (value != 0) {
+                    plot(glyph, font.height, slot->bitmap_left + c, top + r, value);
+                }
+            }
+        }
+        font.glyphs[cp - opt.first] = glyph;
+    }
+
+    // Every pair in the range; beyond a few thousand glyphs that gets slow and large
+    if (FT_HAS_KERNING(face) && !opt.store && opt.last - opt.first < 1024) {
+        for (uint32_t left = opt.first; left <= opt.last; left++) {
+            FT_UInt leftIndex = FT_Get_Char_Index(face, left);
+            if (leftIndex == 0) {
+                continue;
+            }
+            for (uint32_t right = opt.first; right <= opt.last; right++) {
+                FT_UInt rightIndex = FT_Get_Char_Index(face, right);
+                FT_Vector delta;
+                if (rightIndex == 0 || FT_Get_Kerning(face, leftIndex, rightIndex, FT_KERNING_DEFAULT, &delta) != 0) {
+                    continue;
+                }
+                int adjust = (int)((delta.x + 32) >> 6);
+                if (adjust != 0) {
+                    font.kerning.push_back({left, right, std::max(-128, std::min(127, adjust))});
+                }
+            }
+        }
+    }
+    FT_Done_Face(face);
+    FT_Done_FreeType(library);
+    return true;
+}
+#endif
+
+static bool loadFont(const Options& opt, bool antiAliased, FontImage& font, std::string& error) {
+    if (endsWith(opt.fontPath, ".bdf")) {
+        return loadBdf(opt, font, error);
+    }
+#ifdef HAVE_FREETYPE
+    return loadTtf(opt, antiAliased, font, error);
+#else
+    (void)antiAliased;
+    error = "built without FreeType, only BDF fonts are supported";
+    return false;
+#endif
+}
+
+// Moves `spacing` columns from the end of every glyph into Font.spacing
+static void takeSpacing(FontImage& font, int spacing) {
+    for (GlyphImage& glyph : font.glyphs) {
+        if (glyph.width == 0) {
+            continue;
+        }
+        int keep = std::max(glyph.width - spacing, 0);
+        for (size_t i = keep * font.height; i < glyph.coverage.size(); i++) {
+            if (glyph.coverage[i] != 0) {
+                fprintf(stderr, "warning: --spacing %d clips lit pixels\n", spacing);
+                break;
+            }
+        }
+        glyph.width = keep;
+        glyph.coverage.resize(keep * font.height);
+    }
+}
+
+static std::vector<uint8_t> packColumn(const uint8_t* coverage, int height, int bitsPerPixel) {
+    std::vector<uint8_t> bytes((height * bitsPerPixel + 7) / 8, 0);
+    for (int y = 0; y < height; y++) {
+        if (bitsPerPixel == 1) {
+            if (coverage[y] >= 128) {
+                bytes[y / 8] |= 1 << (y % 8);
+            }
+        } else {
+            int level = (coverage[y] * 15 + 127) / 255;
+            bytes[y / 2] |= level << (4 * (y % 2));
+        }
+    }
+    return bytes;
+}
+
+static std::string glyphComment(uint32_t cp) {
+    char buf[32];
+    if (cp >= 0x20 && cp < 0x7f) {
+        snprintf(buf, sizeof(buf), "'%c'", (char)cp);
+    } else {
+        snprintf(buf, sizeof(buf), "U+%04X", cp);
+    }
+    return buf;
+}
+
+static bool writeFont(FILE* out, const FontImage& font, const std::string& name, int bitsPerPixel,
+                      int spacing, std::string& error) {
+    int bytesPerColumn = (font.height * bitsPerPixel + 7) / 8;
+    size_t columns = 0;
+    for (const GlyphImage& glyph : font.glyphs) {
+        columns += glyph.width;
+    }
+    if (columns > 0xffff) {
+        error = name + " has " + std::to_string(columns) + " columns, offsets are 16 bit";
+        return false;
+    }
+    if (font.height > 255 || bytesPerColumn > 255) {
+        error = name + " is too tall";
+        return false;
+    }
+
+    fprintf(out, "constexpr uint8_t %sBitmap[] = {\n", name.c_str());
+    for (size_t i = 0; i < font.glyphs.size(); i++) {
+        const GlyphImage& glyph = font.glyphs[i];
+        if (glyph.width == 0) {
+            continue;
+        }
+        fprintf(out, "   ");
+        for (int c = 0; c < glyph.width; c++) {
+            std::vector<uint8_t> bytes = packColumn(&glyph.coverage[c * font.height], font.height, bitsPerPixel);
+            for (uint8_t b : bytes) {
+                fprintf(out, " 0x%02X,", b);
+            }
+        }
+        fprintf(out, "  // %s\n", glyphComment(font.first + i).c_str());
+    }
+    if (columns == 0) {
+        fprintf(out, "    0x00,\n");
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "constexpr uint8_t %sWidths[%zu] = {", name.c_str(), font.glyphs.size());
+    for (size_t i = 0; i < font.glyphs.size(); i++) {
+        fprintf(out, "%s%d,", i % 16 == 0 ? "\n    " : " ", font.glyphs[i].width);
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "constexpr uint16_t %sOffsets[%zu] = {", name.c_str(), font.glyphs.size());
+    size_t offset = 0;
+    for (size_t i = 0; i < font.glyphs.size(); i++) {
+        fprintf(out, "%s%zu,", i % 16 == 0 ? "\n    " : " ", offset);
+        offset += font.glyphs[i].width;
+    }
+    fprintf(out, "\n};\n\n");
+
+    std::string kerning = "nullptr";
+    if (!font.kerning.empty()) {
+        kerning = name + "Kerning";
+        fprintf(out, "constexpr KernPair %s[%zu] = {\n", kerning.c_str(), font.kerning.size());
+        for (const KernEntry& k : font.kerning) {
+            fprintf(out, "    {0x%04X, 0x%04X, %d},  // %s %s\n", k.left, k.right, k.adjust,
+                    glyphComment(k.left).c_str(), glyphComment(k.right).c_str());
+        }
+        fprintf(out, "};\n\n");
+    }
+
+    fprintf(out, "extern constexpr Font %s = {\n", name.c_str());
+    fprintf(out, "    %d, %d, %d, 0x%X, %zu, %sWidths, %sOffsets, %sBitmap,\n", font.height, bytesPerColumn, spacing,
+            font.first, font.glyphs.size(), name.c_str(), name.c_str(), name.c_str());
+    fprintf(out, "    %d, %d, %d, %d, %s, %zu\n", bitsPerPixel, font.ascent, font.descent, font.lineGap,
+            kerning.c_str(), font.kerning.size());
+    fprintf(out, "};\n");
+    return true;
+}
+
+static void put16(std::vector<uint8_t>& out, uint16_t v) {
+    out.push_back(v & 0xff);
+    out.push_back(v >> 8);
+}
+
+static void put32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back((v >> (8 * i)) & 0xff);
+    }
+}
+
+static bool writeStore(const FontImage& font, const std::string& path, std::string& error) {
+    if (font.height > MAX_STORE_HEIGHT) {
+        error = "glyph store fonts are at most " + std::to_string(MAX_STORE_HEIGHT) + " rows";
+        return false;
+    }
+    std::vector<uint16_t> level1(256, NO_GLYPH_PAGE);
+    std::vector<uint32_t> pages;
+    std::vector<uint8_t> data;
+    uint32_t glyphCount = 0;
+    size_t rleGlyphs = 0;
+    for (size_t i = 0; i < font.glyphs.size(); i++) {
+        const GlyphImage& glyph = font.glyphs[i];
+        uint32_t cp = font.first + i;
+        if (glyph.width == 0) {
+            continue;
+        }
+        if (glyph.width > MAX_STORE_WIDTH) {
+            error = "glyph " + glyphComment(cp) + " is wider than " + std::to_string(MAX_STORE_WIDTH);
+            return false;
+        }
+        if (level1[cp >> 8] == NO_GLYPH_PAGE) {
+            level1[cp >> 8] = pages.size() / 256;
+            pages.resize(pages.size() + 256, NO_GLYPH_RECORD);
+        }
+        pages[level1[cp >> 8] * 256 + (cp & 0xff)] = data.size();
+
+        std::vector<uint8_t> pixels(glyph.coverage.size());
+        for (size_t p = 0; p < pixels.size(); p++) {
+            pixels[p] = glyph.coverage[p] >= 128;
+        }
+        std::vector<uint8_t> packed((pixels.size() + 7) / 8, 0);
+        for (size_t p = 0; p < pixels.size(); p++) {
+            packed[p / 8] |= pixels[p] << (p % 8);
+        }
+        // Runs only when they are actually smaller than the plain bits
+        std::vector<uint8_t> runs(packed.size());
+        size_t runLength = encodeGlyphRuns(pixels.data(), pixels.size(), runs.data(), runs.size());
+        bool rle = runLength > 0 && runLength < packed.size();
+        const std::vector<uint8_t>& body = rle ? runs : packed;
+        size_t length = rle ? runLength : packed.size();
+        data.push_back(glyph.width);
+        data.push_back(rle ? GLYPH_RLE : 0);
+        put16(data, length);
+        data.insert(data.end(), body.begin(), body.begin() + length);
+        rleGlyphs += rle;
+        glyphCount++;
+    }
+
+    uint32_t pagesOffset = GLYPH_STORE_HEADER_SIZE + 256 * 2;
+    std::vector<uint8_t> out;
+    put32(out, GLYPH_STORE_MAGIC);
+    out.push_back(GLYPH_STORE_VERSION);
+    out.push_back(font.height);
+    out.push_back(font.ascent);
+    out.push_back(font.descent);
+    put32(out, glyphCount);
+    put32(out, pages.size() / 256);
+    put32(out, pagesOffset);
+    put32(out, pagesOffset + pages.size() * 4);
+    for (uint16_t page : level1) {
+        put16(out, page);
+    }
+    for (uint32_t record : pages) {
+        put32(out, record);
+    }
+    out.insert(out.end(), data.begin(), data.end());
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr || fwrite(out.data(), 1, out.size(), file) != out.size()) {
+        if (file != nullptr) {
+            fclose(file);
+        }
+        error = "cannot write " + path;
+        return false;
+    }
+    fclose(file);
+    printf("%u glyphs (%zu run length coded), %zu pages, %zu bytes\n", glyphCount, rleGlyphs,
+           pages.size() / 256, out.size());
+    return true;
+}
+
+static bool parseRange(const char* arg, uint32_t& first, uint32_t& last) {
+    char* end;
+    first = strtoul(arg, &end, 0);
+    if (*end != '-') {
+        return false;
+    }
+    last = strtoul(end + 1, &end, 0);
+    return *end == '\0' && first <= last && last <= 0xffff;
+}
+
+static int usage() {
+    fprintf(stderr, "usage: font_compiler [--range 0x20-0x7e] [--spacing N] [--line-gap N] [--aa] "
+                    "<font.bdf|font.ttf> <height> <name> <out.cpp>\n"
+                    "       font_compiler --store [--range 0x20-0x9fff] <font.bdf|font.ttf> <height> <out.bin>\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--range" && i + 1 < argc) {
+            if (!parseRange(argv[++i], opt.first, opt.last)) {
+                return usage();
+            }
+        } else if (arg == "--spacing" && i + 1 < argc) {
+            opt.spacing = atoi(argv[++i]);
+        } else if (arg == "--line-gap" && i + 1 < argc) {
+            opt.lineGap = atoi(argv[++i]);
+        } else if (arg == "--aa") {
+            opt.antiAliased = true;
+        } else if (arg == "--store") {
+            opt.store = true;
+        } else if (arg.compare(0, 2, "--") == 0) {
+            return usage();
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.size() != (opt.store ? 3u : 4u)) {
+        return usage();
+    }
+    opt.fontPath = positional[0];
+    opt.height = atoi(positional[1].c_str());
+    opt.name = opt.store ? "" : positional[2];
+    opt.outPath = positional.back();
+    if (opt.height <= 0 || opt.height > 255 || opt.spacing < 0 || opt.spacing > 255) {
+        return usage();
+    }
+
+    std::string error;
+    FontImage mono;
+    FontImage smooth;
+    if (opt.store) {
+        if (!loadFont(opt, false, mono, error) || !writeStore(mono, opt.outPath, error)) {
+            fprintf(stderr, "font_compiler: %s\n", error.c_str());
+            return 1;
+        }
+        return 0;
+    }
+    if (!loadFont(opt, false, mono, error) || (opt.antiAliased && !loadFont(opt, true, smooth, error))) {
+        fprintf(stderr, "font_compiler: %s\n", error.c_str());
+        return 1;
+    }
+    takeSpacing(mono, opt.spacing);
+    takeSpacing(smooth, opt.spacing);
+
+    // Written to a temporary and renamed so a failed run never leaves half a table behind
+    std::string tmpPath = opt.outPath + ".tmp";
+    FILE* out = fopen(tmpPath.c_str(), "w");
+    if (out == nullptr) {
+        fprintf(stderr, "font_compiler: cannot write %s\n", tmpPath.c_str());
+        return 1;
+    }
+    std::string source = opt.fontPath.substr(opt.fontPath.find_last_of("/\\") + 1);
+    fprintf(out, "// Generated by tools/font_compiler from %s, do not edit\n", source.c_str());
+    fprintf(out, "#include \"font.h\"\n\n");
+    bool ok = writeFont(out, mono, opt.name, 1, opt.spacing, error);
+    if (ok && opt.antiAliased) {
+        fprintf(out, "\n");
+        ok = writeFont(out, smooth, opt.name + "AA", 4, opt.spacing, error);
+    }
+    ok = fclose(out) == 0 && ok;
+    if (!ok || rename(tmpPath.c_str(), opt.outPath.c_str()) != 0) {
+        fprintf(stderr, "font_compiler: %s\n", error.empty() ? "write failed" : error.c_str());
+        remove(tmpPath.c_str());
+        return 1;
+    }
+    return 0;
+}
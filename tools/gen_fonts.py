@@ -0,0 +1,59 @@
+# Generates the font tables listed in fonts/fonts.txt into src/generated/.
+# Runs as a PlatformIO pre-build script (see platformio.ini) or by hand:
+#   python tools/gen_fonts.py
+# The host font compiler is built with the tools CMake project in build-tools/.
+# Tables are only regenerated when the font, the manifest or the compiler changed.
+import os
+import shlex
+import subprocess
+import sys
+
+try:
+    Import("env")  # noqa: F821, only defined inside PlatformIO
+    ROOT = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+FONTS = os.path.join(ROOT, "fonts")
+MANIFEST = os.path.join(FONTS, "fonts.txt")
+OUT = os.path.join(ROOT, "src", "generated")
+BUILD = os.path.join(ROOT, "build-tools")
+COMPILER = os.path.join(BUILD, "font_compiler.exe" if os.name == "nt" else "font_compiler")
+
+
+def build_compiler():
+    subprocess.check_call(["cmake", "-S", os.path.join(ROOT, "tools"), "-B", BUILD])
+    subprocess.check_call(["cmake", "--build", BUILD, "--target", "font_compiler"])
+
+
+def mtime(path):
+    return os.path.getmtime(path) if os.path.exists(path) else 0
+
+
+def generate():
+    build_compiler()
+    os.makedirs(OUT, exist_ok=True)
+    wanted = set()
+    with open(MANIFEST) as manifest:
+        for line in manifest:
+            words = shlex.split(line, comments=True)
+            if not words:
+                continue
+            if len(words) < 3:
+                sys.exit("fonts.txt: expected <file> <height> <name> [options]: " + line.strip())
+            font, height, name, options = words[0], words[1], words[2], words[3:]
+            source = os.path.join(FONTS, font)
+            target = os.path.join(OUT, name + ".cpp")
+            wanted.add(name + ".cpp")
+            newest = max(mtime(source), mtime(MANIFEST), mtime(COMPILER))
+            if mtime(target) >= newest:
+                continue
+            print("font_compiler: %s -> %s" % (font, os.path.relpath(target, ROOT)))
+            subprocess.check_call([COMPILER] + options + [source, height, name, target])
+    # Fonts dropped from the manifest must not stay in the build
+    for stale in os.listdir(OUT):
+        if stale.endswith(".cpp") and stale not in wanted:
+            os.remove(os.path.join(OUT, stale))
+
+
+generate()
@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "image_resample.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define RESAMPLE_SIMD "avx2"
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RESAMPLE_SIMD "sse2"
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define RESAMPLE_SIMD "neon"
+#endif
+
+// Separable filtering: a vertical pass over source rows, then a horizontal
+// pass over the columns it produced. Both are the same operation, a weighted
+// sum of a few contiguous lines, which is what the vector kernels do; the
+// intermediate is stored column-major so the second pass writes straight
+// into the column-major frame.
+
+// Source samples and weights for every destination sample along one axis
+struct Taps {
+    std::vector<int> start;     // destination d uses entries start[d] .. start[d + 1] - 1
+    std::vector<int> index;
+    std::vector<float> weight;
+};
+
+static int sourceIndex(int s, int size, bool wrap) {
+    if (wrap) {
+        return ((s % size) + size) % size;
+    }
+    return std::min(std::max(s, 0), size - 1);
+}
+
+static double lanczos3(double x) {
+    x = std::fabs(x);
+    if (x < 1e-9) {
+        return 1;
+    }
+    if (x >= 3) {
+        return 0;
+    }
+    double px = M_PI * x;
+    return 3 * std::sin(px) * std::sin(px / 3) / (px * px);
+}
+
+// The source window [srcStart, srcStart + srcSpan) maps onto dstSize samples
+static Taps makeTaps(int srcSize, double srcStart, double srcSpan, int dstSize, ResampleFilter filter, bool wrap) {
+    Taps taps;
+    double scale = srcSpan / dstSize;
+    std::vector<double> weights;
+    for (int d = 0; d < dstSize; d++) {
+        taps.start.push_back(taps.index.size());
+        weights.clear();
+        int first;
+        if (filter == FILTER_BOX) {
+            double lo = srcStart + d * scale;
+            double hi = lo + scale;
+            first = (int)std::floor(lo);
+            for (int s = first; s < hi; s++) {
+                weights.push_back(std::max(std::min(hi, s + 1.0) - std::max(lo, (double)s), 0.0));
+            }
+        } else {
+            // Widened when shrinking so every source pixel contributes
+            double stretch = std::max(scale, 1.0);
+            double center = srcStart + (d + 0.5) * scale;
+            first = (int)std::floor(center - 3 * stretch);
+            int last = (int)std::ceil(center + 3 * stretch);
+            for (int s = first; s <= last; s++) {
+                weights.push_back(lanczos3((s + 0.5 - center) / stretch));
+            }
+        }
+        double total = 0;
+        for (double w : weights) {
+            total += w;
+        }
+        for (size_t k = 0; k < weights.size(); k++) {
+            if (weights[k] != 0) {
+                taps.index.push_back(sourceIndex(first + (int)k, srcSize, wrap));
+                taps.weight.push_back((float)(total != 0 ? weights[k] / total : 0));
+            }
+        }
+    }
+    taps.start.push_back(taps.index.size());
+    return taps;
+}
+
+// out[i] = sum over k of weights[k] * lines[k][i], summed in order of k so
+// the scalar and vector results are identical
+template <typename T>
+static void weightedSumScalar(const T* const* lines, const float* weights, int taps, size_t n, float* out,
+                              size_t from = 0) {
+    for (size_t i = from; i < n; i++) {
+        float acc = 0;
+        for (int k = 0; k < taps; k++) {
+            acc += weights[k] * lines[k][i];
+        }
+        out[i] = acc;
+    }
+}
+
+#ifdef RESAMPLE_SIMD
+#if defined(__AVX2__)
+typedef __m256 Vec;
+const size_t LANES = 8;
+static inline Vec vload(const float* p) { return _mm256_loadu_ps(p); }
+static inline Vec vload(const uint8_t* p) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p)));
+}
+static inline Vec vzero() { return _mm256_setzero_ps(); }
+static inline Vec vmuladd(Vec acc, float w, Vec x) { return _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(w), x)); }
+static inline void vstore(float* p, Vec v) { _mm256_storeu_ps(p, v); }
+#elif defined(__ARM_NEON)
+typedef float32x4_t Vec;
+const size_t LANES = 4;
+static inline Vec vload(const float* p) { return vld1q_f32(p); }
+static inline Vec vload(const uint8_t* p) {
+    uint32_t four;
+    memcpy(&four, p, 4);
+    uint16x8_t wide = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(four)));
+    return vcvtq_f32_u32(vmovl_u16(vget_low_u16(wide)));
+}
+static inline Vec vzero() { return vdupq_n_f32(0); }
+static inline Vec vmuladd(Vec acc, float w, Vec x) { return vaddq_f32(acc, vmulq_f32(vdupq_n_f32(w), x)); }
+static inline void vstore(float* p, Vec v) { vst1q_f32(p, v); }
+#else
+typedef __m128 Vec;
+const size_t LANES = 4;
+static inline Vec vload(const float* p) { return _mm_loadu_ps(p); }
+static inline Vec vload(const uint8_t* p) {
+    int four;
+    memcpy(&four, p, 4);
+    __m128i zero = _mm_setzero_si128();
+    __m128i bytes = _mm_cvtsi32_si128(four);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero));
+}
+static inline Vec vzero() { return _mm_setzero_ps(); }
+static inline Vec vmuladd(Vec acc, float w, Vec x) { return _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w), x)); }
+static inline void vstore(float* p, Vec v) { _mm_storeu_ps(p, v); }
+#endif
+
+template <typename T>
+static void weightedSumSimd(const T* const* lines, const float* weights, int taps, size_t n, float* out) {
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        Vec acc = vzero();
+        for (int k = 0; k < taps; k++) {
+            acc = vmuladd(acc, weights[k], vload(lines[k] + i));
+        }
+        vstore(out + i, acc);
+    }
+    weightedSumScalar(lines, weights, taps, n, out, i);
+}
+#endif
+
+template <typename T>
+static void weightedSum(const T* const* lines, const float* weights, int taps, size_t n, float* out, bool simd) {
+#ifdef RESAMPLE_SIMD
+    if (simd) {
+        weightedSumSimd(lines, weights, taps, n, out);
+        return;
+    }
+#endif
+    (void)simd;
+    weightedSumScalar(lines, weights, taps, n, out);
+}
+
+const char* resampleSimdName() {
+#ifdef RESAMPLE_SIMD
+    return RESAMPLE_SIMD;
+#else
+    return "scalar";
+#endif
+}
+
+// Source window and destination box for the fit mode, in pixels
+struct FitWindow {
+    double srcX, srcY, srcW, srcH;
+    int dstX, dstY, dstW, dstH;
+};
+
+static FitWindow fitWindow(const HostImage& image, const ResampleOptions& options) {
+    FitWindow w = {0, 0, (double)image.width, (double)image.height, 0, 0, WIDTH, HEIGHT};
+    if (options.fit == FIT_STRETCH) {
+        return w;
+    }
+    double srcAspect = (double)image.width / image.height;
+    double dstAspect = options.circumference / options.height;
+    if (options.wrap) {
+        // The width always goes once around; only the height can be cropped or barred
+        if (srcAspect < dstAspect) {
+            w.srcH = image.width / dstAspect;
+            w.srcY = (image.height - w.srcH) / 2;
+        } else {
+            w.dstH = std::max(1, (int)std::lround(HEIGHT * dstAspect / srcAspect));
+            w.dstY = (HEIGHT - w.dstH) / 2;
+        }
+    } else if ((options.fit == FIT_COVER) == (srcAspect > dstAspect)) {
+        if (options.fit == FIT_COVER) {
+            w.srcW = image.height * dstAspect;
+            w.srcX = (image.width - w.srcW) / 2;
+        } else {
+            w.dstW = std::max(1, (int)std::lround(WIDTH * srcAspect / dstAspect));
+            w.dstX = (WIDTH - w.dstW) / 2;
+        }
+    } else {
+        if (options.fit == FIT_COVER) {
+            w.srcH = image.width / dstAspect;
+            w.srcY = (image.height - w.srcH) / 2;
+        } else {
+            w.dstH = std::max(1, (int)std::lround(HEIGHT * dstAspect / srcAspect));
+            w.dstY = (HEIGHT - w.dstH) / 2;
+        }
+    }
+    return w;
+}
+
+void resampleToFrame(const HostImage& image, const ResampleOptions& options, RGB* frame) {
+    std::fill(frame, frame + (size_t)WIDTH * HEIGHT, RGB{0, 0, 0});
+    if (image.width == 0 || image.height == 0) {
+        return;
+    }
+    FitWindow w = fitWindow(image, options);
+    Taps xTaps = makeTaps(image.width, w.srcX, w.srcW, w.dstW, options.filter, options.wrap);
+    Taps yTaps = makeTaps(image.height, w.srcY, w.srcH, w.dstH, options.filter, false);
+
+    // Only the source columns the horizontal pass reads go through the vertical pass
+    int lo = *std::min_element(xTaps.index.begin(), xTaps.index.end());
+    int hi = *std::max_element(xTaps.index.begin(), xTaps.index.end());
+    size_t columnCount = hi - lo + 1;
+    size_t columnLength = (size_t)w.dstH * 3;
+
+    std::vector<float> row(columnCount * 3);
+    std::vector<float> columns(columnCount * columnLength);
+    std::vector<const uint8_t*> rowLines;
+    for (int y = 0; y < w.dstH; y++) {
+        rowLines.clear();
+        for (int j = yTaps.start[y]; j < yTaps.start[y + 1]; j++) {
+            rowLines.push_back(&image.rgb[((size_t)yTaps.index[j] * image.width + lo) * 3]);
+        }
+        weightedSum(rowLines.data(), &yTaps.weight[yTaps.start[y]], rowLines.size(), row.size(), row.data(),
+                    options.simd);
+        for (size_t c = 0; c < columnCount; c++) {
+            memcpy(&columns[c * columnLength + y * 3], &row[c * 3], 3 * sizeof(float));
+        }
+    }
+
+    std::vector<float> column(columnLength);
+    std::vector<const float*> columnLines;
+    for (int x = 0; x < w.dstW; x++) {
+        columnLines.clear();
+        for (int j = xTaps.start[x]; j < xTaps.start[x + 1]; j++) {
+            columnLines.push_back(&columns[(xTaps.index[j] - lo) * columnLength]);
+        }
+        weightedSum(columnLines.data(), &xTaps.weight[xTaps.start[x]], columnLines.size(), columnLength,
+                    column.data(), options.simd);
+        uint8_t* out = (uint8_t*)(frame + (size_t)(w.dstX + x) * HEIGHT + w.dstY);
+        for (size_t i = 0; i < columnLength; i++) {
+            float v = std::min(std::max(column[i], 0.0f), 255.0f);
+            out[i] = (uint8_t)(v + 0.5f);
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef IMAGE_RESAMPLE_H
+#define IMAGE_RESAMPLE_H
+#include <stdint.h>
+#include <vector>
+#include "display_types.h"
+
+// Host side image handling for the asset tools: decoded images are row-major
+// RGB, device frames are column-major (see src/image_codec.h).
+struct HostImage {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> rgb;  // width * height * 3, row-major
+};
+
+enum FitMode {
+    FIT_STRETCH,   // whole image, aspect ratio not kept
+    FIT_CONTAIN,   // whole image, black bars
+    FIT_COVER      // fills the surface, edges cropped
+};
+
+enum ResampleFilter {
+    FILTER_BOX,       // area average, no ringing, softer
+    FILTER_LANCZOS3   // sharper, slight ringing on hard edges
+};
+
+// The surface is WIDTH columns around and HEIGHT LEDs high, but a column and
+// a row need not be the same physical size, so fits keep the aspect ratio of
+// the cylinder (circumference : height in any unit) rather than of the grid.
+// The defaults are the 10 cm diameter, 1 mm pixel cylinder from display.cpp.
+struct ResampleOptions {
+    FitMode fit = FIT_STRETCH;
+    ResampleFilter filter = FILTER_LANCZOS3;
+    // The image is a 360 degree panorama: it always spans the circumference
+    // and the filter reads across its left/right edge, so there is no seam
+    bool wrap = false;
+    double circumference = WIDTH;
+    double height = HEIGHT;
+    bool simd = true;  // false forces the scalar kernels, for testing and benchmarks
+};
+
+// Filtered resample to WIDTH x HEIGHT, frame is column-major
+void resampleToFrame(const HostImage& image, const ResampleOptions& options, RGB* frame);
+
+// Instruction set of the vector kernels, "scalar" if none was compiled in.
+// Both produce bit-identical frames.
+const char* resampleSimdName();
+
+#endif // IMAGE_RESAMPLE_H
@@ -0,0 +1,162 @@
+// Converts an event trace from the device (src/trace.h) into Chrome trace
+// JSON, for chrome://tracing or ui.perfetto.dev:
+//
+//   curl -o trace.bin http://<device>/trace && trace_convert trace.bin trace.json
+//   trace_convert serial.log trace.json     (a capture of the 'trace:dump' command)
+//
+// Every core is a thread. Begin/end pairs become slices; an end whose begin
+// was already overwritten in the ring is dropped.
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "trace.h"
+
+// Mode in display.cpp, the argument of render events
+static const char* const MODE_NAMES[] = {"menu", "characters", "pictures", "videos", "layers", "effects", "vectors"};
+
+static bool readBinary(const std::string& data, std::vector<TraceRecord>& records, uint32_t& dropped) {
+    TraceHeader header;
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != TRACE_MAGIC || header.version != TRACE_VERSION || header.recordSize != sizeof(TraceRecord)
+        || data.size() < sizeof(header) + (size_t)header.count * sizeof(TraceRecord)) {
+        return false;
+    }
+    records.resize(header.count);
+    memcpy(records.data(), data.data() + sizeof(header), header.count * sizeof(TraceRecord));
+    dropped = header.dropped;
+    return true;
+}
+
+// The last TRACE BEGIN ... TRACE END block of a serial capture
+static bool readSerial(const std::string& data, std::vector<TraceRecord>& records, uint32_t& dropped) {
+    std::istringstream in(data);
+    std::string line;
+    bool inside = false, found = false;
+    std::vector<TraceRecord> block;
+    while (std::getline(in, line)) {
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+            line.pop_back();
+        }
+        unsigned count, lost;
+        if (sscanf(line.c_str(), "TRACE BEGIN %u %u", &count, &lost) == 2) {
+            inside = true;
+            block.clear();
+            dropped = lost;
+            continue;
+        }
+        if (!inside) {
+            continue;
+        }
+        if (line == "TRACE END") {
+            inside = false;
+            found = true;
+            records = block;
+            continue;
+        }
+        if (line.size() != 2 * sizeof(TraceRecord)) {
+            continue;   // output of another task in the middle of the dump
+        }
+        TraceRecord r;
+        uint8_t* bytes = (uint8_t*)&r;
+        bool ok = true;
+        for (size_t b = 0; b < sizeof(r) && ok; b++) {
+            unsigned v;
+            ok = sscanf(line.c_str() + 2 * b, "%2x", &v) == 1;
+            bytes[b] = (uint8_t)v;
+        }
+        if (ok) {
+            block.push_back(r);
+        }
+    }
+    return found;
+}
+
+static std::string argJson(const TraceRecord& r) {
+    char buf[64];
+    if (r.event == TRACE_RENDER && r.arg < sizeof(MODE_NAMES) / sizeof(MODE_NAMES[0])) {
+        snprintf(buf, sizeof(buf), "{\"mode\":\"%s\"}", MODE_NAMES[r.arg]);
+    } else if (r.event == TRACE_COMMAND) {
+        std::string verb;
+        for (int i = 0; i < 4; i++) {
+            char c = (char)(r.arg >> (8 * i));
+            if (c >= 0x20 && c < 0x7f && c != '"' && c != '\\') {
+                verb += c;
+            }
+        }
+        snprintf(buf, sizeof(buf), "{\"verb\":\"%s\"}", verb.c_str());
+    } else if (r.event == TRACE_UPLOAD || r.event == TRACE_FLASH_READ || r.event == TRACE_FLASH_WRITE) {
+        snprintf(buf, sizeof(buf), "{\"bytes\":%u}", (unsigned)r.arg);
+    } else {
+        snprintf(buf, sizeof(buf), "{\"arg\":%u}", (unsigned)r.arg);
+    }
+    return buf;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: trace_convert <trace.bin|serial log> <out.json>\n");
+        return 2;
+    }
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        fprintf(stderr, "trace_convert: cannot read %s\n", argv[1]);
+        return 1;
+    }
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::vector<TraceRecord> records;
+    uint32_t dropped = 0;
+    if (!readBinary(data, records, dropped) && !readSerial(data, records, dropped)) {
+        fprintf(stderr, "trace_convert: %s is neither a /trace download nor a serial capture of trace:dump\n",
+                argv[1]);
+        return 1;
+    }
+
+    FILE* out = fopen(argv[2], "w");
+    if (out == nullptr) {
+        fprintf(stderr, "trace_convert: cannot write %s\n", argv[2]);
+        return 1;
+    }
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"POV display\"}}");
+    for (int core = 0; core < 2; core++) {
+        fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"core %d\"}}",
+                core, core);
+    }
+
+    // Timestamps are 32 bit microseconds, unwrapped here
+    uint64_t base = 0;
+    uint32_t last = records.empty() ? 0 : records[0].us;
+    int open[2][TRACE_EVENT_COUNT] = {};
+    size_t written = 0, orphans = 0;
+    for (const TraceRecord& r : records) {
+        if (r.us < last && last - r.us > 0x80000000u) {
+            base += 0x100000000ULL;
+        }
+        last = r.us;
+        if (r.core > 1 || r.event >= TRACE_EVENT_COUNT || r.phase > TRACE_INSTANT) {
+            orphans++;
+            continue;
+        }
+        int& depth = open[r.core][r.event];
+        if (r.phase == TRACE_END && depth == 0) {
+            orphans++;
+            continue;
+        }
+        depth += r.phase == TRACE_BEGIN ? 1 : r.phase == TRACE_END ? -1 : 0;
+        const char* phase = r.phase == TRACE_BEGIN ? "B" : r.phase == TRACE_END ? "E" : "i";
+        fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%llu,\"pid\":1,\"tid\":%u,\"args\":%s}",
+                traceEventName(r.event), phase, (unsigned long long)(base + r.us), (unsigned)r.core,
+                argJson(r).c_str());
+        written++;
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    printf("%zu events, %zu skipped, %u overwritten on the device\n", written, orphans, (unsigned)dropped);
+    return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef VECTOR_WRITER_H
+#define VECTOR_WRITER_H
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "vector_scene.h"
+
+// Builds scenes in the format of src/vector_scene.h for the host tools.
+// Coordinates are in LEDs here and stored as 1/16 LED; angles in degrees.
+class VectorWriter {
+public:
+    VectorWriter() : shapes(0) {}
+
+    void line(double x0, double y0, double x1, double y1, double width, RGB color) {
+        begin(VECTOR_LINE, 0, color);
+        coord(x0);
+        coord(y0);
+        coord(x1);
+        coord(y1);
+        put16((uint16_t)coord16(width));
+    }
+    void rect(double x, double y, double w, double h, RGB color) {
+        begin(VECTOR_RECT, 0, color);
+        coord(x);
+        coord(y);
+        coord(w);
+        coord(h);
+    }
+    void polygon(const std::vector<double>& xy, RGB color) {
+        begin(VECTOR_POLYGON, 0, color);
+        bytes.push_back((uint8_t)(xy.size() / 2));
+        for (double v : xy) {
+            coord(v);
+        }
+    }
+    void arc(double cx, double cy, double radius, double startDegrees, double sweepDegrees, double width,
+             bool filled, RGB color) {
+        begin(VECTOR_ARC, filled ? VECTOR_FILLED : 0, color);
+        coord(cx);
+        coord(cy);
+        put16((uint16_t)coord16(radius));
+        put16(angle16(startDegrees));
+        put16(sweepDegrees >= 360 ? 0 : angle16(sweepDegrees));
+        put16((uint16_t)coord16(width));
+    }
+
+    // The finished scene, header first
+    std::vector<uint8_t> scene() const {
+        std::vector<uint8_t> out = {(uint8_t)VECTOR_MAGIC, (uint8_t)(VECTOR_MAGIC >> 8), (uint8_t)(VECTOR_MAGIC >> 16),
+                                    (uint8_t)(VECTOR_MAGIC >> 24), VECTOR_VERSION, 0, (uint8_t)shapes,
+                                    (uint8_t)(shapes >> 8)};
+        out.resize(VECTOR_HEADER_SIZE + bytes.size());
+        std::copy(bytes.begin(), bytes.end(), out.begin() + VECTOR_HEADER_SIZE);
+        return out;
+    }
+    uint16_t shapeCount() const { return shapes; }
+
+private:
+    static int16_t coord16(double v) { return (int16_t)std::lround(v * 16); }
+    static uint16_t angle16(double degrees) {
+        return (uint16_t)((int64_t)std::lround(degrees / 360 * 65536) & 0xffff);
+    }
+    void begin(uint8_t type, uint8_t flags, RGB color) {
+        bytes.insert(bytes.end(), {type, flags, color.r, color.g, color.b});
+        shapes++;
+    }
+    void coord(double v) { put16((uint16_t)coord16(v)); }
+    void put16(uint16_t v) {
+        bytes.push_back(v & 0xff);
+        bytes.push_back(v >> 8);
+    }
+
+    std::vector<uint8_t> bytes;
+    uint16_t shapes;
+};
+
+#endif // VECTOR_WRITER_H